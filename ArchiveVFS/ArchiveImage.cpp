@@ -0,0 +1,96 @@
+/*      ArchiveImage
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ArchiveImage.hpp"
+#include <algorithm>
+
+int ArchiveImage::Load(const TSTRING &inPath) {
+  path = inPath;
+
+  if (!file.Open(path, RawFile::READ)) {
+    printerror("Cannot open: ", << path);
+    return 1;
+  }
+
+  int magic = 0;
+  file.ReadAt(0, reinterpret_cast<char *>(&magic), sizeof(magic));
+
+  if (magic == AAF::ID) {
+    compression = SARC::C_AAF;
+    rd.reset(new BinReader(path));
+
+    if (aafBuf.Load(rd.get())) {
+      printerror("Invalid AAF file: ", << path);
+      return 2;
+    }
+
+    imageSize = aafBuf.Size();
+    imageStream.rdbuf(&aafBuf);
+  } else if (static_cast<uchar>(magic) == 0x78) {
+    compression = SARC::C_ZLIB;
+
+    if (!zlibBuf.Load(&file)) {
+      printerror("Cannot inflate Zlib stream: ", << path);
+      return 2;
+    }
+
+    imageStream.rdbuf(&zlibBuf);
+  } else {
+    imageSize = file.Size();
+    rd.reset(new BinReader(path));
+    sarc = SARC::Create(rd.get());
+  }
+
+  if (compression != SARC::C_NONE) {
+    imageReader.SetStream(imageStream);
+    sarc = SARC::Create(&imageReader);
+
+    if (sarc && imageStream.fail()) {
+      printerror("Corrupted archive: ", << path);
+      return 2;
+    }
+  }
+
+  if (!sarc) {
+    printerror("Unknown archive format: ", << path);
+    return 2;
+  }
+
+  return 0;
+}
+
+bool ArchiveImage::ReadImage(size_t offset, char *buffer, size_t size) {
+  if (compression == SARC::C_NONE)
+    return file.ReadAt(offset, buffer, size);
+
+  imageStream.clear();
+  imageStream.seekg(offset);
+  imageStream.read(buffer, size);
+
+  return static_cast<size_t>(imageStream.gcount()) == size;
+}
+
+size_t ArchiveImage::BlockID(size_t offset) const {
+  auto &blocks = aafBuf.Blocks();
+  auto found = std::upper_bound(
+      blocks.begin(), blocks.end(), offset,
+      [](size_t offset, const AAFReadBuf::Block &b) {
+        return offset < b.offset;
+      });
+
+  return std::distance(blocks.begin(), found) - 1;
+}
@@ -0,0 +1,46 @@
+/*      ArchiveImage
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "ArchiveStream.hpp"
+#include "RawFile.hpp"
+#include <memory>
+
+// Archive opened for reading.
+// AAF and zlib archives are inflated on demand.
+struct ArchiveImage {
+  TSTRING path;
+  RawFile file;
+  std::unique_ptr<BinReader> rd;
+  SARC::Ptr sarc;
+  SARC::CompressionType compression = SARC::C_NONE;
+  AAFReadBuf aafBuf;
+  ZlibReadBuf zlibBuf;
+  std::istream imageStream{nullptr};
+  BinReader imageReader;
+  // Unknown (0) for zlib archives, until stream is inflated to its end
+  size_t imageSize = 0;
+
+  int Load(const TSTRING &inPath);
+  // Reader over uncompressed image
+  BinReader *Reader() {
+    return compression == SARC::C_NONE ? rd.get() : &imageReader;
+  }
+  bool ReadImage(size_t offset, char *buffer, size_t size);
+  // Index of AAF block containing image offset
+  size_t BlockID(size_t offset) const;
+};
@@ -0,0 +1,508 @@
+/*      Streaming archive compression/decompression
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ArchiveStream.hpp"
+#include <algorithm>
+
+static constexpr size_t ZLIB_CHUNK_SIZE = 0x100000;
+static constexpr size_t ZLIB_CHECKPOINT_SPACING = 0x800000;
+
+CompressStreamBuf::CompressStreamBuf(size_t chunkSize)
+    : chunk(BufferPool::Acquire(chunkSize)) {
+  if (!chunk) {
+    printerror("Cannot allocate compression buffer.");
+    status = Z_MEM_ERROR;
+  }
+
+  setp(chunk.Data(), chunk.Data() + (chunk ? chunkSize : 0));
+}
+
+bool CompressStreamBuf::FlushChunk() {
+  const size_t size = pptr() - pbase();
+
+  if (status || (status = Flush(pbase(), size, false)))
+    return false;
+
+  flushedSize += size;
+  setp(pbase(), epptr());
+
+  return true;
+}
+
+CompressStreamBuf::int_type CompressStreamBuf::overflow(int_type ch) {
+  if (!FlushChunk())
+    return traits_type::eof();
+
+  if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+  }
+
+  return traits_type::not_eof(ch);
+}
+
+std::streamsize CompressStreamBuf::xsputn(const char *data,
+                                          std::streamsize size) {
+  std::streamsize written = 0;
+
+  while (written < size) {
+    if (pptr() == epptr() && !FlushChunk())
+      break;
+
+    const std::streamsize toCopy =
+        std::min<std::streamsize>(size - written, epptr() - pptr());
+    memcpy(pptr(), data + written, toCopy);
+    pbump(static_cast<int>(toCopy));
+    written += toCopy;
+  }
+
+  return written;
+}
+
+CompressStreamBuf::pos_type
+CompressStreamBuf::seekoff(off_type offset, std::ios_base::seekdir dir,
+                           std::ios_base::openmode which) {
+  if (offset || dir != std::ios_base::cur || !(which & std::ios_base::out))
+    return pos_type(off_type(-1));
+
+  return pos_type(flushedSize + (pptr() - pbase()));
+}
+
+int CompressStreamBuf::Finish() {
+  if (status)
+    return status;
+
+  const size_t size = pptr() - pbase();
+  status = Flush(pbase(), size, true);
+  flushedSize += size;
+  setp(pbase(), pbase());
+
+  return status;
+}
+
+AAFStreamBuf::AAFStreamBuf(BinWritter *output, bool bigEndian)
+    : CompressStreamBuf(AAF::MAX_BLOCK_SIZE), wr(output),
+      headerOffset(output->Tell()), bigEndian(bigEndian) {
+  wr->Write(AAF::Header());
+}
+
+int AAFStreamBuf::Flush(const char *data, size_t size, bool last) {
+  if (uncompressedSize + size > SARC::MAX_OFFSET) {
+    printerror("[AAF] Archives over 4 GB are not supported.");
+    return 1;
+  }
+
+  if (size || !numBlocks) {
+    EWAM ew;
+    ew.intermediateData = const_cast<char *>(data);
+    ew.header.uncompressedSize = static_cast<int>(size);
+
+    if (bigEndian ? ew.Write<true>(wr) : ew.Write<false>(wr))
+      return 2;
+
+    uncompressedSize += size;
+    numBlocks++;
+  }
+
+  if (!last)
+    return 0;
+
+  AAF::Header header;
+  header.uncompressedSize = static_cast<uint>(uncompressedSize);
+  header.blockCount = numBlocks;
+  header.blockSize = numBlocks > 1 ? AAF::MAX_BLOCK_SIZE
+                                   : static_cast<uint>(uncompressedSize);
+
+  if (bigEndian)
+    AAF::SwapHeader<true>(header);
+
+  const size_t endOffset = wr->Tell();
+  wr->Seek(headerOffset);
+  wr->Write(header);
+  wr->Seek(endOffset);
+
+  return 0;
+}
+
+ZlibStreamBuf::ZlibStreamBuf(BinWritter *output)
+    : CompressStreamBuf(ZLIB_CHUNK_SIZE), wr(output) {
+  stream.zalloc = Z_NULL;
+  stream.zfree = Z_NULL;
+  stream.opaque = Z_NULL;
+  deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, MAX_WBITS, 8,
+               Z_DEFAULT_STRATEGY);
+  outBuffer.resize(ZLIB_CHUNK_SIZE);
+}
+
+ZlibStreamBuf::~ZlibStreamBuf() { deflateEnd(&stream); }
+
+int ZlibStreamBuf::Flush(const char *data, size_t size, bool last) {
+  const int flush = last ? Z_FINISH : Z_NO_FLUSH;
+  stream.avail_in = static_cast<uInt>(size);
+  stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+  int state;
+
+  do {
+    stream.avail_out = static_cast<uInt>(outBuffer.size());
+    stream.next_out = reinterpret_cast<Bytef *>(&outBuffer[0]);
+    state = deflate(&stream, flush);
+
+    if (state == Z_STREAM_ERROR) {
+      printerror("[ZLIB] Stream error.");
+      return 1;
+    }
+
+    wr->WriteBuffer(outBuffer.data(), outBuffer.size() - stream.avail_out);
+  } while (!stream.avail_out);
+
+  if (last && state != Z_STREAM_END) {
+    printerror("[ZLIB] Expected Z_STREAM_END.");
+    return 1;
+  }
+
+  return 0;
+}
+
+int AAFReadBuf::Load(BinReader *input) {
+  rd = input;
+  const size_t begin = rd->Tell();
+  AAF::Header header;
+  rd->Read(header);
+  rd->Seek(begin);
+  bigEndian = header.IsBigEndian();
+
+  return bigEndian ? Load<true>() : Load<false>();
+}
+
+template <bool BE> int AAFReadBuf::Load() {
+  AAF::Header header;
+  rd->Read(header);
+  AAF::SwapHeader<BE>(header);
+
+  if (header.id != AAF::ID)
+    return 1;
+
+  if (memcmp(header.id2, AAF::ID2, sizeof(AAF::ID2)))
+    return 2;
+
+  size_t cOffset = rd->Tell();
+
+  for (uint b = 0; b < header.blockCount; b++) {
+    EWAM::Header bHeader;
+    rd->Seek(cOffset);
+    rd->Read(bHeader);
+    EWAM::SwapHeader<BE>(bHeader);
+
+    if (!rd->IsValid() || bHeader.id != EWAM::ID ||
+        bHeader.uncompressedSize < 0 ||
+        bHeader.uncompressedSize > AAF::MAX_BLOCK_SIZE ||
+        bHeader.compressedSize < 0 || bHeader.nextBlock <= 0)
+      return 3;
+
+    Block cBlock;
+    cBlock.offset = imageSize;
+    cBlock.fileOffset = cOffset + sizeof(EWAM::Header);
+    cBlock.compressedSize = bHeader.compressedSize;
+    cBlock.uncompressedSize = bHeader.uncompressedSize;
+    blocks.push_back(cBlock);
+
+    imageSize += bHeader.uncompressedSize;
+    cOffset += bHeader.nextBlock;
+  }
+
+  if (imageSize != header.uncompressedSize)
+    return 3;
+
+  setg(nullptr, nullptr, nullptr);
+
+  return 0;
+}
+
+bool AAFReadBuf::LoadBlock(size_t id) {
+  const Block &cBlock = blocks[id];
+
+  if (!blockData)
+    blockData = BufferPool::Acquire(AAF::MAX_BLOCK_SIZE);
+
+  BufferPool::Buffer compressed = BufferPool::Acquire(cBlock.compressedSize);
+
+  if (!blockData || !compressed) {
+    printerror("[AAF] Cannot allocate block buffers.");
+    setg(nullptr, nullptr, nullptr);
+    return false;
+  }
+
+  rd->Seek(cBlock.fileOffset);
+  rd->ReadBuffer(compressed.Data(), cBlock.compressedSize);
+
+  const int state =
+      EWAM::Inflate(compressed.Data(), cBlock.compressedSize,
+                    blockData.Data(), cBlock.uncompressedSize);
+
+  if (state != Z_STREAM_END) {
+    printerror("[ZLIB] Expected Z_STREAM_END.");
+    setg(nullptr, nullptr, nullptr);
+    return false;
+  }
+
+  areaOffset = cBlock.offset;
+  nextBlock = id + 1;
+  setg(blockData.Data(), blockData.Data(),
+       blockData.Data() + cBlock.uncompressedSize);
+
+  return true;
+}
+
+AAFReadBuf::int_type AAFReadBuf::underflow() {
+  if (gptr() < egptr())
+    return traits_type::to_int_type(*gptr());
+
+  // Skip empty blocks
+  while (nextBlock < blocks.size()) {
+    if (!LoadBlock(nextBlock))
+      return traits_type::eof();
+
+    if (gptr() < egptr())
+      return traits_type::to_int_type(*gptr());
+  }
+
+  return traits_type::eof();
+}
+
+AAFReadBuf::pos_type AAFReadBuf::seekoff(off_type offset,
+                                         std::ios_base::seekdir dir,
+                                         std::ios_base::openmode which) {
+  const size_t current = areaOffset + (gptr() - eback());
+
+  if (dir == std::ios_base::cur && !offset)
+    return pos_type(current);
+
+  size_t position = offset;
+
+  if (dir == std::ios_base::cur)
+    position = current + offset;
+  else if (dir == std::ios_base::end)
+    position = imageSize + offset;
+
+  return seekpos(pos_type(position), which);
+}
+
+AAFReadBuf::pos_type AAFReadBuf::seekpos(pos_type position,
+                                         std::ios_base::openmode which) {
+  const size_t target = static_cast<size_t>(off_type(position));
+
+  if (!(which & std::ios_base::in) || target > imageSize)
+    return pos_type(off_type(-1));
+
+  if (target >= areaOffset && target < areaOffset + (egptr() - eback())) {
+    setg(eback(), eback() + (target - areaOffset), egptr());
+    return position;
+  }
+
+  if (target == imageSize) {
+    areaOffset = imageSize;
+    nextBlock = blocks.size();
+    setg(nullptr, nullptr, nullptr);
+    return position;
+  }
+
+  auto found = std::upper_bound(
+      blocks.begin(), blocks.end(), target,
+      [](size_t offset, const Block &b) { return offset < b.offset; });
+  const size_t id = std::distance(blocks.begin(), found) - 1;
+
+  if (!LoadBlock(id))
+    return pos_type(off_type(-1));
+
+  setg(eback(), eback() + (target - areaOffset), egptr());
+
+  return position;
+}
+
+ZlibReadBuf::~ZlibReadBuf() {
+  if (streamValid)
+    inflateEnd(&stream);
+
+  for (auto &c : checkpoints)
+    inflateEnd(&c->stream);
+}
+
+bool ZlibReadBuf::Load(const RawFile *input) {
+  file = input;
+  fileSize = file->Size();
+  inBuffer = BufferPool::Acquire(ZLIB_CHUNK_SIZE);
+  outBuffer = BufferPool::Acquire(ZLIB_CHUNK_SIZE);
+  setg(nullptr, nullptr, nullptr);
+
+  if (!inBuffer || !outBuffer) {
+    printerror("[ZLIB] Cannot allocate stream buffers.");
+    return false;
+  }
+
+  streamValid = inflateInit2(&stream, MAX_WBITS) == Z_OK;
+
+  return streamValid && AddCheckpoint();
+}
+
+bool ZlibReadBuf::AddCheckpoint() {
+  std::unique_ptr<Checkpoint> checkpoint(new Checkpoint());
+
+  if (inflateCopy(&checkpoint->stream, &stream) != Z_OK)
+    return false;
+
+  checkpoint->imageOffset = streamOffset;
+  checkpoint->fileOffset = fileOffset - stream.avail_in;
+  checkpoints.push_back(std::move(checkpoint));
+
+  return true;
+}
+
+bool ZlibReadBuf::Restore(Checkpoint &checkpoint) {
+  if (streamValid)
+    inflateEnd(&stream);
+
+  streamValid = inflateCopy(&stream, &checkpoint.stream) == Z_OK;
+  setg(nullptr, nullptr, nullptr);
+
+  if (!streamValid)
+    return false;
+
+  // Input buffer of checkpoint is gone, it's read again
+  stream.avail_in = 0;
+  fileOffset = checkpoint.fileOffset;
+  areaOffset = streamOffset = checkpoint.imageOffset;
+  streamEnd = false;
+
+  return true;
+}
+
+// Replaces get area with next inflated chunk
+bool ZlibReadBuf::InflateChunk() {
+  areaOffset = streamOffset;
+  setg(nullptr, nullptr, nullptr);
+
+  if (!streamValid || streamEnd)
+    return false;
+
+  if (streamOffset >=
+          checkpoints.back()->imageOffset + ZLIB_CHECKPOINT_SPACING &&
+      !AddCheckpoint())
+    return false;
+
+  stream.next_out = reinterpret_cast<Bytef *>(outBuffer.Data());
+  stream.avail_out = static_cast<uInt>(ZLIB_CHUNK_SIZE);
+
+  while (stream.avail_out) {
+    if (!stream.avail_in) {
+      const size_t toRead = std::min(fileSize - fileOffset, ZLIB_CHUNK_SIZE);
+
+      if (!toRead || !file->ReadAt(fileOffset, inBuffer.Data(), toRead))
+        break;
+
+      fileOffset += toRead;
+      stream.next_in = reinterpret_cast<Bytef *>(inBuffer.Data());
+      stream.avail_in = static_cast<uInt>(toRead);
+    }
+
+    const int state = inflate(&stream, Z_NO_FLUSH);
+
+    if (state == Z_STREAM_END) {
+      streamEnd = true;
+      break;
+    }
+
+    if (state != Z_OK) {
+      printerror("[ZLIB] Corrupted stream.");
+      break;
+    }
+  }
+
+  const size_t numInflated = ZLIB_CHUNK_SIZE - stream.avail_out;
+  streamOffset += numInflated;
+
+  if (streamEnd)
+    imageSize = streamOffset;
+
+  setg(outBuffer.Data(), outBuffer.Data(), outBuffer.Data() + numInflated);
+
+  return numInflated > 0;
+}
+
+ZlibReadBuf::int_type ZlibReadBuf::underflow() {
+  if (gptr() < egptr() || InflateChunk())
+    return traits_type::to_int_type(*gptr());
+
+  return traits_type::eof();
+}
+
+ZlibReadBuf::pos_type ZlibReadBuf::seekoff(off_type offset,
+                                           std::ios_base::seekdir dir,
+                                           std::ios_base::openmode which) {
+  const size_t current = areaOffset + (gptr() - eback());
+
+  if (dir == std::ios_base::cur && !offset)
+    return pos_type(current);
+
+  size_t position = offset;
+
+  if (dir == std::ios_base::cur) {
+    position = current + offset;
+  } else if (dir == std::ios_base::end) {
+    // Size is known, once stream is inflated to its end
+    while (!streamEnd)
+      if (!InflateChunk() && !streamEnd)
+        return pos_type(off_type(-1));
+
+    position = imageSize + offset;
+  }
+
+  return seekpos(pos_type(position), which);
+}
+
+ZlibReadBuf::pos_type ZlibReadBuf::seekpos(pos_type position,
+                                           std::ios_base::openmode which) {
+  const size_t target = static_cast<size_t>(off_type(position));
+
+  if (!(which & std::ios_base::in) || !streamValid)
+    return pos_type(off_type(-1));
+
+  if (target >= areaOffset && target < streamOffset) {
+    setg(eback(), eback() + (target - areaOffset), egptr());
+    return position;
+  }
+
+  // First checkpoint is at stream begin
+  auto found = std::upper_bound(
+      checkpoints.begin(), checkpoints.end(), target,
+      [](size_t offset, const std::unique_ptr<Checkpoint> &c) {
+        return offset < c->imageOffset;
+      });
+  Checkpoint &checkpoint = **(found - 1);
+
+  if ((target < streamOffset || checkpoint.imageOffset > streamOffset) &&
+      !Restore(checkpoint))
+    return pos_type(off_type(-1));
+
+  while (target >= streamOffset)
+    if (!InflateChunk())
+      return streamEnd && target == streamOffset ? position
+                                                 : pos_type(off_type(-1));
+
+  setg(eback(), eback() + (target - areaOffset), egptr());
+
+  return position;
+}
@@ -0,0 +1,169 @@
+/*      Streaming archive compression/decompression
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "RawFile.hpp"
+#include "SARC.hpp"
+#include <memory>
+#include <streambuf>
+#include <vector>
+
+// Output stream buffer, that compresses written data on the fly.
+// Only one chunk of uncompressed data is held in memory.
+// Supports tellp only, Finish must be called after last write.
+class CompressStreamBuf : public std::streambuf {
+public:
+  int Finish();
+
+protected:
+  CompressStreamBuf(size_t chunkSize);
+
+  // Called with full chunks, last is set for final (possibly partial) chunk.
+  virtual int Flush(const char *data, size_t size, bool last) = 0;
+
+  int_type overflow(int_type ch) override;
+  std::streamsize xsputn(const char *data, std::streamsize size) override;
+  pos_type seekoff(off_type offset, std::ios_base::seekdir dir,
+                   std::ios_base::openmode which) override;
+
+private:
+  BufferPool::Buffer chunk;
+  size_t flushedSize = 0;
+  int status = 0;
+
+  bool FlushChunk();
+};
+
+// Writes AAF header and EWAM blocks, header is finalized by Finish.
+class AAFStreamBuf : public CompressStreamBuf {
+public:
+  AAFStreamBuf(BinWritter *output, bool bigEndian);
+
+protected:
+  int Flush(const char *data, size_t size, bool last) override;
+
+private:
+  BinWritter *wr;
+  size_t headerOffset;
+  size_t uncompressedSize = 0;
+  uint numBlocks = 0;
+  bool bigEndian;
+};
+
+// Writes zlib stream.
+class ZlibStreamBuf : public CompressStreamBuf {
+public:
+  ZlibStreamBuf(BinWritter *output);
+  ~ZlibStreamBuf();
+
+protected:
+  int Flush(const char *data, size_t size, bool last) override;
+
+private:
+  BinWritter *wr;
+  z_stream stream;
+  std::string outBuffer;
+};
+
+// Seekable input stream buffer over AAF archive.
+// Blocks are inflated on demand, only one block is held in memory.
+class AAFReadBuf : public std::streambuf {
+public:
+  struct Block {
+    size_t offset;
+    size_t fileOffset;
+    uint compressedSize;
+    uint uncompressedSize;
+  };
+
+  // Scans block table, returns same codes as AAF::Load.
+  // Reader must outlive this buffer.
+  int Load(BinReader *input);
+  size_t Size() const { return imageSize; }
+  bool BigEndian() const { return bigEndian; }
+  // Block offsets are within uncompressed image,
+  // file offsets point to compressed data after EWAM header.
+  const std::vector<Block> &Blocks() const { return blocks; }
+
+protected:
+  int_type underflow() override;
+  pos_type seekoff(off_type offset, std::ios_base::seekdir dir,
+                   std::ios_base::openmode which) override;
+  pos_type seekpos(pos_type position, std::ios_base::openmode which) override;
+
+private:
+  BinReader *rd = nullptr;
+  std::vector<Block> blocks;
+  BufferPool::Buffer blockData;
+  size_t imageSize = 0;
+  size_t areaOffset = 0;
+  size_t nextBlock = 0;
+  bool bigEndian = false;
+
+  template <bool BE> int Load();
+  bool LoadBlock(size_t id);
+};
+
+// Seekable input stream buffer over zlib archive.
+// Stream is inflated on demand, only one chunk is held in memory.
+// Forward seeks inflate and discard data, backward seeks resume from
+// nearest checkpoint (inflate state copy), taken every few megabytes.
+class ZlibReadBuf : public std::streambuf {
+public:
+  ZlibReadBuf() = default;
+  ZlibReadBuf(const ZlibReadBuf &) = delete;
+  ZlibReadBuf &operator=(const ZlibReadBuf &) = delete;
+  ~ZlibReadBuf();
+
+  // File must outlive this buffer.
+  bool Load(const RawFile *input);
+  // Size is known, once stream was inflated to its end, 0 otherwise
+  size_t Size() const { return imageSize; }
+
+protected:
+  int_type underflow() override;
+  pos_type seekoff(off_type offset, std::ios_base::seekdir dir,
+                   std::ios_base::openmode which) override;
+  pos_type seekpos(pos_type position, std::ios_base::openmode which) override;
+
+private:
+  // Inflate state must not move, zlib keeps pointer to it
+  struct Checkpoint {
+    z_stream stream;
+    size_t imageOffset;
+    size_t fileOffset;
+  };
+
+  const RawFile *file = nullptr;
+  z_stream stream = {};
+  bool streamValid = false;
+  bool streamEnd = false;
+  BufferPool::Buffer inBuffer;
+  BufferPool::Buffer outBuffer;
+  // File offset of next input chunk
+  size_t fileOffset = 0;
+  size_t fileSize = 0;
+  // Image offsets of get area and next inflated byte
+  size_t areaOffset = 0;
+  size_t streamOffset = 0;
+  size_t imageSize = 0;
+  std::vector<std::unique_ptr<Checkpoint>> checkpoints;
+
+  bool AddCheckpoint();
+  bool Restore(Checkpoint &checkpoint);
+  bool InflateChunk();
+};
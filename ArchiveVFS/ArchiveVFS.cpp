@@ -0,0 +1,465 @@
+/*      ArchiveVFS
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ArchiveVFS.hpp"
+#include "ArchiveStream.hpp"
+#include <algorithm>
+
+BlockCache::Block BlockCache::Get(const Key &key) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto found = lookup.find(key);
+
+  if (found == lookup.end())
+    return nullptr;
+
+  items.splice(items.begin(), items, found->second);
+
+  return found->second->second;
+}
+
+BlockCache::Block BlockCache::Insert(const Key &key, Block block) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto found = lookup.find(key);
+
+  // Other thread was faster, use its copy.
+  if (found != lookup.end()) {
+    items.splice(items.begin(), items, found->second);
+    return found->second->second;
+  }
+
+  items.emplace_front(key, block);
+  lookup[key] = items.begin();
+  cachedSize += block->size();
+
+  while (cachedSize > maxSize && items.size() > 1) {
+    auto &last = items.back();
+    cachedSize -= last.second->size();
+    lookup.erase(last.first);
+    items.pop_back();
+  }
+
+  return block;
+}
+
+class RawSource : public ArchiveSource {
+public:
+  RawSource(std::ifstream &&stream, size_t size) : str(std::move(stream)) {
+    imageSize = size;
+  }
+
+  bool Read(size_t offset, char *buffer, size_t size) override {
+    if (offset + size > imageSize)
+      return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    str.clear();
+    str.seekg(offset);
+    str.read(buffer, size);
+
+    return static_cast<size_t>(str.gcount()) == size;
+  }
+
+private:
+  std::mutex mutex;
+  std::ifstream str;
+};
+
+// Zlib archives are inflated on demand, reads share stream position,
+// so they are serialized.
+class ZlibSource : public ArchiveSource {
+public:
+  explicit ZlibSource(const TSTRING &path) : file(path, RawFile::READ) {}
+
+  // Stream is inflated to its end once, to get image size and checkpoints
+  bool Load() {
+    if (!file.IsValid() || !zlibBuf.Load(&file) ||
+        zlibBuf.pubseekoff(0, std::ios::end, std::ios::in) ==
+            std::streampos(std::streamoff(-1)))
+      return false;
+
+    imageSize = zlibBuf.Size();
+
+    return true;
+  }
+
+  bool Read(size_t offset, char *buffer, size_t size) override {
+    if (offset + size > imageSize)
+      return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return zlibBuf.pubseekpos(offset, std::ios::in) ==
+               std::streampos(offset) &&
+           static_cast<size_t>(zlibBuf.sgetn(buffer, size)) == size;
+  }
+
+private:
+  std::mutex mutex;
+  RawFile file;
+  ZlibReadBuf zlibBuf;
+};
+
+class AAFSource : public ArchiveSource {
+public:
+  struct Block {
+    size_t fileOffset;
+    size_t compressedSize;
+    size_t offset;
+    size_t size;
+  };
+
+  std::vector<Block> blocks;
+
+  AAFSource(std::ifstream &&stream, BlockCache &cache, size_t archiveID)
+      : str(std::move(stream)), cache(cache), archiveID(archiveID) {}
+
+  void AddBlock(const Block &block) {
+    blocks.push_back(block);
+    imageSize += block.size;
+  }
+
+  bool Read(size_t offset, char *buffer, size_t size) override {
+    if (offset + size > imageSize)
+      return false;
+
+    if (!size)
+      return true;
+
+    auto cBlock = std::upper_bound(
+        blocks.begin(), blocks.end(), offset,
+        [](size_t offset, const Block &b) { return offset < b.offset; });
+
+    cBlock--;
+
+    while (size) {
+      BlockCache::Block data = GetBlock(cBlock - blocks.begin());
+
+      if (!data)
+        return false;
+
+      const size_t blockOffset = offset - cBlock->offset;
+      const size_t toCopy = std::min(size, cBlock->size - blockOffset);
+
+      memcpy(buffer, data->data() + blockOffset, toCopy);
+      buffer += toCopy;
+      offset += toCopy;
+      size -= toCopy;
+      cBlock++;
+    }
+
+    return true;
+  }
+
+private:
+  std::mutex mutex;
+  std::ifstream str;
+  BlockCache &cache;
+  size_t archiveID;
+
+  BlockCache::Block GetBlock(size_t blockID) {
+    const BlockCache::Key key(archiveID, blockID);
+    BlockCache::Block data = cache.Get(key);
+
+    if (data)
+      return data;
+
+    const Block &block = blocks[blockID];
+    BufferPool::Buffer compressed = BufferPool::Acquire(block.compressedSize);
+
+    if (!compressed)
+      return nullptr;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      str.clear();
+      str.seekg(block.fileOffset);
+      str.read(compressed.Data(), block.compressedSize);
+
+      if (static_cast<size_t>(str.gcount()) != block.compressedSize)
+        return nullptr;
+    }
+
+    std::string *inflated = new std::string();
+    inflated->resize(block.size);
+    data.reset(inflated);
+
+    if (EWAM::Inflate(compressed.Data(), block.compressedSize, &(*inflated)[0],
+                      inflated->size()) != Z_STREAM_END) {
+      printerror("[ZLIB] Expected Z_STREAM_END.");
+      return nullptr;
+    }
+
+    return cache.Insert(key, data);
+  }
+};
+
+int ArchiveVFS::Mount(const TSTRING &archivePath) {
+  std::ifstream str(archivePath, std::ios::in | std::ios::binary);
+
+  if (str.fail())
+    return 1;
+
+  str.seekg(0, std::ios::end);
+  const size_t fileSize = str.tellg();
+  str.seekg(0);
+
+  int magic = 0;
+  str.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+  str.seekg(0);
+
+  ArchiveSource::Ptr source;
+
+  if (magic == AAF::ID) {
+    AAF::Header hdr;
+    str.read(reinterpret_cast<char *>(&hdr), sizeof(hdr));
+
+    if (str.fail() || memcmp(hdr.id2, AAF::ID2, sizeof(AAF::ID2)))
+      return 2;
+
+    const bool bigEndian = hdr.IsBigEndian();
+
+    if (bigEndian)
+      AAF::SwapHeader<true>(hdr);
+
+    std::vector<AAFSource::Block> blocks;
+    size_t cPos = sizeof(hdr);
+    size_t imageSize = 0;
+
+    for (uint b = 0; b < hdr.blockCount; b++) {
+      EWAM::Header bHdr;
+      str.seekg(cPos);
+      str.read(reinterpret_cast<char *>(&bHdr), sizeof(bHdr));
+
+      if (bigEndian)
+        EWAM::SwapHeader<true>(bHdr);
+
+      if (str.fail() || bHdr.id != EWAM::ID ||
+          cPos + sizeof(bHdr) + bHdr.compressedSize > fileSize)
+        return 3;
+
+      blocks.push_back({cPos + sizeof(bHdr),
+                        static_cast<size_t>(bHdr.compressedSize), imageSize,
+                        static_cast<size_t>(bHdr.uncompressedSize)});
+      imageSize += bHdr.uncompressedSize;
+      cPos += bHdr.nextBlock;
+    }
+
+    AAFSource *aafSource = new AAFSource(std::move(str), cache, nextCacheID++);
+    source.reset(aafSource);
+
+    for (auto &b : blocks)
+      aafSource->AddBlock(b);
+  } else if (magic == 4 || SARC::IsBigEndian(magic)) {
+    source.reset(new RawSource(std::move(str), fileSize));
+  } else if (static_cast<uchar>(magic) == 0x78) {
+    ZlibSource *zlibSource = new ZlibSource(archivePath);
+    source.reset(zlibSource);
+
+    if (!zlibSource->Load())
+      return 3;
+  } else {
+    return 2;
+  }
+
+  struct {
+    int hlen;
+    int hid;
+    int version;
+    uint tocSize;
+    uint bufferLen;
+  } sarcHeader;
+
+  if (!source->Read(0, reinterpret_cast<char *>(&sarcHeader),
+                    sizeof(sarcHeader)) ||
+      sarcHeader.hid != SARC::ID)
+    return 2;
+
+  if (SARC::IsBigEndian(sarcHeader.hlen)) {
+    Endian<true>::Swap(sarcHeader.hlen);
+    Endian<true>::Swap(sarcHeader.version);
+    Endian<true>::Swap(sarcHeader.tocSize);
+  }
+
+  if (sarcHeader.hlen != 4)
+    return 2;
+
+  // V2 stores TOC size, V3 stores data offset instead
+  const size_t tocEnd = sarcHeader.version > 2 ? sarcHeader.tocSize
+                                               : sarcHeader.tocSize + 16;
+  std::string tocBuffer;
+  tocBuffer.resize(tocEnd);
+
+  if (!source->Read(0, &tocBuffer[0], tocEnd))
+    return 3;
+
+  std::stringstream tocStream(std::move(tocBuffer));
+  BinReader rd(tocStream);
+  SARC::Ptr sarc = SARC::Create(&rd);
+
+  if (!sarc)
+    return 2;
+
+  const size_t archiveID = archives.size();
+  const size_t numFiles = sarc->NumFiles();
+
+  for (size_t f = 0; f < numFiles; f++) {
+    const size_t offset = sarc->FileOffset(f);
+    const size_t size = sarc->FileSize(f);
+
+    // External files are not stored within archive
+    if (!offset)
+      continue;
+
+    if (offset + size > source->Size()) {
+      printwarning("[VFS] Entry out of archive bounds: ",
+                   << sarc->FileName(f).c_str());
+      continue;
+    }
+
+    Entry cEntry;
+    cEntry.path = NormalizePath(sarc->FileName(f));
+    cEntry.hash = HashPath(cEntry.path);
+    cEntry.archive = archiveID;
+    cEntry.offset = offset;
+    cEntry.size = size;
+
+    AddEntry(std::move(cEntry));
+  }
+
+  archives.push_back(std::move(source));
+
+  return 0;
+}
+
+void ArchiveVFS::AddEntry(Entry &&entry) {
+  auto range = hashes.equal_range(entry.hash);
+
+  for (auto it = range.first; it != range.second; it++)
+    if (entries[it->second].path == entry.path) {
+      entries[it->second] = std::move(entry);
+      return;
+    }
+
+  size_t lastSlash = 0;
+  std::string parent;
+
+  for (size_t s = 0; s < entry.path.size(); s++)
+    if (entry.path[s] == '/') {
+      folders[parent].insert(entry.path.substr(lastSlash, s - lastSlash + 1));
+      parent = entry.path.substr(0, s);
+      lastSlash = s + 1;
+    }
+
+  folders[parent].insert(entry.path.substr(lastSlash));
+  hashes.emplace(entry.hash, entries.size());
+  entries.push_back(std::move(entry));
+}
+
+std::string ArchiveVFS::NormalizePath(const std::string &path) {
+  std::string retVal = path;
+  std::replace(retVal.begin(), retVal.end(), '\\', '/');
+
+  size_t begin = 0;
+
+  while (true) {
+    if (retVal.compare(begin, 2, "./") == 0)
+      begin += 2;
+    else if (retVal.compare(begin, 1, "/") == 0)
+      begin++;
+    else
+      break;
+  }
+
+  return retVal.substr(begin);
+}
+
+uint ArchiveVFS::HashPath(const std::string &path) {
+  return JenkinsLookup3(path.c_str());
+}
+
+const ArchiveVFS::Entry *ArchiveVFS::Find(const std::string &path) const {
+  const std::string normPath = NormalizePath(path);
+  auto range = hashes.equal_range(HashPath(normPath));
+
+  for (auto it = range.first; it != range.second; it++)
+    if (entries[it->second].path == normPath)
+      return &entries[it->second];
+
+  return nullptr;
+}
+
+const ArchiveVFS::Entry *ArchiveVFS::Find(uint hash) const {
+  auto found = hashes.find(hash);
+
+  if (found == hashes.end())
+    return nullptr;
+
+  return &entries[found->second];
+}
+
+size_t ArchiveVFS::Read(const Entry &entry, size_t offset, char *buffer,
+                        size_t size) const {
+  if (offset >= entry.size)
+    return 0;
+
+  size = std::min(size, entry.size - offset);
+
+  if (!archives[entry.archive]->Read(entry.offset + offset, buffer, size))
+    return 0;
+
+  return size;
+}
+
+bool ArchiveVFS::Read(const Entry &entry, std::string &output) const {
+  output.resize(entry.size);
+
+  if (!entry.size)
+    return true;
+
+  return Read(entry, 0, &output[0], entry.size) == entry.size;
+}
+
+bool ArchiveVFS::Stream(const Entry &entry, std::ostream &output) const {
+  std::string buffer;
+  buffer.resize(std::min<size_t>(entry.size, AAF::MAX_BLOCK_SIZE / 32));
+
+  for (size_t offset = 0; offset < entry.size;) {
+    const size_t numRead = Read(entry, offset, &buffer[0], buffer.size());
+
+    if (!numRead)
+      return false;
+
+    output.write(buffer.data(), numRead);
+    offset += numRead;
+  }
+
+  return !output.fail();
+}
+
+std::vector<std::string> ArchiveVFS::List(const std::string &folder) const {
+  std::string normFolder = NormalizePath(folder);
+
+  while (normFolder.size() && normFolder.back() == '/')
+    normFolder.pop_back();
+
+  auto found = folders.find(normFolder);
+
+  if (found == folders.end())
+    return {};
+
+  return {found->second.begin(), found->second.end()};
+}
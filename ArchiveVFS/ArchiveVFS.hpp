@@ -0,0 +1,120 @@
+/*      ArchiveVFS
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "SARC.hpp"
+#include <fstream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+
+// Size bounded, least recently used cache of inflated blocks.
+// Blocks are handed out as shared pointers, so evicting a block
+// doesn't invalidate readers still holding it.
+class BlockCache {
+public:
+  typedef std::shared_ptr<const std::string> Block;
+  typedef std::pair<size_t, size_t> Key; // archive id, block id
+
+  explicit BlockCache(size_t maxSize) : maxSize(maxSize), cachedSize(0) {}
+
+  Block Get(const Key &key);
+  Block Insert(const Key &key, Block block);
+  size_t Size() const { return cachedSize; }
+
+private:
+  struct KeyHash {
+    size_t operator()(const Key &k) const {
+      return std::hash<size_t>()(k.first * 0x9E3779B97F4A7C15ULL ^ k.second);
+    }
+  };
+  typedef std::list<std::pair<Key, Block>> list_type;
+
+  std::mutex mutex;
+  list_type items;
+  std::unordered_map<Key, list_type::iterator, KeyHash> lookup;
+  size_t maxSize;
+  size_t cachedSize;
+};
+
+// Random access to uncompressed SARC image of an archive.
+class ArchiveSource {
+public:
+  typedef std::unique_ptr<ArchiveSource> Ptr;
+
+  virtual ~ArchiveSource() = default;
+  virtual bool Read(size_t offset, char *buffer, size_t size) = 0;
+  size_t Size() const { return imageSize; }
+
+protected:
+  size_t imageSize = 0;
+};
+
+// Read only virtual file system over set of SARC/AAF/zlib archives.
+// Mount archives first, lookups and reads are then thread safe.
+// Later mounted archives override entries with same path.
+class ArchiveVFS {
+public:
+  struct Entry {
+    std::string path;
+    uint hash;
+    size_t archive;
+    size_t offset;
+    size_t size;
+  };
+
+  typedef std::vector<Entry>::const_iterator const_iterator;
+
+  explicit ArchiveVFS(size_t cacheSize = 0x10000000) : cache(cacheSize) {}
+
+  // Returns 0 on success, 1 cannot open, 2 unknown format, 3 corrupted
+  int Mount(const TSTRING &archivePath);
+
+  const Entry *Find(const std::string &path) const;
+  const Entry *Find(uint hash) const;
+
+  // Reads part of entry, returns number of bytes read.
+  size_t Read(const Entry &entry, size_t offset, char *buffer,
+              size_t size) const;
+  bool Read(const Entry &entry, std::string &output) const;
+  bool Stream(const Entry &entry, std::ostream &output) const;
+
+  // Lists direct children of a folder, subfolders end with '/'.
+  std::vector<std::string> List(const std::string &folder) const;
+
+  const_iterator begin() const { return entries.begin(); }
+  const_iterator end() const { return entries.end(); }
+  size_t NumEntries() const { return entries.size(); }
+  size_t NumArchives() const { return archives.size(); }
+  BlockCache &Cache() { return cache; }
+
+  static std::string NormalizePath(const std::string &path);
+  static uint HashPath(const std::string &path);
+
+private:
+  std::vector<ArchiveSource::Ptr> archives;
+  std::vector<Entry> entries;
+  std::unordered_multimap<uint, size_t> hashes;
+  std::map<std::string, std::set<std::string>> folders;
+  mutable BlockCache cache;
+  // Cache IDs are never reused, failed mounts might leave cached blocks
+  size_t nextCacheID = 0;
+
+  void AddEntry(Entry &&entry);
+};
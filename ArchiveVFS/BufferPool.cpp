@@ -0,0 +1,136 @@
+/*      BufferPool
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "BufferPool.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+static constexpr size_t MIN_SIZE_CLASS = 12;
+static constexpr size_t NUM_SIZE_CLASSES = 48;
+static constexpr size_t HUGE_PAGE_SIZE = 0x200000;
+
+static std::atomic<size_t> allocations(0);
+static std::atomic<size_t> allocationsAvoided(0);
+static std::atomic<size_t> poolSize(0);
+static std::atomic<size_t> peakPoolSize(0);
+static std::atomic<size_t> maxThreadPoolSize(0x10000000);
+static std::atomic<bool> useHugePages(false);
+
+static char *AllocateBlock(size_t size) {
+  void *block = nullptr;
+
+#ifdef __linux__
+  if (useHugePages && size >= HUGE_PAGE_SIZE) {
+    if (posix_memalign(&block, HUGE_PAGE_SIZE, size))
+      return nullptr;
+
+    madvise(block, size, MADV_HUGEPAGE);
+  } else
+#endif
+    block = malloc(size);
+
+  if (!block)
+    return nullptr;
+
+  allocations++;
+  const size_t cSize = poolSize += size;
+  size_t cPeak = peakPoolSize;
+
+  while (cSize > cPeak && !peakPoolSize.compare_exchange_weak(cPeak, cSize))
+    ;
+
+  return static_cast<char *>(block);
+}
+
+static void FreeBlock(char *block, size_t size) {
+  free(block);
+  poolSize -= size;
+}
+
+static size_t GetSizeClass(size_t size) {
+  size_t sizeClass = MIN_SIZE_CLASS;
+
+  // Sizes above largest class yield NUM_SIZE_CLASSES, Acquire fails then
+  while (sizeClass < NUM_SIZE_CLASSES && (size_t(1) << sizeClass) < size)
+    sizeClass++;
+
+  return sizeClass;
+}
+
+struct ThreadPool {
+  std::vector<char *> freeBlocks[NUM_SIZE_CLASSES];
+  size_t cachedSize = 0;
+
+  ~ThreadPool() {
+    for (size_t c = 0; c < NUM_SIZE_CLASSES; c++)
+      for (auto b : freeBlocks[c])
+        FreeBlock(b, size_t(1) << c);
+  }
+};
+
+static thread_local ThreadPool localPool;
+
+BufferPool::Buffer BufferPool::Acquire(size_t size) {
+  Buffer retVal;
+  retVal.size = size;
+  retVal.sizeClass = GetSizeClass(size);
+
+  if (retVal.sizeClass >= NUM_SIZE_CLASSES)
+    return Buffer();
+
+  auto &freeBlocks = localPool.freeBlocks[retVal.sizeClass];
+
+  if (freeBlocks.size()) {
+    retVal.buffer = freeBlocks.back();
+    freeBlocks.pop_back();
+    localPool.cachedSize -= size_t(1) << retVal.sizeClass;
+    allocationsAvoided++;
+  } else {
+    retVal.buffer = AllocateBlock(size_t(1) << retVal.sizeClass);
+  }
+
+  return retVal;
+}
+
+void BufferPool::Buffer::Release() {
+  if (!buffer)
+    return;
+
+  const size_t blockSize = size_t(1) << sizeClass;
+
+  if (localPool.cachedSize + blockSize > maxThreadPoolSize) {
+    FreeBlock(buffer, blockSize);
+  } else {
+    localPool.freeBlocks[sizeClass].push_back(buffer);
+    localPool.cachedSize += blockSize;
+  }
+
+  buffer = nullptr;
+}
+
+BufferPool::Stats BufferPool::GetStats() {
+  return {allocations, allocationsAvoided, poolSize, peakPoolSize};
+}
+
+void BufferPool::UseHugePages(bool use) { useHugePages = use; }
+
+void BufferPool::MaxThreadPoolSize(size_t size) { maxThreadPoolSize = size; }
@@ -0,0 +1,71 @@
+/*      BufferPool
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <cstddef>
+#include <utility>
+
+// Thread local pool of reusable buffers.
+// Buffers are rounded up to power of two size classes and returned into
+// pool of releasing thread, once Buffer goes out of scope.
+class BufferPool {
+public:
+  struct Stats {
+    size_t allocations;
+    size_t allocationsAvoided;
+    size_t poolSize;
+    size_t peakPoolSize;
+  };
+
+  class Buffer {
+  public:
+    Buffer() : buffer(nullptr), size(0), sizeClass(0) {}
+    Buffer(Buffer &&other)
+        : buffer(other.buffer), size(other.size), sizeClass(other.sizeClass) {
+      other.buffer = nullptr;
+    }
+    Buffer &operator=(Buffer &&other) {
+      std::swap(buffer, other.buffer);
+      std::swap(size, other.size);
+      std::swap(sizeClass, other.sizeClass);
+      return *this;
+    }
+    Buffer(const Buffer &) = delete;
+    Buffer &operator=(const Buffer &) = delete;
+    ~Buffer() { Release(); }
+
+    char *Data() const { return buffer; }
+    size_t Size() const { return size; }
+    explicit operator bool() const { return buffer != nullptr; }
+    void Release();
+
+  private:
+    friend class BufferPool;
+    char *buffer;
+    size_t size;
+    size_t sizeClass;
+  };
+
+  static Buffer Acquire(size_t size);
+  static Stats GetStats();
+
+  // Back buffers of 2MB and larger by transparent huge pages, if available.
+  static void UseHugePages(bool use);
+
+  // Maximum size of released buffers, that each thread keeps for reuse.
+  static void MaxThreadPoolSize(size_t size);
+};
@@ -0,0 +1,306 @@
+/*      ContentStore
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ContentStore.hpp"
+#include "BufferPool.hpp"
+#include "RawFile.hpp"
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+#endif
+
+static constexpr size_t CHUNK_SIZE = 0x100000;
+
+static constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+static constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+static constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+static uint64_t RotL(uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t Round(uint64_t acc, uint64_t input) {
+  return RotL(acc + input * PRIME2, 31) * PRIME1;
+}
+
+static uint64_t MergeRound(uint64_t acc, uint64_t value) {
+  return (acc ^ Round(0, value)) * PRIME1 + PRIME4;
+}
+
+static uint64_t Read64(const char *data) {
+  uint64_t retVal;
+  memcpy(&retVal, data, 8);
+  return retVal;
+}
+
+static uint32_t Read32(const char *data) {
+  uint32_t retVal;
+  memcpy(&retVal, data, 4);
+  return retVal;
+}
+
+Hash64::Hash64(uint64_t seed)
+    : acc{seed + PRIME1 + PRIME2, seed + PRIME2, seed, seed - PRIME1},
+      seed(seed) {}
+
+void Hash64::Update(const char *data, size_t size) {
+  totalSize += size;
+
+  if (bufferSize) {
+    const size_t toCopy = std::min(size, sizeof(buffer) - bufferSize);
+    memcpy(buffer + bufferSize, data, toCopy);
+    bufferSize += toCopy;
+    data += toCopy;
+    size -= toCopy;
+
+    if (bufferSize < sizeof(buffer))
+      return;
+
+    for (int a = 0; a < 4; a++)
+      acc[a] = Round(acc[a], Read64(buffer + a * 8));
+
+    bufferSize = 0;
+  }
+
+  for (; size >= 32; data += 32, size -= 32)
+    for (int a = 0; a < 4; a++)
+      acc[a] = Round(acc[a], Read64(data + a * 8));
+
+  memcpy(buffer, data, size);
+  bufferSize = size;
+}
+
+uint64_t Hash64::Digest() const {
+  uint64_t hash;
+
+  if (totalSize >= 32) {
+    hash = RotL(acc[0], 1) + RotL(acc[1], 7) + RotL(acc[2], 12) +
+           RotL(acc[3], 18);
+
+    for (int a = 0; a < 4; a++)
+      hash = MergeRound(hash, acc[a]);
+  } else {
+    hash = seed + PRIME5;
+  }
+
+  hash += totalSize;
+  const char *data = buffer;
+  size_t size = bufferSize;
+
+  for (; size >= 8; data += 8, size -= 8)
+    hash = RotL(hash ^ Round(0, Read64(data)), 27) * PRIME1 + PRIME4;
+
+  if (size >= 4) {
+    hash = RotL(hash ^ (Read32(data) * PRIME1), 23) * PRIME2 + PRIME3;
+    data += 4;
+    size -= 4;
+  }
+
+  for (; size; data++, size--)
+    hash = RotL(hash ^ (static_cast<uint8_t>(*data) * PRIME5), 11) * PRIME1;
+
+  hash ^= hash >> 33;
+  hash *= PRIME2;
+  hash ^= hash >> 29;
+  hash *= PRIME3;
+  hash ^= hash >> 32;
+
+  return hash;
+}
+
+static TSTRING ToHex(uint64_t value, int numDigits) {
+  static const char digits[] = "0123456789abcdef";
+  TSTRING retVal(numDigits, '0');
+
+  for (int d = numDigits - 1; d >= 0; d--, value >>= 4)
+    retVal[d] = digits[value & 0xF];
+
+  return retVal;
+}
+
+bool ContentStore::Open(const TSTRING &path, bool useReflinks) {
+  root = path;
+  reflinks = useReflinks;
+
+  if (root.size() && root.back() != '/' && root.back() != '\\')
+    root.push_back('/');
+
+  bool created = MakeDir(root);
+
+  for (int d = 0; d < 0x100 && created; d++)
+    created = MakeDir(root + ToHex(d, 2));
+
+  if (!created)
+    root.clear();
+
+  return created;
+}
+
+TSTRING ContentStore::ObjectPath(uint64_t hash, size_t size) const {
+  return root + ToHex(hash >> 56, 2) + TSTRING(1, '/') + ToHex(hash, 16) +
+         TSTRING(1, '_') + ToHex(size, size > 0xffffffff ? 16 : 8);
+}
+
+bool ContentStore::Store(const TSTRING &objectPath, size_t size,
+                         const read_type &read) {
+  // Unique temporary name, so concurrent stores of same object don't clash
+  const TSTRING tempPath =
+      objectPath + _T(".") + ToHex(tempCounter.fetch_add(1), 8);
+  BufferPool::Buffer buffer = BufferPool::Acquire(std::min(size, CHUNK_SIZE));
+  RawFile object(tempPath, RawFile::WRITE);
+
+  if (!buffer || !object.IsValid())
+    return false;
+
+  for (size_t cPos = 0; cPos < size;) {
+    const size_t toCopy = std::min(size - cPos, CHUNK_SIZE);
+
+    if (!read(cPos, buffer.Data(), toCopy) ||
+        !object.WriteAt(cPos, buffer.Data(), toCopy)) {
+      object.Close();
+      RemoveFile(tempPath);
+      return false;
+    }
+
+    cPos += toCopy;
+  }
+
+  object.Close();
+
+  if (!MoveFileOver(tempPath, objectPath)) {
+    RemoveFile(tempPath);
+    return false;
+  }
+
+  numStored++;
+  bytesStored += size;
+
+  return true;
+}
+
+bool ContentStore::Link(const TSTRING &objectPath, const TSTRING &path) const {
+  int64_t mtime;
+  const size_t objectSize = FileStat(objectPath, mtime);
+
+  if (objectSize == NO_FILE)
+    return false;
+
+  if (FileStat(path, mtime) != NO_FILE) {
+    // Already linked from previous extraction
+    if (SameFile(path, objectPath))
+      return true;
+
+    RemoveFile(path);
+  }
+
+#ifdef _WIN32
+  if (!reflinks && CreateHardLink(path.c_str(), objectPath.c_str(), nullptr))
+    return true;
+
+  return CopyFile(objectPath.c_str(), path.c_str(), FALSE) != 0;
+#else
+  if (!reflinks && !link(objectPath.c_str(), path.c_str()))
+    return true;
+
+  RawFile source(objectPath, RawFile::READ);
+  RawFile target(path, RawFile::WRITE);
+
+  if (!source.IsValid() || !target.IsValid())
+    return false;
+
+#ifdef FICLONE
+  if (!ioctl(target.Handle(), FICLONE, source.Handle()))
+    return true;
+#endif
+
+  return CopyRange(source, 0, target, 0, objectSize);
+#endif
+}
+
+bool ContentStore::Put(const TSTRING &path, const char *data, size_t size) {
+  Hash64 hash;
+  hash.Update(data, size);
+  const TSTRING objectPath = ObjectPath(hash.Digest(), size);
+  int64_t mtime;
+
+  if (FileStat(objectPath, mtime) != NO_FILE) {
+    numReused++;
+    bytesReused += size;
+  } else if (!Store(objectPath, size,
+                    [data](size_t offset, char *buffer, size_t toRead) {
+                      memcpy(buffer, data + offset, toRead);
+                      return true;
+                    })) {
+    return false;
+  }
+
+  return Link(objectPath, path);
+}
+
+bool ContentStore::Put(const TSTRING &path, size_t size,
+                       const read_type &read) {
+  if (size <= CHUNK_SIZE) {
+    BufferPool::Buffer buffer = BufferPool::Acquire(size);
+
+    if (!buffer || !read(0, buffer.Data(), size))
+      return false;
+
+    return Put(path, buffer.Data(), size);
+  }
+
+  BufferPool::Buffer buffer = BufferPool::Acquire(CHUNK_SIZE);
+  Hash64 hash;
+
+  if (!buffer)
+    return false;
+
+  for (size_t cPos = 0; cPos < size;) {
+    const size_t toRead = std::min(size - cPos, CHUNK_SIZE);
+
+    if (!read(cPos, buffer.Data(), toRead))
+      return false;
+
+    hash.Update(buffer.Data(), toRead);
+    cPos += toRead;
+  }
+
+  const TSTRING objectPath = ObjectPath(hash.Digest(), size);
+  int64_t mtime;
+
+  if (FileStat(objectPath, mtime) != NO_FILE) {
+    numReused++;
+    bytesReused += size;
+  } else if (!Store(objectPath, size, read)) {
+    return false;
+  }
+
+  return Link(objectPath, path);
+}
+
+ContentStore::Stats ContentStore::GetStats() const {
+  return {numStored, numReused, bytesStored, bytesReused};
+}
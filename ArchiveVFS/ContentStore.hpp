@@ -0,0 +1,81 @@
+/*      ContentStore
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "datas/esString.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+// Streaming xxHash64.
+class Hash64 {
+public:
+  Hash64(uint64_t seed = 0);
+  void Update(const char *data, size_t size);
+  uint64_t Digest() const;
+
+private:
+  uint64_t acc[4];
+  char buffer[32];
+  size_t bufferSize = 0;
+  uint64_t totalSize = 0;
+  uint64_t seed;
+};
+
+// Content addressed store of extracted files.
+// Objects are stored once under <root>/<xx>/<hash>_<size> and output files
+// are created as hardlinks or reflinks into store, falling back to copy.
+// Thread safe.
+class ContentStore {
+public:
+  // Reads size bytes at offset of placed data into buffer.
+  typedef std::function<bool(size_t offset, char *buffer, size_t size)>
+      read_type;
+
+  struct Stats {
+    size_t numStored;
+    size_t numReused;
+    size_t bytesStored;
+    size_t bytesReused;
+  };
+
+  // Reflinks (copy on write) keep store intact, when output files
+  // are modified in place, hardlinks share data with store.
+  bool Open(const TSTRING &path, bool useReflinks);
+  bool IsOpen() const { return !root.empty(); }
+
+  // Creates file at path with given contents.
+  bool Put(const TSTRING &path, const char *data, size_t size);
+  // Large data are read twice, once for hash and once for store,
+  // if they are not stored already.
+  bool Put(const TSTRING &path, size_t size, const read_type &read);
+
+  Stats GetStats() const;
+
+private:
+  TSTRING root;
+  bool reflinks = false;
+  std::atomic<size_t> numStored{0};
+  std::atomic<size_t> numReused{0};
+  std::atomic<size_t> bytesStored{0};
+  std::atomic<size_t> bytesReused{0};
+  std::atomic<size_t> tempCounter{0};
+
+  TSTRING ObjectPath(uint64_t hash, size_t size) const;
+  bool Store(const TSTRING &objectPath, size_t size, const read_type &read);
+  bool Link(const TSTRING &objectPath, const TSTRING &path) const;
+};
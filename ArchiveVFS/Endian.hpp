@@ -0,0 +1,99 @@
+/*      Endian helpers
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if defined(__SSSE3__) || defined(__AVX__)
+#include <tmmintrin.h>
+#define ENDIAN_SSSE3
+#endif
+
+inline uint32_t ByteSwap32(uint32_t value) {
+#ifdef _MSC_VER
+  return _byteswap_ulong(value);
+#else
+  return __builtin_bswap32(value);
+#endif
+}
+
+// Byte swaps array of 32bit words in place.
+inline void SwapWords(void *data, size_t numWords) {
+  char *cData = static_cast<char *>(data);
+  size_t w = 0;
+
+#ifdef ENDIAN_SSSE3
+  const __m128i mask =
+      _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+
+  for (; w + 4 <= numWords; w += 4) {
+    __m128i *cItem = reinterpret_cast<__m128i *>(cData + w * 4);
+    _mm_storeu_si128(cItem, _mm_shuffle_epi8(_mm_loadu_si128(cItem), mask));
+  }
+#endif
+
+  for (; w < numWords; w++) {
+    uint32_t cItem;
+    memcpy(&cItem, cData + w * 4, 4);
+    cItem = ByteSwap32(cItem);
+    memcpy(cData + w * 4, &cItem, 4);
+  }
+}
+
+// Compile time endian selector, little endian variant compiles into nothing.
+// FourCC fields are stored as plain bytes in both byte orders,
+// so they must be excluded from swapping by caller.
+template <bool bigEndian> struct Endian {
+  static constexpr bool BIG = false;
+
+  template <class T> static void Swap(T &) {}
+  static void SwapArray(void *, size_t) {}
+
+  static uint32_t Get(const char *data) {
+    uint32_t retVal;
+    memcpy(&retVal, data, 4);
+    return retVal;
+  }
+
+  static void Put(std::string &buffer, uint32_t value) {
+    buffer.append(reinterpret_cast<const char *>(&value), 4);
+  }
+};
+
+template <> struct Endian<true> {
+  static constexpr bool BIG = true;
+
+  template <class T> static void Swap(T &item) {
+    static_assert(sizeof(T) % 4 == 0, "Expected 32bit fields only.");
+    SwapWords(&item, sizeof(T) / 4);
+  }
+
+  static void SwapArray(void *data, size_t numWords) {
+    SwapWords(data, numWords);
+  }
+
+  static uint32_t Get(const char *data) {
+    return ByteSwap32(Endian<false>::Get(data));
+  }
+
+  static void Put(std::string &buffer, uint32_t value) {
+    Endian<false>::Put(buffer, ByteSwap32(value));
+  }
+};
@@ -0,0 +1,104 @@
+/*      MappedFile
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "MappedFile.hpp"
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile &MappedFile::operator=(MappedFile &&other) {
+  std::swap(data, other.data);
+  std::swap(size, other.size);
+  return *this;
+}
+
+bool MappedFile::Open(const TSTRING &path) {
+  Close();
+#ifdef _WIN32
+  HANDLE file = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                           nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                           nullptr);
+
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER fileSize;
+
+  if (!GetFileSizeEx(file, &fileSize) || !fileSize.QuadPart) {
+    CloseHandle(file);
+    return false;
+  }
+
+  // View stays valid after handles are closed
+  HANDLE mapping =
+      CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+
+  if (!mapping)
+    return false;
+
+  data = static_cast<const char *>(
+      MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  CloseHandle(mapping);
+
+  if (data)
+    size = static_cast<size_t>(fileSize.QuadPart);
+#else
+  const int fd = open(path.c_str(), O_RDONLY);
+
+  if (fd < 0)
+    return false;
+
+  struct stat fileStat;
+
+  if (fstat(fd, &fileStat) || !fileStat.st_size) {
+    close(fd);
+    return false;
+  }
+
+  void *mapped = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (mapped == MAP_FAILED)
+    return false;
+
+  data = static_cast<const char *>(mapped);
+  size = fileStat.st_size;
+#endif
+
+  return IsValid();
+}
+
+void MappedFile::Close() {
+  if (!data)
+    return;
+
+#ifdef _WIN32
+  UnmapViewOfFile(data);
+#else
+  munmap(const_cast<char *>(data), size);
+#endif
+  data = nullptr;
+  size = 0;
+}
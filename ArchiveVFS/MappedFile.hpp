@@ -0,0 +1,52 @@
+/*      MappedFile
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "datas/esString.h"
+
+// Read only memory mapped file.
+// Empty files cannot be mapped.
+class MappedFile {
+public:
+  MappedFile() = default;
+  MappedFile(const TSTRING &path) { Open(path); }
+  MappedFile(MappedFile &&other) : data(other.data), size(other.size) {
+    other.data = nullptr;
+    other.size = 0;
+  }
+  MappedFile &operator=(MappedFile &&other);
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile() { Close(); }
+
+  bool Open(const TSTRING &path);
+  void Close();
+  bool IsValid() const { return data != nullptr; }
+  const char *Data() const { return data; }
+  size_t Size() const { return size; }
+
+  // Checks, that range lies within mapped data
+  bool Contains(const void *begin, size_t rangeSize) const {
+    const char *cBegin = static_cast<const char *>(begin);
+    return cBegin >= data && cBegin <= data + size &&
+           rangeSize <= static_cast<size_t>(data + size - cBegin);
+  }
+
+private:
+  const char *data = nullptr;
+  size_t size = 0;
+};
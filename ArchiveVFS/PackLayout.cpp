@@ -0,0 +1,168 @@
+/*      PackLayout
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "PackLayout.hpp"
+#include <algorithm>
+
+static constexpr size_t ENTRY_ALIGNMENT = 0x10;
+static constexpr size_t GAP_LOOKAHEAD = 64;
+
+static size_t AlignUp(size_t offset, size_t alignment) {
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+static std::string GetType(const std::string &path) {
+  const size_t lastDot = path.find_last_of('.');
+  const size_t lastSlash = path.find_last_of("/\\");
+
+  if (lastDot == path.npos || (lastSlash != path.npos && lastDot < lastSlash))
+    return {};
+
+  return path.substr(lastDot);
+}
+
+void PackLayout::AccessOrder(const std::vector<std::string> &paths) {
+  accessRanks.clear();
+
+  for (auto &p : paths) {
+    std::string cPath = p;
+    std::replace(cPath.begin(), cPath.end(), '\\', '/');
+    accessRanks.emplace(cPath, accessRanks.size());
+  }
+}
+
+size_t PackLayout::Alignment(const PackEntry &entry) const {
+  if (largeEntryAlignment > ENTRY_ALIGNMENT && entry.size >= largeEntrySize)
+    return largeEntryAlignment;
+
+  return ENTRY_ALIGNMENT;
+}
+
+bool PackLayout::Straddles(size_t offset, size_t size) const {
+  if (!blockSize || !size)
+    return false;
+
+  const size_t numBlocks =
+      (offset + size - 1) / blockSize - offset / blockSize + 1;
+
+  return numBlocks > (size + blockSize - 1) / blockSize;
+}
+
+size_t PackLayout::Place(std::vector<PackEntry> &entries,
+                         size_t dataBegin) const {
+  std::vector<size_t> order;
+  std::vector<size_t> ranks(entries.size(), static_cast<size_t>(-1));
+  std::vector<std::string> types(entries.size());
+
+  for (size_t e = 0; e < entries.size(); e++) {
+    if (entries[e].external)
+      continue;
+
+    order.push_back(e);
+
+    if (accessRanks.size()) {
+      std::string cPath = entries[e].name;
+      std::replace(cPath.begin(), cPath.end(), '\\', '/');
+      auto found = accessRanks.find(cPath);
+
+      if (found != accessRanks.end())
+        ranks[e] = found->second;
+    }
+
+    if (groupByType)
+      types[e] = GetType(entries[e].name);
+  }
+
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    if (ranks[a] != ranks[b])
+      return ranks[a] < ranks[b];
+
+    return types[a] < types[b];
+  });
+
+  std::vector<bool> placed(order.size());
+  size_t cursor = dataBegin;
+
+  for (size_t o = 0; o < order.size(); o++) {
+    if (placed[o])
+      continue;
+
+    PackEntry &cEntry = entries[order[o]];
+    size_t start = AlignUp(cursor, Alignment(cEntry));
+
+    if (Straddles(start, cEntry.size)) {
+      const size_t boundary = (start / blockSize + 1) * blockSize;
+      const size_t lookEnd = std::min(order.size(), o + GAP_LOOKAHEAD + 1);
+
+      for (size_t n = o + 1; n < lookEnd; n++) {
+        if (placed[n])
+          continue;
+
+        PackEntry &gapEntry = entries[order[n]];
+        const size_t gapStart = AlignUp(cursor, Alignment(gapEntry));
+
+        if (gapStart + gapEntry.size <= boundary) {
+          gapEntry.offset = gapStart;
+          cursor = gapStart + gapEntry.size;
+          placed[n] = true;
+        }
+      }
+
+      start = AlignUp(boundary, Alignment(cEntry));
+    }
+
+    cEntry.offset = start;
+    cursor = start + cEntry.size;
+  }
+
+  return cursor;
+}
+
+PackLayout::Report PackLayout::Evaluate(const std::vector<PackEntry> &entries,
+                                        size_t dataBegin) const {
+  Report report = {};
+  size_t dataEnd = dataBegin;
+  size_t dataSize = 0;
+
+  for (auto &e : entries) {
+    if (e.external)
+      continue;
+
+    report.numEntries++;
+    dataSize += e.size;
+    dataEnd = std::max(dataEnd, e.offset + e.size);
+
+    if (!blockSize) {
+      report.blockReads++;
+      report.minBlockReads++;
+      continue;
+    }
+
+    const size_t lastByte = e.offset + (e.size ? e.size - 1 : 0);
+    const size_t numBlocks = lastByte / blockSize - e.offset / blockSize + 1;
+    const size_t minBlocks =
+        std::max<size_t>(1, (e.size + blockSize - 1) / blockSize);
+
+    report.blockReads += numBlocks;
+    report.minBlockReads += minBlocks;
+    report.straddling += numBlocks > minBlocks;
+  }
+
+  report.padding = dataEnd - dataBegin - dataSize;
+
+  return report;
+}
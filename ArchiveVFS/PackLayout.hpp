@@ -0,0 +1,60 @@
+/*      PackLayout
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct PackEntry {
+  std::string name;
+  size_t size = 0;
+  size_t offset = 0;
+  bool external = false;
+};
+
+// Decides where entry payloads are placed within archive data.
+// Entries are ordered by access trace first, then optionally by type.
+// With blockSize set (AAF), entries are kept from straddling block
+// boundaries, gaps are filled by following small entries where possible.
+struct PackLayout {
+  struct Report {
+    size_t numEntries;
+    size_t blockReads;
+    size_t minBlockReads;
+    size_t straddling;
+    size_t padding;
+  };
+
+  bool groupByType = false;
+  size_t blockSize = 0;
+  size_t largeEntryAlignment = 0;
+  size_t largeEntrySize = 0x10000;
+
+  void AccessOrder(const std::vector<std::string> &paths);
+
+  // Assigns offsets to non external entries, returns end of data.
+  size_t Place(std::vector<PackEntry> &entries, size_t dataBegin) const;
+  Report Evaluate(const std::vector<PackEntry> &entries,
+                  size_t dataBegin) const;
+
+private:
+  std::unordered_map<std::string, size_t> accessRanks;
+
+  size_t Alignment(const PackEntry &entry) const;
+  bool Straddles(size_t offset, size_t size) const;
+};
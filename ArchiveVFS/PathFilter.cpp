@@ -0,0 +1,285 @@
+/*      PathFilter
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "PathFilter.hpp"
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+static std::string Normalize(const std::string &path) {
+  std::string retVal = path;
+
+  for (auto &c : retVal) {
+    if (c == '\\')
+      c = '/';
+    else if (c >= 'A' && c <= 'Z')
+      c += 'a' - 'A';
+  }
+
+  return retVal;
+}
+
+template <class F>
+static void ForEachItem(const std::string &list, F &&func) {
+  size_t lastOffset = 0;
+
+  while (lastOffset <= list.size()) {
+    size_t curOffset = list.find(';', lastOffset);
+
+    if (curOffset == list.npos)
+      curOffset = list.size();
+
+    if (curOffset > lastOffset)
+      func(Normalize(list.substr(lastOffset, curOffset - lastOffset)));
+
+    lastOffset = curOffset + 1;
+  }
+}
+
+// Iterative wildcard match, backtracks to last '*' only.
+static bool MatchGlob(const char *str, const char *strEnd, const char *pat) {
+  const char *lastStar = nullptr;
+  const char *lastMatch = nullptr;
+
+  while (str < strEnd) {
+    if (*pat == '*') {
+      lastStar = pat++;
+      lastMatch = str;
+    } else if (*pat && (*pat == '?' || *pat == *str)) {
+      pat++;
+      str++;
+    } else if (lastStar) {
+      pat = lastStar + 1;
+      str = ++lastMatch;
+    } else {
+      return false;
+    }
+  }
+
+  while (*pat == '*')
+    pat++;
+
+  return !*pat;
+}
+
+void PathFilter::AddExtensions(const std::string &list) {
+  ForEachItem(list, [&](std::string &&item) {
+    if (item[0] != '.')
+      item.insert(item.begin(), '.');
+
+    extensions.insert(std::move(item));
+  });
+}
+
+void PathFilter::AddGlobs(const std::string &list) {
+  ForEachItem(list, [&](std::string &&item) {
+    const bool pathPattern = item.find('/') != item.npos;
+    const size_t wildcard = item.find_first_of("*?");
+
+    // Plain names and "*.ext" patterns are looked up in hashed sets
+    if (!pathPattern && wildcard == item.npos) {
+      names.insert(std::move(item));
+    } else if (!pathPattern && wildcard == 0 && item.size() > 2 &&
+               item[1] == '.' &&
+               item.find_first_of("*?.", 2) == item.npos) {
+      extensions.insert(item.substr(1));
+    } else if (pathPattern) {
+      pathGlobs.push_back(std::move(item));
+    } else {
+      nameGlobs.push_back(std::move(item));
+    }
+  });
+}
+
+void PathFilter::AddDirectories(const std::string &list) {
+  ForEachItem(list, [&](std::string &&item) {
+    while (item.size() && item.back() == '/')
+      item.pop_back();
+
+    if (item.size())
+      directories.insert(std::move(item));
+  });
+}
+
+bool PathFilter::Empty() const {
+  return extensions.empty() && names.empty() && directories.empty() &&
+         nameGlobs.empty() && pathGlobs.empty();
+}
+
+bool PathFilter::MatchGlobs(const std::string &path, size_t nameBegin) const {
+  const char *pathEnd = path.c_str() + path.size();
+
+  for (auto &g : nameGlobs)
+    if (MatchGlob(path.c_str() + nameBegin, pathEnd, g.c_str()))
+      return true;
+
+  for (auto &g : pathGlobs)
+    if (MatchGlob(path.c_str(), pathEnd, g.c_str()))
+      return true;
+
+  return false;
+}
+
+bool PathFilter::Matches(const std::string &path) const {
+  if (Empty())
+    return false;
+
+  const std::string cPath = Normalize(path);
+  const size_t lastSlash = cPath.find_last_of('/');
+  const size_t nameBegin = lastSlash == cPath.npos ? 0 : lastSlash + 1;
+  const size_t lastDot = cPath.find_last_of('.');
+
+  if (lastDot != cPath.npos && lastDot >= nameBegin &&
+      extensions.count(cPath.substr(lastDot)))
+    return true;
+
+  if (names.size() && names.count(cPath.substr(nameBegin)))
+    return true;
+
+  // Directories are pruned during scan, but paths may come from TOC
+  if (directories.size()) {
+    for (size_t cOffset = 0; cOffset < nameBegin;) {
+      const size_t nextSlash = cPath.find('/', cOffset);
+
+      if (directories.count(cPath.substr(cOffset, nextSlash - cOffset)))
+        return true;
+
+      cOffset = nextSlash + 1;
+    }
+  }
+
+  return MatchGlobs(cPath, nameBegin);
+}
+
+bool PathFilter::IsExcludedDirectory(const std::string &path) const {
+  if (Empty())
+    return false;
+
+  std::string cPath = Normalize(path);
+
+  while (cPath.size() && cPath.back() == '/')
+    cPath.pop_back();
+
+  const size_t lastSlash = cPath.find_last_of('/');
+  const size_t nameBegin = lastSlash == cPath.npos ? 0 : lastSlash + 1;
+
+  if (directories.count(cPath.substr(nameBegin)))
+    return true;
+
+  cPath.push_back('/');
+
+  return MatchGlobs(cPath, nameBegin);
+}
+
+std::vector<TSTRING> ScanDirectory(const TSTRING &dir,
+                                   const PathFilter &filter) {
+  std::vector<TSTRING> files;
+  TSTRING root = dir;
+
+  if (root.size() && root.back() != '/' && root.back() != '\\')
+    root.push_back('/');
+
+  // Relative paths of directories to visit, with trailing slash
+  std::vector<TSTRING> queue = {TSTRING()};
+
+  while (queue.size()) {
+    const TSTRING cDir = std::move(queue.back());
+    queue.pop_back();
+
+    auto addItem = [&](const TSTRING &name, bool isDir) {
+      const TSTRING relPath = cDir + name;
+
+      if (isDir) {
+        if (!filter.IsExcludedDirectory(esString(relPath)))
+          queue.push_back(relPath + TSTRING(1, '/'));
+      } else if (!filter.IsExcluded(esString(relPath))) {
+        files.push_back(root + relPath);
+      }
+    };
+
+#ifdef _WIN32
+    WIN32_FIND_DATA findData;
+    const TSTRING pattern = root + cDir + _T("*");
+    HANDLE fHandle = FindFirstFile(pattern.c_str(), &findData);
+
+    if (fHandle == INVALID_HANDLE_VALUE)
+      continue;
+
+    do {
+      const TSTRING name = findData.cFileName;
+
+      if (name == _T(".") || name == _T(".."))
+        continue;
+
+      // Linked directories (junctions) are not entered, they might loop
+      if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) &&
+          (findData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+        continue;
+
+      addItem(name,
+              (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0);
+    } while (FindNextFile(fHandle, &findData));
+
+    FindClose(fHandle);
+#else
+    const TSTRING cPath = root + cDir;
+    DIR *cDirHandle = opendir(cPath.c_str());
+
+    if (!cDirHandle)
+      continue;
+
+    while (dirent *cEntry = readdir(cDirHandle)) {
+      const TSTRING name = cEntry->d_name;
+
+      if (name == "." || name == "..")
+        continue;
+
+      bool isDir = cEntry->d_type == DT_DIR;
+      bool isLink = cEntry->d_type == DT_LNK;
+      const TSTRING itemPath = cPath + name;
+      struct stat cStat;
+
+      if (cEntry->d_type == DT_UNKNOWN) {
+        if (lstat(itemPath.c_str(), &cStat))
+          continue;
+
+        isDir = S_ISDIR(cStat.st_mode);
+        isLink = S_ISLNK(cStat.st_mode);
+      }
+
+      if (isLink) {
+        // Linked directories are not entered, they might loop
+        if (stat(itemPath.c_str(), &cStat) || S_ISDIR(cStat.st_mode))
+          continue;
+
+        isDir = false;
+      }
+
+      addItem(name, isDir);
+    }
+
+    closedir(cDirHandle);
+#endif
+  }
+
+  return files;
+}
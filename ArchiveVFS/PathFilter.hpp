@@ -0,0 +1,58 @@
+/*      PathFilter
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "datas/esString.h"
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Exclusion rules compiled into hashed sets and glob patterns.
+// Paths are relative, '/' or '\\' separated, matching is case insensitive.
+// Rule lists are ';' separated.
+class PathFilter {
+public:
+  // For example: ".toc;.ee"
+  void AddExtensions(const std::string &list);
+  // Patterns without '/' are matched against file name only,
+  // '*' matches any sequence including '/', '?' any single character.
+  // For example: "*_backup.*;temp/*"
+  void AddGlobs(const std::string &list);
+  // Directory names, whole subtrees are excluded. For example: ".git;cache"
+  void AddDirectories(const std::string &list);
+
+  // Filter can be used as inclusion list too, returns false when empty.
+  bool Matches(const std::string &path) const;
+  bool IsExcluded(const std::string &path) const { return Matches(path); }
+  bool IsExcludedDirectory(const std::string &path) const;
+  bool Empty() const;
+
+private:
+  std::unordered_set<std::string> extensions;
+  std::unordered_set<std::string> names;
+  std::unordered_set<std::string> directories;
+  std::vector<std::string> nameGlobs;
+  std::vector<std::string> pathGlobs;
+
+  bool MatchGlobs(const std::string &path, size_t nameBegin) const;
+};
+
+// Recursively collects files within directory, that are not excluded.
+// Excluded and symlinked directories are not entered at all.
+// Returned paths are dir + relative path.
+std::vector<TSTRING> ScanDirectory(const TSTRING &dir,
+                                   const PathFilter &filter);
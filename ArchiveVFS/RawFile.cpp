@@ -0,0 +1,309 @@
+/*      RawFile
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "RawFile.hpp"
+#include "BufferPool.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#include <sys/utime.h>
+#include <windows.h>
+#else
+#include <climits>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+static constexpr size_t COPY_CHUNK_SIZE = 0x100000;
+
+RawFile &RawFile::operator=(RawFile &&other) {
+  std::swap(fd, other.fd);
+  return *this;
+}
+
+bool RawFile::Open(const TSTRING &path, Mode mode) {
+  Close();
+#ifdef _WIN32
+  if (mode == READ)
+    fd = _topen(path.c_str(), _O_RDONLY | _O_BINARY);
+  else if (mode == UPDATE)
+    fd = _topen(path.c_str(), _O_RDWR | _O_BINARY);
+  else if (mode == CREATE_NEW)
+    fd = _topen(path.c_str(), _O_RDWR | _O_CREAT | _O_EXCL | _O_BINARY,
+                _S_IREAD | _S_IWRITE);
+  else
+    fd = _topen(path.c_str(), _O_RDWR | _O_CREAT | _O_TRUNC | _O_BINARY,
+                _S_IREAD | _S_IWRITE);
+#else
+  if (mode == READ)
+    fd = open(path.c_str(), O_RDONLY);
+  else if (mode == UPDATE)
+    fd = open(path.c_str(), O_RDWR);
+  else if (mode == CREATE_NEW)
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+  else
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+#endif
+  return IsValid();
+}
+
+void RawFile::Close() {
+  if (fd < 0)
+    return;
+
+#ifdef _WIN32
+  _close(fd);
+#else
+  close(fd);
+#endif
+  fd = -1;
+}
+
+size_t RawFile::Size() const {
+#ifdef _WIN32
+  struct _stat64 fStat;
+
+  if (_fstat64(fd, &fStat))
+    return 0;
+#else
+  struct stat fStat;
+
+  if (fstat(fd, &fStat))
+    return 0;
+#endif
+  return fStat.st_size;
+}
+
+bool RawFile::ReadAt(size_t offset, char *buffer, size_t size) const {
+  while (size) {
+#ifdef _WIN32
+    if (_lseeki64(fd, offset, SEEK_SET) < 0)
+      return false;
+
+    const int numRead = _read(
+        fd, buffer, static_cast<unsigned>(std::min<size_t>(size, 1 << 30)));
+#else
+    const ssize_t numRead = pread(fd, buffer, size, offset);
+#endif
+    if (numRead <= 0)
+      return false;
+
+    buffer += numRead;
+    offset += numRead;
+    size -= numRead;
+  }
+
+  return true;
+}
+
+bool RawFile::WriteAt(size_t offset, const char *buffer, size_t size) {
+  while (size) {
+#ifdef _WIN32
+    if (_lseeki64(fd, offset, SEEK_SET) < 0)
+      return false;
+
+    const int numWritten = _write(
+        fd, buffer, static_cast<unsigned>(std::min<size_t>(size, 1 << 30)));
+#else
+    const ssize_t numWritten = pwrite(fd, buffer, size, offset);
+#endif
+    if (numWritten <= 0)
+      return false;
+
+    buffer += numWritten;
+    offset += numWritten;
+    size -= numWritten;
+  }
+
+  return true;
+}
+
+bool RawFile::WriteAt(size_t offset, const std::vector<Slice> &slices) {
+#ifdef __linux__
+  std::vector<iovec> vectors;
+
+  for (auto &s : slices)
+    if (s.size)
+      vectors.push_back({const_cast<char *>(s.data), s.size});
+
+  for (size_t first = 0; first < vectors.size();) {
+    const int count =
+        static_cast<int>(std::min<size_t>(vectors.size() - first, IOV_MAX));
+    ssize_t numWritten = pwritev(fd, vectors.data() + first, count, offset);
+
+    if (numWritten <= 0)
+      return false;
+
+    offset += numWritten;
+
+    // Skip written vectors, partially written one is adjusted
+    for (; first < vectors.size() && numWritten; first++) {
+      iovec &cVector = vectors[first];
+
+      if (static_cast<size_t>(numWritten) < cVector.iov_len) {
+        cVector.iov_base = static_cast<char *>(cVector.iov_base) + numWritten;
+        cVector.iov_len -= numWritten;
+        break;
+      }
+
+      numWritten -= cVector.iov_len;
+    }
+  }
+
+  return true;
+#else
+  for (auto &s : slices) {
+    if (!WriteAt(offset, s.data, s.size))
+      return false;
+
+    offset += s.size;
+  }
+
+  return true;
+#endif
+}
+
+bool CopyRange(const RawFile &input, size_t inOffset, RawFile &output,
+               size_t outOffset, size_t size) {
+#ifdef __linux__
+  while (size) {
+    loff_t inOff = inOffset;
+    loff_t outOff = outOffset;
+    const ssize_t numCopied = copy_file_range(
+        input.Handle(), &inOff, output.Handle(), &outOff, size, 0);
+
+    // Not supported by kernel or filesystem, use fallback
+    if (numCopied <= 0)
+      break;
+
+    inOffset += numCopied;
+    outOffset += numCopied;
+    size -= numCopied;
+  }
+
+  if (!size)
+    return true;
+#endif
+
+  BufferPool::Buffer buffer =
+      BufferPool::Acquire(std::min(size, COPY_CHUNK_SIZE));
+
+  if (!buffer)
+    return false;
+
+  while (size) {
+    const size_t toCopy = std::min(size, COPY_CHUNK_SIZE);
+
+    if (!input.ReadAt(inOffset, buffer.Data(), toCopy) ||
+        !output.WriteAt(outOffset, buffer.Data(), toCopy))
+      return false;
+
+    inOffset += toCopy;
+    outOffset += toCopy;
+    size -= toCopy;
+  }
+
+  return true;
+}
+
+size_t FileStat(const TSTRING &path, int64_t &mtime) {
+#ifdef _WIN32
+  struct _stat64 fileStat;
+
+  if (_tstat64(path.c_str(), &fileStat) || !(fileStat.st_mode & _S_IFREG))
+    return NO_FILE;
+
+  mtime = static_cast<int64_t>(fileStat.st_mtime) * 1000000000;
+#else
+  struct stat fileStat;
+
+  if (stat(path.c_str(), &fileStat) || !S_ISREG(fileStat.st_mode))
+    return NO_FILE;
+
+#ifdef __linux__
+  mtime = static_cast<int64_t>(fileStat.st_mtim.tv_sec) * 1000000000 +
+          fileStat.st_mtim.tv_nsec;
+#else
+  mtime = static_cast<int64_t>(fileStat.st_mtime) * 1000000000;
+#endif
+#endif
+
+  return static_cast<size_t>(fileStat.st_size);
+}
+
+bool SetModifiedTime(const TSTRING &path, int64_t mtime) {
+#ifdef _WIN32
+  struct __utimbuf64 times;
+  times.actime = times.modtime = mtime / 1000000000;
+
+  return !_tutime64(path.c_str(), &times);
+#else
+  struct timespec times[2];
+  times[0].tv_sec = 0;
+  times[0].tv_nsec = UTIME_OMIT;
+  times[1].tv_sec = static_cast<time_t>(mtime / 1000000000);
+  times[1].tv_nsec = static_cast<long>(mtime % 1000000000);
+
+  return !utimensat(AT_FDCWD, path.c_str(), times, 0);
+#endif
+}
+
+bool MoveFileOver(const TSTRING &from, const TSTRING &to) {
+#ifdef _WIN32
+  return MoveFileEx(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+  return !rename(from.c_str(), to.c_str());
+#endif
+}
+
+bool RemoveFile(const TSTRING &path) {
+#ifdef _WIN32
+  return !_tremove(path.c_str());
+#else
+  return !unlink(path.c_str());
+#endif
+}
+
+bool MakeDir(const TSTRING &path) {
+#ifdef _WIN32
+  struct _stat64 dirStat;
+  _tmkdir(path.c_str());
+
+  return !_tstat64(path.c_str(), &dirStat) && (dirStat.st_mode & _S_IFDIR);
+#else
+  struct stat dirStat;
+  mkdir(path.c_str(), 0755);
+
+  return !stat(path.c_str(), &dirStat) && S_ISDIR(dirStat.st_mode);
+#endif
+}
+
+bool SameFile(const TSTRING &path1, const TSTRING &path2) {
+#ifdef _WIN32
+  return false;
+#else
+  struct stat stat1, stat2;
+
+  return !stat(path1.c_str(), &stat1) && !stat(path2.c_str(), &stat2) &&
+         stat1.st_ino == stat2.st_ino && stat1.st_dev == stat2.st_dev;
+#endif
+}
@@ -0,0 +1,84 @@
+/*      RawFile
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "datas/esString.h"
+#include <cstdint>
+#include <vector>
+
+// Unbuffered file with positional reads and writes.
+// Positional access is thread safe on POSIX only.
+class RawFile {
+public:
+  enum Mode { READ, WRITE, UPDATE, CREATE_NEW };
+
+  struct Slice {
+    const char *data;
+    size_t size;
+  };
+
+  RawFile() = default;
+  RawFile(const TSTRING &path, Mode mode) { Open(path, mode); }
+  RawFile(RawFile &&other) : fd(other.fd) { other.fd = -1; }
+  RawFile &operator=(RawFile &&other);
+  RawFile(const RawFile &) = delete;
+  RawFile &operator=(const RawFile &) = delete;
+  ~RawFile() { Close(); }
+
+  // WRITE mode creates or truncates file,
+  // UPDATE mode opens existing file for reading and writing,
+  // CREATE_NEW mode creates file, fails when it exists
+  bool Open(const TSTRING &path, Mode mode);
+  void Close();
+  bool IsValid() const { return fd >= 0; }
+  int Handle() const { return fd; }
+  size_t Size() const;
+
+  // Returns false on error or end of file
+  bool ReadAt(size_t offset, char *buffer, size_t size) const;
+  bool WriteAt(size_t offset, const char *buffer, size_t size);
+  // Gathered write of consecutive slices, single pwritev where available
+  bool WriteAt(size_t offset, const std::vector<Slice> &slices);
+
+private:
+  int fd = -1;
+};
+
+// Copies range between files, kernel side (copy_file_range) where available,
+// falls back to pooled buffer.
+bool CopyRange(const RawFile &input, size_t inOffset, RawFile &output,
+               size_t outOffset, size_t size);
+
+static constexpr size_t NO_FILE = static_cast<size_t>(-1);
+
+// Size of regular file or NO_FILE,
+// modification time is in nanoseconds (where available).
+size_t FileStat(const TSTRING &path, int64_t &mtime);
+
+// Modification time in nanoseconds, precision depends on platform.
+bool SetModifiedTime(const TSTRING &path, int64_t mtime);
+
+// Renames file, existing destination file is replaced.
+bool MoveFileOver(const TSTRING &from, const TSTRING &to);
+
+bool RemoveFile(const TSTRING &path);
+
+// Returns true, when directory exists afterwards.
+bool MakeDir(const TSTRING &path);
+
+// Both paths are links to same file, detected on POSIX only.
+bool SameFile(const TSTRING &path1, const TSTRING &path2);
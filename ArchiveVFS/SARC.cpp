@@ -0,0 +1,44 @@
+/*      SARC/AAF archive formats
+        Copyright(C) 2017-2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "SARC.hpp"
+
+constexpr int AAF::ID2[];
+
+SARC::Ptr SARC::Create(BinReader *rd) {
+  const size_t begin = rd->Tell();
+  int hlen;
+  rd->Read(hlen);
+  rd->Seek(begin);
+
+  const bool bigEndian = IsBigEndian(hlen);
+  Ptr SARCInstance(new SARC2());
+  SARCInstance->bigEndian = bigEndian;
+  int resltld = SARCInstance->Load(rd);
+
+  if (resltld == 2) {
+    rd->Seek(begin);
+    SARCInstance.reset(new SARC3());
+    SARCInstance->bigEndian = bigEndian;
+    resltld = SARCInstance->Load(rd);
+  }
+
+  if (resltld)
+    return nullptr;
+
+  return SARCInstance;
+}
@@ -0,0 +1,670 @@
+/*      SARC/AAF archive formats
+        Copyright(C) 2017-2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "BufferPool.hpp"
+#include "Endian.hpp"
+#include "datas/MasterPrinter.hpp"
+#include "datas/binreader.hpp"
+#include "datas/binwritter.hpp"
+#include "lookup3.h"
+#include "zlib.h"
+#include <memory>
+#include <sstream>
+#include <vector>
+
+struct SARCFileEntry {
+  std::string fileName;
+  size_t offset;
+  size_t length;
+  bool external = false;
+
+  SARCFileEntry() = default;
+  SARCFileEntry(const std::string str, size_t fSize)
+      : fileName(str), offset(0), length(fSize) {}
+
+  // Returns nullptr if entry doesn't fit into TOC buffer
+  template <bool BE> const char *Load(const char *cur, const char *end) {
+    if (cur + 4 > end)
+      return nullptr;
+
+    const uint nameSize = Endian<BE>::Get(cur);
+    cur += 4;
+
+    if (!nameSize || cur + nameSize + 8 > end)
+      return nullptr;
+
+    // Name is zero padded to 4 bytes
+    fileName.assign(cur, strnlen(cur, nameSize));
+    cur += nameSize;
+    offset = Endian<BE>::Get(cur);
+    length = Endian<BE>::Get(cur + 4);
+    external = !offset;
+
+    return cur + 8;
+  }
+
+  // Offset and length must be checked against SARC::MAX_OFFSET
+  template <bool BE> void Write(std::string &toc) const {
+    uint allignment = fileName.size() & 0x3;
+
+    if (allignment)
+      allignment = 4 - allignment;
+
+    Endian<BE>::Put(toc, allignment + fileName.size());
+    toc.append(fileName).append(allignment, 0);
+    Endian<BE>::Put(toc, static_cast<uint>(offset));
+    Endian<BE>::Put(toc, static_cast<uint>(length));
+  }
+};
+
+struct _SARC3FileEntry {
+  uint fileNameOffset;
+  uint offset;
+  uint length;
+  uint fileNameHash, hash02;
+};
+
+struct SARC3FileEntry {
+  std::string fileName;
+  uint fileNameOffset;
+  size_t offset;
+  size_t length;
+  uint fileNameHash, hash02;
+  bool external = false;
+};
+
+struct SARC {
+  typedef std::unique_ptr<SARC> Ptr;
+  static constexpr int ID = CompileFourCC("SARC");
+
+  enum CompressionType { C_NONE, C_ZLIB, C_AAF };
+
+  // Offsets and sizes are size_t in memory, but stored as 32bit unsigned
+  // integers, Write fails for larger values
+  static constexpr size_t MAX_OFFSET = 0xFFFFFFFF;
+
+  bool bigEndian = false;
+  // Keep offsets assigned by SetFileOffset instead of packing sequentially
+  bool presetOffsets = false;
+
+  virtual ~SARC() = default;
+  virtual int Load(BinReader *rd) = 0;
+  // Returns non zero, when offsets or sizes don't fit, nothing is written
+  virtual int Write(BinWritter *wr) = 0;
+  virtual void AddFileEntry(const std::string &filePath, size_t fileSize,
+                            bool external) = 0;
+  virtual int GetVersion() const = 0;
+  virtual size_t NumFiles() const = 0;
+  virtual const std::string &FileName(size_t id) const = 0;
+  // Returns 0 for external files
+  virtual size_t FileOffset(size_t id) const = 0;
+  virtual size_t FileSize(size_t id) const = 0;
+  virtual void SetFileOffset(size_t id, size_t offset) = 0;
+  // Beginning of file data, TOC must be complete
+  virtual size_t DataOffset() const = 0;
+
+  // Detects SARC version and byte order and loads TOC,
+  // returns nullptr on failure.
+  static Ptr Create(BinReader *rd);
+
+  // First header field is always 4, use it to detect byte order.
+  static bool IsBigEndian(int hlen) { return hlen == 0x4000000; }
+
+protected:
+  static bool FitsFields(const std::string &fileName, size_t offset,
+                         size_t length) {
+    if (offset <= MAX_OFFSET && length <= MAX_OFFSET)
+      return true;
+
+    printerror("File data exceed 4 GB archive offsets: ",
+               << fileName.c_str());
+    return false;
+  }
+};
+
+template <class C> struct SARC_t : SARC {
+  std::vector<C> files;
+
+  size_t NumFiles() const override { return files.size(); }
+  const std::string &FileName(size_t id) const override {
+    return files[id].fileName;
+  }
+  size_t FileOffset(size_t id) const override {
+    return files[id].external ? 0 : files[id].offset;
+  }
+  size_t FileSize(size_t id) const override { return files[id].length; }
+  void SetFileOffset(size_t id, size_t offset) override {
+    files[id].offset = offset;
+  }
+};
+
+struct SARC2 : SARC_t<SARCFileEntry> {
+  struct Header {
+    int hlen;
+    int hid;
+    int version;
+    uint tocSize;
+  } header;
+
+  SARC2() : header{4, ID, 2} {}
+
+  void AddFileEntry(const std::string &filePath, size_t fileSize,
+                    bool external) override {
+    files.emplace_back(filePath, fileSize);
+    files.back().external = external;
+  }
+
+  int GetVersion() const override { return 2; }
+
+  template <bool BE> static void SwapHeader(Header &hdr) {
+    const int hid = hdr.hid;
+    Endian<BE>::Swap(hdr);
+    hdr.hid = hid;
+  }
+
+  int Load(BinReader *rd) override {
+    return bigEndian ? Load<true>(rd) : Load<false>(rd);
+  }
+
+  int Write(BinWritter *bw) override {
+    return bigEndian ? Write<true>(bw) : Write<false>(bw);
+  }
+
+  template <bool BE> int Load(BinReader *rd) {
+    rd->Read(header);
+    SwapHeader<BE>(header);
+
+    if (header.hlen != 4 || header.hid != ID)
+      return 1;
+
+    if (header.version > 2)
+      return 2;
+
+    std::string toc;
+    toc.resize(header.tocSize);
+    rd->ReadContainer(toc, header.tocSize);
+
+    const char *cur = toc.data();
+    const char *end = cur + toc.size();
+
+    while (true) {
+      SARCFileEntry cf;
+      cur = cf.Load<BE>(cur, end);
+
+      if (!cur)
+        break;
+
+      files.push_back(cf);
+    }
+
+    return 0;
+  }
+
+  size_t DataOffset() const override {
+    size_t tocSize = 0;
+
+    for (auto &f : files)
+      tocSize += 12 + ((f.fileName.size() + 3) & ~3);
+
+    return sizeof(header) + ((tocSize + 0xF) & ~0xF);
+  }
+
+  template <bool BE> int Write(BinWritter *bw) {
+    std::string toc;
+    header.tocSize = DataOffset() - sizeof(header);
+    size_t lastOffset = bw->Tell() + DataOffset();
+
+    for (auto f : files) {
+      if (f.external) {
+        f.offset = 0;
+      } else if (!presetOffsets) {
+        f.offset = lastOffset;
+
+        uint allignment = f.length & 0xF;
+
+        if (allignment)
+          allignment = 0x10 - allignment;
+
+        lastOffset += allignment + f.length;
+      }
+
+      if (!FitsFields(f.fileName, f.offset, f.length))
+        return 1;
+
+      f.Write<BE>(toc);
+    }
+
+    toc.resize(header.tocSize);
+
+    Header outHeader = header;
+    SwapHeader<BE>(outHeader);
+    bw->Write(outHeader);
+    bw->WriteContainer(toc);
+
+    return 0;
+  }
+};
+
+struct SARC3 : SARC_t<SARC3FileEntry> {
+  struct Header {
+    int hlen;
+    int hid;
+    int version;
+    uint dataOffset;
+    uint bufferLen;
+  } header;
+
+  std::string nameBuffer;
+
+  SARC3() : header{4, ID, 3} {}
+
+  void AddFileEntry(const std::string &filePath, size_t fileSize,
+                    bool external) override {
+    SARC3FileEntry nEntry;
+
+    nEntry.fileNameOffset = static_cast<uint>(nameBuffer.size());
+    nameBuffer.append(filePath).push_back(0);
+    nEntry.fileNameHash = JenkinsLookup3(filePath.c_str());
+    nEntry.hash02 = 0;
+    nEntry.length = fileSize;
+    nEntry.offset = 0;
+    nEntry.external = external;
+    nEntry.fileName = filePath;
+
+    files.push_back(nEntry);
+  }
+
+  int GetVersion() const override { return 3; }
+
+  template <bool BE> static void SwapHeader(Header &hdr) {
+    const int hid = hdr.hid;
+    Endian<BE>::Swap(hdr);
+    hdr.hid = hid;
+  }
+
+  int Load(BinReader *rd) override {
+    return bigEndian ? Load<true>(rd) : Load<false>(rd);
+  }
+
+  int Write(BinWritter *wr) override {
+    return bigEndian ? Write<true>(wr) : Write<false>(wr);
+  }
+
+  template <bool BE> int Load(BinReader *rd) {
+    const size_t begin = rd->Tell();
+    rd->Read(header);
+    SwapHeader<BE>(header);
+
+    if (header.hlen != 4 || header.hid != ID)
+      return 1;
+
+    if (header.version != 3)
+      return 2;
+
+    nameBuffer.resize(header.bufferLen);
+    rd->ReadContainer(nameBuffer, header.bufferLen);
+
+    const size_t tocBegin = rd->Tell() - begin;
+
+    if (header.dataOffset < tocBegin)
+      return 1;
+
+    // Whole table is read and byte swapped at once
+    const size_t numFiles =
+        (header.dataOffset - tocBegin) / sizeof(_SARC3FileEntry);
+    std::vector<_SARC3FileEntry> table(numFiles);
+
+    if (numFiles) {
+      rd->ReadBuffer(reinterpret_cast<char *>(table.data()),
+                     numFiles * sizeof(_SARC3FileEntry));
+      Endian<BE>::SwapArray(table.data(), numFiles *
+                                              sizeof(_SARC3FileEntry) / 4);
+    }
+
+    files.resize(numFiles);
+
+    for (size_t f = 0; f < numFiles; f++) {
+      SARC3FileEntry &cf = files[f];
+      cf.fileNameOffset = table[f].fileNameOffset;
+      cf.offset = table[f].offset;
+      cf.length = table[f].length;
+      cf.fileNameHash = table[f].fileNameHash;
+      cf.hash02 = table[f].hash02;
+      cf.external = !cf.offset;
+
+      if (cf.fileNameOffset < nameBuffer.size())
+        cf.fileName = nameBuffer.c_str() + cf.fileNameOffset;
+    }
+
+    return 0;
+  }
+
+  size_t DataOffset() const override {
+    const size_t TOCend = sizeof(header) + ((nameBuffer.size() + 3) & ~3) +
+                          files.size() * sizeof(_SARC3FileEntry);
+
+    return (TOCend + 0xF) & ~0xF;
+  }
+
+  template <bool BE> int Write(BinWritter *wr) {
+    const size_t begin = wr->Tell();
+
+    header.bufferLen = (nameBuffer.size() + 3) & ~3;
+    header.dataOffset = static_cast<uint>(begin + DataOffset());
+
+    std::vector<_SARC3FileEntry> table(files.size());
+    size_t lastOffset = header.dataOffset;
+
+    for (size_t t = 0; t < files.size(); t++) {
+      auto &f = files[t];
+
+      if (f.external) {
+        f.offset = 0;
+      } else if (!presetOffsets) {
+        f.offset = lastOffset;
+        uint allignment = f.length & 0xF;
+
+        if (allignment)
+          allignment = 0x10 - allignment;
+
+        lastOffset += allignment + f.length;
+      }
+
+      if (!FitsFields(f.fileName, f.offset, f.length))
+        return 1;
+
+      table[t] = {f.fileNameOffset, static_cast<uint>(f.offset),
+                  static_cast<uint>(f.length), f.fileNameHash, f.hash02};
+    }
+
+    Endian<BE>::SwapArray(table.data(),
+                          table.size() * sizeof(_SARC3FileEntry) / 4);
+
+    Header outHeader = header;
+    SwapHeader<BE>(outHeader);
+
+    wr->Write(outHeader);
+    wr->WriteContainer(nameBuffer);
+    wr->ApplyPadding(4);
+    wr->WriteBuffer(reinterpret_cast<const char *>(table.data()),
+                    table.size() * sizeof(_SARC3FileEntry));
+    wr->ApplyPadding();
+
+    return 0;
+  }
+};
+
+struct EWAM {
+  static constexpr int ID = CompileFourCC("EWAM");
+  static constexpr int MAX_BLOCK_SIZE = 0x2000000;
+
+  // Sizes are signed on disk, blocks are limited to MAX_BLOCK_SIZE,
+  // so compressed data fit too
+  struct Header {
+    int compressedSize;
+    int uncompressedSize;
+    int nextBlock;
+    int id;
+  } header;
+  // Points either into pooled buffer or into caller's data when writing
+  char *intermediateData;
+  BufferPool::Buffer buffer;
+
+  template <bool BE> static void SwapHeader(Header &hdr) {
+    const int id = hdr.id;
+    Endian<BE>::Swap(hdr);
+    hdr.id = id;
+  }
+
+  // Raw deflate of one block, returns zlib state.
+  static int Inflate(const char *inBuffer, size_t inSize, char *outBuffer,
+                     size_t outSize) {
+    z_stream infstream;
+    infstream.zalloc = Z_NULL;
+    infstream.zfree = Z_NULL;
+    infstream.opaque = Z_NULL;
+    infstream.avail_in = inSize;
+    infstream.next_in =
+        reinterpret_cast<Bytef *>(const_cast<char *>(inBuffer));
+    infstream.avail_out = outSize;
+    infstream.next_out = reinterpret_cast<Bytef *>(outBuffer);
+    inflateInit2(&infstream, -MAX_WBITS);
+    const int state = inflate(&infstream, Z_FINISH);
+    inflateEnd(&infstream);
+
+    return state;
+  }
+
+  template <bool BE> int Load(BinReader *rd) {
+    rd->Read(header);
+    SwapHeader<BE>(header);
+
+    if (header.id != ID)
+      return 1;
+
+    if (header.compressedSize < 0 || header.uncompressedSize < 0 ||
+        header.uncompressedSize > MAX_BLOCK_SIZE) {
+      printerror("[EWAM] Invalid block sizes.");
+      return 2;
+    }
+
+    BufferPool::Buffer compressedStream =
+        BufferPool::Acquire(header.compressedSize);
+    buffer = BufferPool::Acquire(header.uncompressedSize);
+    intermediateData = buffer.Data();
+
+    if (!compressedStream || !buffer) {
+      printerror("[EWAM] Cannot allocate block buffers.");
+      return 2;
+    }
+    rd->ReadBuffer(compressedStream.Data(), header.compressedSize);
+
+    int state = Inflate(compressedStream.Data(), header.compressedSize,
+                        intermediateData, header.uncompressedSize);
+
+    if (state != Z_STREAM_END) {
+      printerror("[ZLIB] Expected Z_STREAM_END.");
+      return 2;
+    }
+
+    return 0;
+  }
+
+  // Raw deflate of one block into pooled buffer, returns zlib state.
+  static int Deflate(const char *inBuffer, size_t inSize,
+                     BufferPool::Buffer &outBuffer, size_t &outSize) {
+    const uLong compressedBound = compressBound(static_cast<uLong>(inSize));
+    outBuffer = BufferPool::Acquire(compressedBound);
+
+    if (!outBuffer)
+      return Z_MEM_ERROR;
+
+    z_stream infstream;
+    infstream.zalloc = Z_NULL;
+    infstream.zfree = Z_NULL;
+    infstream.opaque = Z_NULL;
+    infstream.avail_in = static_cast<uInt>(inSize);
+    infstream.next_in =
+        reinterpret_cast<Bytef *>(const_cast<char *>(inBuffer));
+    infstream.avail_out = compressedBound;
+    infstream.next_out = reinterpret_cast<Bytef *>(outBuffer.Data());
+
+    deflateInit2(&infstream, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+                 Z_DEFAULT_STRATEGY);
+    const int state = deflate(&infstream, Z_FINISH);
+    deflateEnd(&infstream);
+    outSize = infstream.total_out;
+
+    return state;
+  }
+
+  // Fills compressedSize and nextBlock from compressed data size.
+  void SetCompressedSize(size_t compressedSize) {
+    header.compressedSize = static_cast<int>(compressedSize);
+    const size_t dataSize = sizeof(header) + compressedSize;
+    header.nextBlock = (dataSize + 0xF) & ~0xF;
+  }
+
+  template <bool BE> int Write(BinWritter *wr) {
+    BufferPool::Buffer compressedStream;
+    size_t compressedSize;
+
+    if (Deflate(intermediateData, header.uncompressedSize, compressedStream,
+                compressedSize) != Z_STREAM_END) {
+      printerror("[ZLIB] Expected Z_STREAM_END.");
+      return 2;
+    }
+
+    SetCompressedSize(compressedSize);
+
+    Header outHeader = header;
+    SwapHeader<BE>(outHeader);
+
+    wr->Write(outHeader);
+    wr->WriteBuffer(compressedStream.Data(), header.compressedSize);
+    wr->ApplyPadding();
+
+    return 0;
+  }
+
+  EWAM() : header{0, 0, 0, ID}, intermediateData(nullptr) {}
+};
+
+struct AAF {
+  static constexpr int ID = CompileFourCC("AAF\0");
+  static constexpr int ID2[] = {CompileFourCC("AVAL"), CompileFourCC("ANCH"),
+                                CompileFourCC("EARC"), CompileFourCC("HIVE"),
+                                CompileFourCC("FORM"), CompileFourCC("ATIS"),
+                                CompileFourCC("COOL")};
+  static constexpr int MAX_BLOCK_SIZE = EWAM::MAX_BLOCK_SIZE;
+
+  struct Header {
+    int id;
+    int version;
+    int id2[7];
+    uint uncompressedSize;
+    uint blockSize;
+    uint blockCount;
+
+    Header()
+        : id(ID), version(1), id2{ID2[0], ID2[1], ID2[2], ID2[3],
+                                  ID2[4], ID2[5], ID2[6]} {}
+
+    // Version is always 1, use it to detect byte order.
+    bool IsBigEndian() const { return version == 0x1000000; }
+  } header;
+
+  bool bigEndian = false;
+  std::vector<std::unique_ptr<EWAM>> blocks;
+
+  template <bool BE> static void SwapHeader(Header &hdr) {
+    Endian<BE>::Swap(hdr.version);
+    Endian<BE>::Swap(hdr.uncompressedSize);
+    Endian<BE>::Swap(hdr.blockSize);
+    Endian<BE>::Swap(hdr.blockCount);
+  }
+
+  int Load(BinReader *rd) {
+    const size_t begin = rd->Tell();
+    rd->Read(header);
+    rd->Seek(begin);
+    bigEndian = header.IsBigEndian();
+
+    return bigEndian ? Load<true>(rd) : Load<false>(rd);
+  }
+
+  int Write(BinWritter *wr, char *buffer, size_t buffSize) {
+    if (buffSize > SARC::MAX_OFFSET) {
+      printerror("[AAF] Archives over 4 GB are not supported.");
+      return 1;
+    }
+
+    return bigEndian ? Write<true>(wr, buffer, buffSize)
+                     : Write<false>(wr, buffer, buffSize);
+  }
+
+  template <bool BE> int Load(BinReader *rd) {
+    rd->Read(header);
+    SwapHeader<BE>(header);
+
+    if (header.id != ID)
+      return 1;
+
+    if (memcmp(header.id2, ID2, sizeof(ID2)))
+      return 2;
+
+    for (uint b = 0; b < header.blockCount; b++) {
+      EWAM *cb = new EWAM;
+      size_t cpos = rd->Tell();
+      int rtval = cb->Load<BE>(rd);
+
+      if (rtval)
+        return 3;
+
+      blocks.emplace_back(cb);
+      rd->Seek(cpos + cb->header.nextBlock);
+    }
+
+    return 0;
+  }
+
+  template <bool BE>
+  int Write(BinWritter *wr, char *buffer, size_t buffSize) {
+    header.blockCount = static_cast<uint>(buffSize / MAX_BLOCK_SIZE);
+    header.uncompressedSize = static_cast<uint>(buffSize);
+
+    if (buffSize % MAX_BLOCK_SIZE || !buffSize)
+      header.blockCount++;
+
+    const size_t lastBlockSize =
+        buffSize - (header.blockCount - 1) * MAX_BLOCK_SIZE;
+
+    if (header.blockCount > 1)
+      header.blockSize = MAX_BLOCK_SIZE;
+    else
+      header.blockSize = lastBlockSize;
+
+    Header outHeader = header;
+    SwapHeader<BE>(outHeader);
+    wr->Write(outHeader);
+
+    for (uint b = 1; b < header.blockCount; b++) {
+      EWAM ew;
+      ew.intermediateData = buffer + (b - 1) * MAX_BLOCK_SIZE;
+      ew.header.uncompressedSize = MAX_BLOCK_SIZE;
+
+      if (ew.Write<BE>(wr))
+        return 1;
+    }
+
+    EWAM ew;
+    ew.intermediateData = buffer + (header.blockCount - 1) * MAX_BLOCK_SIZE;
+    ew.header.uncompressedSize = lastBlockSize;
+
+    if (ew.Write<BE>(wr))
+      return 1;
+
+    return 0;
+  }
+
+  void GetNewStream(std::stringstream *str) {
+    for (auto &b : blocks)
+      str->write(b->intermediateData, b->header.uncompressedSize);
+  }
+};
+
@@ -0,0 +1,176 @@
+/*      SourceCache
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "SourceCache.hpp"
+#include "RawFile.hpp"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+// Stat calls are latency bound, more threads than cores help on cold cache
+static constexpr size_t MAX_STAT_THREADS = 16;
+static constexpr size_t FILES_PER_STAT_THREAD = 64;
+
+// Helper threads of all concurrent FileSizes calls (batch pack jobs)
+static std::atomic<size_t> numStatHelpers(0);
+
+std::vector<size_t> FileSizes(const std::vector<TSTRING> &paths) {
+  std::vector<size_t> sizes(paths.size(), NO_FILE);
+  std::atomic<size_t> nextFile{0};
+
+  auto worker = [&] {
+    int64_t mtime;
+
+    for (size_t f; (f = nextFile.fetch_add(1)) < paths.size();)
+      sizes[f] = FileStat(paths[f], mtime);
+  };
+
+  const size_t numThreads = std::min(
+      MAX_STAT_THREADS, paths.size() / FILES_PER_STAT_THREAD + 1);
+  std::vector<std::thread> threads;
+
+  // Calling thread always works, helpers are taken from shared budget
+  for (size_t t = 1; t < numThreads; t++) {
+    if (numStatHelpers.fetch_add(1) >= MAX_STAT_THREADS - 1) {
+      numStatHelpers--;
+      break;
+    }
+
+    threads.emplace_back(worker);
+  }
+
+  worker();
+
+  for (auto &t : threads)
+    t.join();
+
+  numStatHelpers -= threads.size();
+
+  return sizes;
+}
+
+static SourceCache::data_type LoadFile(const TSTRING &path, size_t size) {
+  RawFile file(path, RawFile::READ);
+
+  if (!file.IsValid() || file.Size() != size)
+    return nullptr;
+
+  std::string buffer;
+  buffer.resize(size);
+
+  if (!file.ReadAt(0, &buffer[0], size))
+    return nullptr;
+
+  return std::make_shared<const std::string>(std::move(buffer));
+}
+
+SourceCache &SourceCache::Get() {
+  static SourceCache instance;
+  return instance;
+}
+
+void SourceCache::SetLimit(size_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex);
+  limit = bytes;
+  Evict();
+}
+
+SourceCache::data_type SourceCache::Acquire(const TSTRING &path,
+                                            size_t size) {
+  // Cached data are valid only for unchanged file
+  int64_t mtime = 0;
+
+  if (FileStat(path, mtime) != size)
+    return nullptr;
+
+  std::unique_lock<std::mutex> lock(mutex);
+  Entry *entry = &entries[path];
+
+  // Wait for other job, that is reading same file
+  while (true) {
+    data_type data = entry->data.lock();
+
+    if (data && data->size() == size && entry->mtime == mtime) {
+      stats.numShared++;
+      stats.bytesShared += size;
+      Touch(path, *entry, data);
+      return data;
+    }
+
+    if (!entry->loading)
+      break;
+
+    loaded.wait(lock);
+    // Entry might have been evicted while waiting
+    entry = &entries[path];
+  }
+
+  // Loading entry is never evicted
+  entry->loading = true;
+  lock.unlock();
+  data_type data = LoadFile(path, size);
+  lock.lock();
+  entry->loading = false;
+  loaded.notify_all();
+
+  if (!data) {
+    if (!entry->cachedData && entry->data.expired())
+      entries.erase(path);
+
+    return nullptr;
+  }
+
+  entry->data = data;
+  entry->mtime = mtime;
+  stats.numReads++;
+  stats.bytesRead += size;
+  Touch(path, *entry, data);
+  Evict();
+
+  return data;
+}
+
+SourceCache::Stats SourceCache::GetStats() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return stats;
+}
+
+void SourceCache::Touch(const TSTRING &path, Entry &entry,
+                        const data_type &data) {
+  if (entry.cachedData) {
+    cachedSize -= entry.cachedData->size();
+    cached.erase(entry.cachedPos);
+  }
+
+  entry.cachedData = data;
+  cached.push_front(path);
+  entry.cachedPos = cached.begin();
+  cachedSize += data->size();
+}
+
+void SourceCache::Evict() {
+  while (cachedSize > limit && !cached.empty()) {
+    auto found = entries.find(cached.back());
+    Entry &entry = found->second;
+    cachedSize -= entry.cachedData->size();
+    entry.cachedData.reset();
+    cached.pop_back();
+
+    if (entry.data.expired() && !entry.loading)
+      entries.erase(found);
+  }
+}
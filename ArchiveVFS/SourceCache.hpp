@@ -0,0 +1,80 @@
+/*      SourceCache
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "RawFile.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Size of each file, NO_FILE if it cannot be accessed.
+// Files are queried in parallel, helper threads are bounded process wide.
+std::vector<size_t> FileSizes(const std::vector<TSTRING> &paths);
+
+// Process wide cache of source file data, shared by concurrent pack jobs.
+// Each file is read once, while it's cached or in use by any job.
+// Data in use are kept alive by their references, cached data are
+// evicted in least recently used order, once limit is exceeded.
+class SourceCache {
+public:
+  typedef std::shared_ptr<const std::string> data_type;
+
+  struct Stats {
+    size_t numReads;
+    size_t numShared;
+    size_t bytesRead;
+    size_t bytesShared;
+  };
+
+  static SourceCache &Get();
+
+  // 0 disables cache, files larger than quarter of limit are not cached
+  void SetLimit(size_t bytes);
+  bool Accepts(size_t size) const { return size && size <= limit / 4; }
+
+  // Returns null on read error, or when file size differs.
+  // Cached data are reused only while file modification time is same.
+  data_type Acquire(const TSTRING &path, size_t size);
+  Stats GetStats();
+
+private:
+  struct Entry {
+    std::weak_ptr<const std::string> data;
+    // Set while data are cached
+    data_type cachedData;
+    std::list<TSTRING>::iterator cachedPos;
+    int64_t mtime = 0;
+    bool loading = false;
+  };
+
+  std::mutex mutex;
+  std::condition_variable loaded;
+  std::unordered_map<TSTRING, Entry> entries;
+  // Most recently used first
+  std::list<TSTRING> cached;
+  size_t cachedSize = 0;
+  size_t limit = 0;
+  Stats stats{};
+
+  void Touch(const TSTRING &path, Entry &entry, const data_type &data);
+  void Evict();
+};
@@ -0,0 +1,178 @@
+/*      GTOCGenerator
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "GTOCGenerator.hpp"
+#include "GTOC.hpp"
+#include "RawFile.hpp"
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+static constexpr size_t DATA_ALIGNMENT = 0x10;
+
+// Splitmix64, same sequence on every platform and standard library
+class Random {
+public:
+  Random(uint64_t seed) : state(seed) {}
+
+  uint64_t Next() {
+    uint64_t retVal = (state += 0x9E3779B97F4A7C15ULL);
+    retVal = (retVal ^ (retVal >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    retVal = (retVal ^ (retVal >> 27)) * 0x94D049BB133111EBULL;
+    return retVal ^ (retVal >> 31);
+  }
+
+  // Uniform in [0, 1)
+  double Unit() { return (Next() >> 11) * (1.0 / 9007199254740992.0); }
+
+private:
+  uint64_t state;
+};
+
+static const char *const extensions[] = {".ddsc", ".hmddsc", ".modelc",
+                                         ".meshc", ".bin", ".xml"};
+
+int GTOCGenerator::Generate(const TSTRING &folder) const {
+  if (!numArchives || minFileSize < 1 || maxFileSize < minFileSize) {
+    printerror("Invalid generator parameters.");
+    return 1;
+  }
+
+  TSTRING root = folder;
+
+  if (root.back() != '/' && root.back() != '\\')
+    root.push_back('/');
+
+  _tmkdir(root.c_str());
+  _tmkdir((root + _T("archives")).c_str());
+
+  Random rand(seed);
+  const double sizeRange = std::log(static_cast<double>(maxFileSize) /
+                                    static_cast<double>(minFileSize));
+
+  struct FileRecord {
+    std::string name;
+    uint offset;
+    uint size;
+  };
+
+  // Archive hashes must be unique and non zero
+  std::unordered_set<uint> hashes = {0};
+  std::vector<uint> archiveHashes;
+  std::vector<std::vector<FileRecord>> archiveFiles(numArchives);
+  std::string payload;
+
+  for (size_t a = 0; a < numArchives; a++) {
+    uint hash;
+
+    do {
+      hash = static_cast<uint>(rand.Next());
+    } while (!hashes.insert(hash).second);
+
+    archiveHashes.push_back(hash);
+
+    const TSTRING archivePath =
+        root + _T("archives/") +
+        esStringConvert<TCHAR>(std::to_string(a).c_str()) + _T(".arc");
+    RawFile archive(archivePath, RawFile::WRITE);
+
+    if (!archive.IsValid() ||
+        !archive.WriteAt(0, reinterpret_cast<const char *>(&hash), 4)) {
+      printerror("Cannot create: ", << archivePath);
+      return 2;
+    }
+
+    size_t cOffset = 4;
+
+    for (size_t f = 0; f < filesPerArchive; f++) {
+      const size_t fileSize = static_cast<size_t>(
+          minFileSize * std::exp(rand.Unit() * sizeRange));
+      cOffset = (cOffset + DATA_ALIGNMENT - 1) & ~(DATA_ALIGNMENT - 1);
+
+      if (cOffset + fileSize > 0x7FFFFFFF) {
+        printerror("Archive exceeds 2 GB, lower file count or sizes.");
+        return 1;
+      }
+
+      FileRecord cFile;
+      cFile.name = "bench/a" + std::to_string(a) + "/f" + std::to_string(f) +
+                   extensions[rand.Next() % (sizeof(extensions) /
+                                             sizeof(extensions[0]))];
+      cFile.offset = static_cast<uint>(cOffset);
+      cFile.size = static_cast<uint>(fileSize);
+
+      payload.resize((fileSize + 7) & ~size_t(7));
+      uint64_t *payloadData = reinterpret_cast<uint64_t *>(&payload[0]);
+
+      for (size_t p = 0; p < payload.size() / 8; p++)
+        payloadData[p] = rand.Next();
+
+      if (!archive.WriteAt(cOffset, payload.data(), fileSize)) {
+        printerror("Cannot write: ", << archivePath);
+        return 2;
+      }
+
+      archiveFiles[a].push_back(std::move(cFile));
+      cOffset += fileSize;
+    }
+  }
+
+  // Layout: header, archive records with their file entries, name records
+  size_t tableSize = 8;
+
+  for (auto &a : archiveFiles)
+    tableSize += sizeof(GTOCEntry) + a.size() * sizeof(GTOCFileEntry);
+
+  std::string table(tableSize, 0);
+  int *header = reinterpret_cast<int *>(&table[0]);
+  header[0] = GTOC::gtocID;
+  header[1] = static_cast<int>(numArchives);
+  size_t cEntry = 8;
+
+  for (size_t a = 0; a < numArchives; a++) {
+    GTOCEntry entry = {static_cast<uint>(rand.Next()), archiveHashes[a],
+                       static_cast<int>(archiveFiles[a].size())};
+    memcpy(&table[cEntry], &entry, sizeof(entry));
+    cEntry += sizeof(entry);
+
+    for (auto &f : archiveFiles[a]) {
+      const size_t recordOffset = table.size();
+      const GTOCFileEntry fileEntry = {
+          static_cast<int>(recordOffset - cEntry), static_cast<int>(f.offset)};
+      memcpy(&table[cEntry], &fileEntry, sizeof(fileEntry));
+      cEntry += sizeof(fileEntry);
+
+      const uint record[3] = {static_cast<uint>(rand.Next()),
+                              static_cast<uint>(rand.Next()), f.size};
+      table.append(reinterpret_cast<const char *>(record), sizeof(record));
+      table.append(f.name.c_str(), f.name.size() + 1);
+      table.resize((table.size() + 3) & ~size_t(3));
+    }
+  }
+
+  const TSTRING tocPath = root + _T("bench.gtoc");
+  RawFile toc(tocPath, RawFile::WRITE);
+
+  if (!toc.IsValid() || !toc.WriteAt(0, table.data(), table.size())) {
+    printerror("Cannot create: ", << tocPath);
+    return 2;
+  }
+
+  return 0;
+}
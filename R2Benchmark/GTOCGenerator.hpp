@@ -0,0 +1,34 @@
+/*      GTOCGenerator
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "datas/esString.h"
+#include <cstdint>
+
+// Generates gtoc file and matching archives with pseudo random content.
+// Output depends only on parameters, file sizes are log uniformly
+// distributed between minFileSize and maxFileSize.
+struct GTOCGenerator {
+  size_t numArchives = 100;
+  size_t filesPerArchive = 100;
+  size_t minFileSize = 0x100;
+  size_t maxFileSize = 0x100000;
+  uint64_t seed = 1;
+
+  // Writes <folder>/bench.gtoc and <folder>/archives/<index>.arc
+  int Generate(const TSTRING &folder) const;
+};
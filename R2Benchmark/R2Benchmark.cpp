@@ -0,0 +1,173 @@
+/*      R2Benchmark
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ArchiveExtract.hpp"
+#include "GTOCGenerator.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+
+typedef std::chrono::steady_clock Clock;
+
+static constexpr size_t NUM_LOADS = 10;
+static constexpr size_t DEFAULT_LOOKUPS = 10000000;
+
+static const char help[] = "\nR2SmallArchive benchmark.\n\n\
+Usage:\n\
+    R2Benchmark -g <folder> [archives] [files per archive] [min size] \
+[max size] [seed]\n\
+        Generates bench.gtoc and archives into folder.\n\
+    R2Benchmark -b <folder> [lookups]\n\
+        Measures gtoc load time, archive lookup latency and extraction \
+throughput on generated folder.\n";
+
+static double Seconds(Clock::time_point begin) {
+  return std::chrono::duration<double>(Clock::now() - begin).count();
+}
+
+static size_t ToSize(const TCHAR *arg) {
+  const std::string cArg = esString(arg);
+  return static_cast<size_t>(strtoull(cArg.c_str(), nullptr, 0));
+}
+
+static int Benchmark(const TSTRING &folder, size_t numLookups) {
+  TSTRING root = folder;
+
+  if (root.back() != '/' && root.back() != '\\')
+    root.push_back('/');
+
+  const std::string tocPath = esString(root + _T("bench.gtoc"));
+  GTOC::Ptr toc;
+  Clock::time_point begin = Clock::now();
+
+  for (size_t l = 0; l < NUM_LOADS; l++)
+    if (!(toc = LoadGTOC(tocPath)))
+      return 2;
+
+  const double loadTime = Seconds(begin) / NUM_LOADS;
+
+  if (toc->archives.empty()) {
+    printerror("Table has no archives.");
+    return 2;
+  }
+
+  printline("gtoc_archives: ", << toc->archives.size());
+  printline("gtoc_load_ms: ", << loadTime * 1000.0);
+
+  // Existing archives in random order, misses are flipped hashes
+  std::vector<uint> hashes;
+
+  for (auto a : toc->archives)
+    hashes.push_back(a->hash2);
+
+  std::shuffle(hashes.begin(), hashes.end(), std::mt19937(1));
+
+  size_t numFound = 0;
+  begin = Clock::now();
+
+  for (size_t l = 0; l < numLookups; l++)
+    numFound += toc->FindEntry(hashes[l % hashes.size()]) != nullptr;
+
+  const double hitTime = Seconds(begin);
+  begin = Clock::now();
+
+  for (size_t l = 0; l < numLookups; l++)
+    numFound += toc->FindEntry(~hashes[l % hashes.size()]) != nullptr;
+
+  const double missTime = Seconds(begin);
+
+  printline("lookup_hit_ns: ", << hitTime * 1e9 / numLookups);
+  printline("lookup_miss_ns: ", << missTime * 1e9 / numLookups);
+
+  if (numFound < numLookups) {
+    printerror("Lookup failed for existing archive.");
+    return 3;
+  }
+
+  begin = Clock::now();
+  const std::vector<FoundArchive> found =
+      DiscoverArchives(root + _T("archives"), {toc.get()});
+  const double discoveryTime = Seconds(begin);
+
+  printline("discovery_archives: ", << found.size());
+  printline("discovery_ms: ", << discoveryTime * 1000.0);
+
+  std::vector<ArchiveJob> archives;
+  size_t numFiles = 0;
+  size_t numBytes = 0;
+
+  for (auto &a : found) {
+    archives.push_back({a.path, root + _T("out/"), a.toc, a.entry});
+
+    for (int f = 0; f < a.entry->numFiles; f++) {
+      numBytes += a.entry->Files()[f].Entry()->fileSize;
+      numFiles++;
+    }
+  }
+
+  begin = Clock::now();
+  const size_t numExtracted = ExtractArchives(archives, ExtractSettings());
+  const double extractTime = Seconds(begin);
+
+  printline("extract_files: ", << numExtracted);
+  printline("extract_mb_s: ", << (numBytes / 1048576.0) / extractTime);
+
+  if (numExtracted != numFiles) {
+    printerror("Extracted ", << numExtracted << " of " << numFiles
+                             << " files.");
+    return 3;
+  }
+
+  return 0;
+}
+
+int _tmain(int argc, TCHAR *argv[]) {
+  setlocale(LC_ALL, "");
+  printer.AddPrinterFunction(wprintf);
+
+  if (argc < 3 || argv[1][0] != '-') {
+    printer << help >> 1;
+    return 1;
+  }
+
+  if (argv[1][1] == 'g') {
+    GTOCGenerator generator;
+    size_t *params[] = {&generator.numArchives, &generator.filesPerArchive,
+                        &generator.minFileSize, &generator.maxFileSize};
+
+    for (int p = 3; p < argc && p < 7; p++)
+      *params[p - 3] = ToSize(argv[p]);
+
+    if (argc > 7)
+      generator.seed = ToSize(argv[7]);
+
+    if (int status = generator.Generate(argv[2]))
+      return status;
+
+    printline("Generated ", << generator.numArchives << " archives, "
+                            << generator.filesPerArchive
+                            << " files per archive.");
+    return 0;
+  }
+
+  if (argv[1][1] == 'b')
+    return Benchmark(argv[2], argc > 3 ? ToSize(argv[3]) : DEFAULT_LOOKUPS);
+
+  printer << help >> 1;
+  return 1;
+}
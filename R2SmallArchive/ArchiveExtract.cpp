@@ -0,0 +1,201 @@
+/*      ArchiveExtract
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ArchiveExtract.hpp"
+#include "ContentStore.hpp"
+#include "PathFilter.hpp"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <unordered_set>
+
+struct ExtractEntry {
+  size_t archive;
+  size_t offset;
+  size_t size;
+  const char *fileName;
+};
+
+// Names are matched before any archive data are read
+static bool IsSelected(const ExtractSettings &settings,
+                       const char *fileName) {
+  return (!settings.include || settings.include->Empty() ||
+          settings.include->Matches(fileName)) &&
+         !(settings.exclude && settings.exclude->IsExcluded(fileName));
+}
+
+bool WriteEntry(const RawFile &input, size_t offset, size_t size,
+                const TSTRING &path, int64_t archiveTime, ContentStore *store) {
+  // Output file may be hardlinked into store, so it must not be opened
+  if (store) {
+    const bool stored = store->Put(
+        path, size, [&](size_t entryOffset, char *buffer, size_t toRead) {
+          return input.ReadAt(offset + entryOffset, buffer, toRead);
+        });
+
+    if (!stored)
+      printerror("Couldn't store file: ", << path);
+
+    return stored;
+  }
+
+  RawFile fileOut(path, RawFile::WRITE);
+
+  if (!fileOut.IsValid()) {
+    printerror("Couldn't create file: ", << path);
+    return false;
+  }
+
+  if (!CopyRange(input, offset, fileOut, 0, size)) {
+    printerror("Couldn't write file: ", << path);
+    return false;
+  }
+
+  fileOut.Close();
+  SetModifiedTime(path, archiveTime);
+
+  return true;
+}
+
+// Entries of all archives are extracted by single pool of workers.
+// Workers take entries in archive and offset order from shared queue,
+// so reads stay mostly sequential and all workers are busy until the end.
+size_t ExtractArchives(const std::vector<ArchiveJob> &archives,
+                       const ExtractSettings &settings) {
+  std::vector<ExtractEntry> entries;
+  std::unordered_set<std::string> outPaths;
+  const bool filtered = (settings.include && !settings.include->Empty()) ||
+                        (settings.exclude && !settings.exclude->Empty());
+  size_t numFiles = 0;
+  std::vector<int64_t> archiveTimes(archives.size());
+
+  for (size_t a = 0; a < archives.size(); a++) {
+    const ArchiveJob &cArchive = archives[a];
+    const size_t archiveSize = FileStat(cArchive.path, archiveTimes[a]);
+
+    if (archiveSize == NO_FILE) {
+      printerror("Cannot open file: ", << cArchive.path);
+      continue;
+    }
+
+    if (!cArchive.toc->Validate(cArchive.entry)) {
+      printerror("Corrupted file records in global table: ",
+                 << cArchive.path);
+      continue;
+    }
+
+    const std::string outDir = esString(cArchive.outDir);
+
+    for (int f = 0; f < cArchive.entry->numFiles; f++) {
+      const GTOCFileEntry &cFile = cArchive.entry->Files()[f];
+      const GTOCFile *cFileName = cFile.Entry();
+
+      if (cFileName->fileSize < 1 || cFile.fileOffset < 4)
+        continue;
+
+      numFiles++;
+
+      if (filtered && !IsSelected(settings, cFileName->fileName))
+        continue;
+
+      if (static_cast<size_t>(cFile.fileOffset) + cFileName->fileSize >
+          archiveSize) {
+        printerror("File data out of bounds: ", << cFileName->fileName);
+        continue;
+      }
+
+      // Same file may be stored in more archives, first one wins
+      if (!outPaths.insert(outDir + cFileName->fileName).second)
+        continue;
+
+      entries.push_back({a, static_cast<size_t>(cFile.fileOffset),
+                         static_cast<size_t>(cFileName->fileSize),
+                         cFileName->fileName});
+    }
+  }
+
+  if (filtered)
+    printline("Selected ", << entries.size() << " of " << numFiles
+                           << " files.");
+
+  std::sort(entries.begin(), entries.end(),
+            [](const ExtractEntry &e1, const ExtractEntry &e2) {
+              return e1.archive < e2.archive ||
+                     (e1.archive == e2.archive && e1.offset < e2.offset);
+            });
+
+  // Folders are created upfront, workers only create files
+  std::unordered_set<TSTRING> folders;
+
+  for (auto &e : entries) {
+    const TSTRING filePath = archives[e.archive].outDir +
+                             esStringConvert<TCHAR>(e.fileName);
+
+    for (size_t s = 1; s < filePath.length(); s++)
+      if ((filePath[s] == '\\' || filePath[s] == '/') &&
+          folders.insert(filePath.substr(0, s)).second)
+        _tmkdir(filePath.substr(0, s).c_str());
+  }
+
+  std::atomic<size_t> nextEntry{0};
+  std::atomic<size_t> numExtracted{0};
+
+  // Each worker copies single entry at a time, with own file handle
+  auto worker = [&] {
+    RawFile input;
+    size_t inputID = archives.size();
+
+    for (size_t e; (e = nextEntry.fetch_add(1)) < entries.size();) {
+      const ExtractEntry &cFile = entries[e];
+      const ArchiveJob &cArchive = archives[cFile.archive];
+
+      if (cFile.archive != inputID) {
+        inputID = cFile.archive;
+
+        if (!input.Open(cArchive.path, RawFile::READ))
+          printerror("Cannot open file: ", << cArchive.path);
+      }
+
+      if (!input.IsValid())
+        continue;
+
+      const TSTRING cFilePath =
+          cArchive.outDir + esStringConvert<TCHAR>(cFile.fileName);
+
+      if (WriteEntry(input, cFile.offset, cFile.size, cFilePath,
+                     archiveTimes[cFile.archive], settings.store))
+        numExtracted++;
+    }
+  };
+
+  const size_t maxWorkers = settings.numWorkers
+                                ? settings.numWorkers
+                                : std::thread::hardware_concurrency();
+  const size_t numWorkers =
+      std::max(std::min(maxWorkers, entries.size()), size_t(1));
+  std::vector<std::thread> workers;
+
+  for (size_t w = 1; w < numWorkers; w++)
+    workers.emplace_back(worker);
+
+  worker();
+
+  for (auto &w : workers)
+    w.join();
+
+  return numExtracted;
+}
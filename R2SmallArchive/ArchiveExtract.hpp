@@ -0,0 +1,52 @@
+/*      ArchiveExtract
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "GTOC.hpp"
+#include "RawFile.hpp"
+
+class ContentStore;
+class PathFilter;
+
+struct ArchiveJob {
+  TSTRING path;
+  // Output folder with trailing separator
+  TSTRING outDir;
+  const GTOC *toc;
+  const GTOCEntry *entry;
+};
+
+struct ExtractSettings {
+  // Files are stored by content and linked, when set
+  ContentStore *store = nullptr;
+  // Empty or null include filter selects all files
+  const PathFilter *include = nullptr;
+  const PathFilter *exclude = nullptr;
+  // 0 uses all cores
+  size_t numWorkers = 0;
+};
+
+// Writes archive data range into new file.
+// File gets modification time of archive, so pack mode can tell
+// modified files apart.
+bool WriteEntry(const RawFile &input, size_t offset, size_t size,
+                const TSTRING &path, int64_t archiveTime,
+                ContentStore *store = nullptr);
+
+// Extracts files of all archives, returns number of extracted files.
+size_t ExtractArchives(const std::vector<ArchiveJob> &archives,
+                       const ExtractSettings &settings);
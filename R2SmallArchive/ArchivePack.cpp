@@ -0,0 +1,349 @@
+/*      ArchivePack
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ArchivePack.hpp"
+#include "BufferPool.hpp"
+#include "RawFile.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+static constexpr size_t MAX_ALIGNMENT = 0x1000;
+static constexpr size_t COMPARE_CHUNK_SIZE = 0x100000;
+
+// Compares file with archive data range of same size
+static bool SameContent(const RawFile &archive, size_t offset,
+                        const TSTRING &path, size_t size) {
+  RawFile source(path, RawFile::READ);
+
+  if (!source.IsValid())
+    return false;
+
+  const size_t chunkSize = std::min(size, COMPARE_CHUNK_SIZE);
+  BufferPool::Buffer archiveBuffer = BufferPool::Acquire(chunkSize);
+  BufferPool::Buffer sourceBuffer = BufferPool::Acquire(chunkSize);
+
+  // Treated as changed, file is packed again
+  if (!archiveBuffer || !sourceBuffer)
+    return false;
+
+  for (size_t cPos = 0; cPos < size; cPos += chunkSize) {
+    const size_t toCompare = std::min(size - cPos, chunkSize);
+
+    if (!archive.ReadAt(offset + cPos, archiveBuffer.Data(), toCompare) ||
+        !source.ReadAt(cPos, sourceBuffer.Data(), toCompare) ||
+        memcmp(archiveBuffer.Data(), sourceBuffer.Data(), toCompare))
+      return false;
+  }
+
+  return true;
+}
+
+struct PackItem {
+  const GTOCFileEntry *entry;
+  size_t offset;
+  size_t size;
+  // Empty, when payload is copied from original archive
+  TSTRING source;
+  size_t newOffset;
+  // Payload is written by other item
+  bool shared;
+};
+
+struct GTOCPatch {
+  size_t offset;
+  int value;
+};
+
+int PackArchive(const TSTRING &archivePath, const TSTRING &folder,
+                const std::vector<std::string> &tocPaths) {
+  printline("Packing file: ", << archivePath);
+
+  // Tables are loaded for each archive, previous one might have updated them
+  std::vector<GTOC::Ptr> tables;
+  GTOCList tocs;
+
+  for (auto &p : tocPaths) {
+    tables.emplace_back(LoadGTOC(p));
+
+    if (!tables.back())
+      return 1;
+
+    tocs.push_back(tables.back().get());
+  }
+
+  int64_t archiveTime;
+  const size_t archiveSize = FileStat(archivePath, archiveTime);
+  RawFile archive(archivePath, RawFile::READ);
+
+  if (archiveSize == NO_FILE || !archive.IsValid()) {
+    printerror("Cannot open file.");
+    return 1;
+  }
+
+  uint archiveHash;
+
+  if (archiveSize < 4 ||
+      !archive.ReadAt(0, reinterpret_cast<char *>(&archiveHash), 4)) {
+    printerror("Invalid file.");
+    return 1;
+  }
+
+  const GTOC *toc = nullptr;
+  const GTOCEntry *entry = FindArchive(tocs, archiveHash, &toc);
+
+  if (!entry) {
+    printerror("Cannot find file in global table.");
+    return 1;
+  }
+
+  if (!toc->Validate(entry)) {
+    printerror("Corrupted file records in global table.");
+    return 2;
+  }
+
+  TSTRING root = folder;
+
+  if (root.size() && root.back() != '/' && root.back() != '\\')
+    root.push_back('/');
+
+  std::vector<PackItem> items;
+  size_t dataBegin = archiveSize;
+  size_t offsetBits = 0;
+  size_t numChanged = 0;
+
+  for (int f = 0; f < entry->numFiles; f++) {
+    const GTOCFileEntry &cFile = entry->Files()[f];
+    const GTOCFile *cFileName = cFile.Entry();
+
+    if (cFileName->fileSize < 1 || cFile.fileOffset < 4)
+      continue;
+
+    PackItem cItem = {&cFile,
+                      static_cast<size_t>(cFile.fileOffset),
+                      static_cast<size_t>(cFileName->fileSize),
+                      TSTRING(),
+                      0,
+                      false};
+
+    if (cItem.offset + cItem.size > archiveSize) {
+      printerror("File data out of bounds: ", << cFileName->fileName);
+      return 2;
+    }
+
+    const TSTRING sourcePath =
+        root + esStringConvert<TCHAR>(cFileName->fileName);
+    int64_t sourceTime;
+    const size_t sourceSize = FileStat(sourcePath, sourceTime);
+
+    // Extracted files keep modification time of archive, same size files
+    // with other time are compared, time alone is not reliable
+    if (sourceSize != NO_FILE &&
+        (sourceSize != cItem.size ||
+         (sourceTime != archiveTime &&
+          !SameContent(archive, cItem.offset, sourcePath, cItem.size)))) {
+      if (!sourceSize || sourceSize > INT_MAX) {
+        printerror("Invalid file size: ", << sourcePath);
+        return 3;
+      }
+
+      cItem.size = sourceSize;
+      cItem.source = sourcePath;
+      numChanged++;
+    }
+
+    dataBegin = std::min(dataBegin, cItem.offset);
+    offsetBits |= cItem.offset;
+    items.push_back(cItem);
+  }
+
+  if (!numChanged) {
+    printline("No modified files found.");
+    return 0;
+  }
+
+  // Payloads keep their original order and alignment, data before first
+  // payload are kept as they are
+  const size_t alignment =
+      std::min(offsetBits & (~offsetBits + 1), MAX_ALIGNMENT);
+
+  std::stable_sort(items.begin(), items.end(),
+                   [](const PackItem &i1, const PackItem &i2) {
+                     return i1.offset < i2.offset;
+                   });
+
+  // Unchanged payloads may be referenced by more records
+  std::unordered_map<size_t, size_t> copiedItems;
+  size_t cOffset = dataBegin;
+
+  for (size_t i = 0; i < items.size(); i++) {
+    PackItem &cItem = items[i];
+
+    if (cItem.source.empty()) {
+      auto found = copiedItems.find(cItem.offset);
+
+      if (found != copiedItems.end() &&
+          items[found->second].size == cItem.size) {
+        cItem.newOffset = items[found->second].newOffset;
+        cItem.shared = true;
+        continue;
+      }
+
+      copiedItems[cItem.offset] = i;
+    }
+
+    cOffset = (cOffset + alignment - 1) & ~(alignment - 1);
+    cItem.newOffset = cOffset;
+    cOffset += cItem.size;
+  }
+
+  if (cOffset > INT_MAX) {
+    printerror("Archive is too large.");
+    return 3;
+  }
+
+  // Records of resized files must not be shared with other entries,
+  // within this archive or others
+  std::unordered_set<const GTOCFile *> resized;
+
+  for (auto &i : items)
+    if (i.size != static_cast<size_t>(i.entry->Entry()->fileSize))
+      resized.insert(i.entry->Entry());
+
+  if (resized.size()) {
+    std::unordered_set<const GTOCFile *> referenced;
+
+    for (auto a : toc->archives)
+      for (int f = 0; f < a->numFiles; f++) {
+        const GTOCFile *cFile = a->Files()[f].Entry();
+
+        if (resized.count(cFile) && !referenced.insert(cFile).second) {
+          printerror("Size of file is shared with other entries: ",
+                     << cFile->fileName);
+          return 3;
+        }
+      }
+  }
+
+  // Original is replaced, once global table is updated
+  const TSTRING tempPath = archivePath + _T(".new");
+  RawFile archiveOut(tempPath, RawFile::WRITE);
+
+  if (!archiveOut.IsValid()) {
+    printerror("Couldn't create file: ", << tempPath);
+    return 4;
+  }
+
+  bool written = CopyRange(archive, 0, archiveOut, 0, dataBegin);
+
+  for (auto &i : items) {
+    if (!written)
+      break;
+
+    if (i.shared)
+      continue;
+
+    if (i.source.empty()) {
+      written = CopyRange(archive, i.offset, archiveOut, i.newOffset, i.size);
+      continue;
+    }
+
+    RawFile source(i.source, RawFile::READ);
+    written = source.IsValid() &&
+              CopyRange(source, 0, archiveOut, i.newOffset, i.size);
+
+    if (!written)
+      printerror("Couldn't read file: ", << i.source);
+  }
+
+  archiveOut.Close();
+
+  if (!written) {
+    printerror("Couldn't write file: ", << tempPath);
+    RemoveFile(tempPath);
+    return 4;
+  }
+
+  std::vector<GTOCPatch> patches;
+  const char *tocData = toc->file.Data();
+
+  for (auto &i : items) {
+    if (i.newOffset != i.offset)
+      patches.push_back(
+          {static_cast<size_t>(
+               reinterpret_cast<const char *>(&i.entry->fileOffset) -
+               tocData),
+           static_cast<int>(i.newOffset)});
+
+    if (resized.count(i.entry->Entry()))
+      patches.push_back(
+          {static_cast<size_t>(
+               reinterpret_cast<const char *>(&i.entry->Entry()->fileSize) -
+               tocData),
+           static_cast<int>(i.size)});
+  }
+
+  // Patched table is written aside too, both replace originals at the end
+  const TSTRING tocPath = toc->path;
+  const TSTRING tocTempPath = tocPath + _T(".new");
+  RawFile tocOut(tocTempPath, RawFile::WRITE);
+  bool patched = tocOut.IsValid() &&
+                 tocOut.WriteAt(0, toc->file.Data(), toc->file.Size());
+
+  for (auto &p : patches) {
+    if (!patched)
+      break;
+
+    patched = tocOut.WriteAt(
+        p.offset, reinterpret_cast<const char *>(&p.value), sizeof(p.value));
+  }
+
+  tocOut.Close();
+
+  if (!patched) {
+    printerror("Couldn't write file: ", << tocTempPath);
+    RemoveFile(tempPath);
+    RemoveFile(tocTempPath);
+    return 5;
+  }
+
+  // Open files and mappings would block replacing them on Windows
+  archive.Close();
+  tables.clear();
+
+  if (!MoveFileOver(tempPath, archivePath)) {
+    printerror("Couldn't replace archive: ", << archivePath);
+    RemoveFile(tempPath);
+    RemoveFile(tocTempPath);
+    return 5;
+  }
+
+  if (!MoveFileOver(tocTempPath, tocPath)) {
+    printerror("Couldn't replace global table, archive was already replaced. "
+               "New table is: ",
+               << tocTempPath);
+    return 5;
+  }
+
+  printline("Replaced ", << numChanged << " of " << items.size() << " files, "
+                         << patches.size() << " table records updated.");
+
+  return 0;
+}
@@ -0,0 +1,27 @@
+/*      ArchivePack
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "GTOC.hpp"
+
+// Rebuilds archive from its original and files within folder,
+// then updates archive's records in global table.
+// File is taken from folder, when its size or content differs,
+// other payloads are copied from original archive.
+// Tables are loaded from tocPaths, archive and then its table are replaced.
+int PackArchive(const TSTRING &archivePath, const TSTRING &folder,
+                const std::vector<std::string> &tocPaths);
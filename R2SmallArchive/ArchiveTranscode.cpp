@@ -0,0 +1,188 @@
+/*      ArchiveTranscode
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ArchiveTranscode.hpp"
+#include "ArchiveStream.hpp"
+#include "PackLayout.hpp"
+#include "RawFile.hpp"
+#include "datas/binwritter.hpp"
+#include <algorithm>
+#include <unordered_set>
+
+static constexpr size_t COPY_CHUNK_SIZE = 0x100000;
+
+struct TranscodeEntry {
+  size_t offset;
+  size_t size;
+};
+
+static int WriteSARC(BinWritter &out, const RawFile &archive,
+                     const GTOCEntry *entry, bool blockLayout) {
+  SARC3 sarc;
+  std::vector<PackEntry> entries;
+  std::vector<TranscodeEntry> sources;
+  std::unordered_set<std::string> names;
+
+  for (int f = 0; f < entry->numFiles; f++) {
+    const GTOCFileEntry &cFile = entry->Files()[f];
+    const GTOCFile *cFileName = cFile.Entry();
+
+    if (cFileName->fileSize < 1 || cFile.fileOffset < 4 ||
+        !names.insert(cFileName->fileName).second)
+      continue;
+
+    PackEntry cEntry;
+    cEntry.name = cFileName->fileName;
+    cEntry.size = cFileName->fileSize;
+
+    sarc.AddFileEntry(cEntry.name, cEntry.size, false);
+    entries.push_back(cEntry);
+    sources.push_back({static_cast<size_t>(cFile.fileOffset), cEntry.size});
+  }
+
+  PackLayout layout;
+  layout.blockSize = blockLayout ? AAF::MAX_BLOCK_SIZE : 0;
+
+  const size_t dataBegin = out.Tell() + sarc.DataOffset();
+  const size_t dataEnd = layout.Place(entries, dataBegin);
+
+  if (dataEnd > SARC::MAX_OFFSET) {
+    printerror("Archive data would exceed 4 GB, which cannot be addressed "
+               "by archive offsets.");
+    return 1;
+  }
+
+  for (size_t e = 0; e < entries.size(); e++)
+    sarc.SetFileOffset(e, entries[e].offset);
+
+  sarc.presetOffsets = true;
+
+  if (sarc.Write(&out))
+    return 1;
+
+  std::vector<size_t> dataOrder(entries.size());
+
+  for (size_t e = 0; e < entries.size(); e++)
+    dataOrder[e] = e;
+
+  std::sort(dataOrder.begin(), dataOrder.end(), [&](size_t a, size_t b) {
+    return entries[a].offset < entries[b].offset;
+  });
+
+  BufferPool::Buffer buffer = BufferPool::Acquire(COPY_CHUNK_SIZE);
+  const std::string padding(0x1000, 0);
+
+  if (!buffer) {
+    printerror("Cannot allocate copy buffer.");
+    return 2;
+  }
+
+  for (auto e : dataOrder) {
+    for (size_t cPos = out.Tell(); cPos < entries[e].offset;) {
+      const size_t padSize =
+          std::min(padding.size(), entries[e].offset - cPos);
+      out.WriteBuffer(padding.data(), padSize);
+      cPos += padSize;
+    }
+
+    for (size_t cPos = 0; cPos < sources[e].size;) {
+      const size_t toCopy = std::min(sources[e].size - cPos, COPY_CHUNK_SIZE);
+
+      if (!archive.ReadAt(sources[e].offset + cPos, buffer.Data(), toCopy)) {
+        printerror("Cannot read file data: ", << entries[e].name.c_str());
+        return 2;
+      }
+
+      out.WriteBuffer(buffer.Data(), toCopy);
+      cPos += toCopy;
+    }
+  }
+
+  return 0;
+}
+
+int TranscodeArchive(const TSTRING &archivePath, const TSTRING &outPath,
+                     const GTOCList &tocs, SARC::CompressionType cType) {
+  printline("Converting file: ", << archivePath);
+
+  RawFile archive(archivePath, RawFile::READ);
+
+  if (!archive.IsValid()) {
+    printerror("Cannot open file.");
+    return 1;
+  }
+
+  const size_t archiveSize = archive.Size();
+  uint archiveHash;
+
+  if (archiveSize < 4 ||
+      !archive.ReadAt(0, reinterpret_cast<char *>(&archiveHash), 4)) {
+    printerror("Invalid file.");
+    return 1;
+  }
+
+  const GTOC *toc = nullptr;
+  const GTOCEntry *entry = FindArchive(tocs, archiveHash, &toc);
+
+  if (!entry) {
+    printerror("Cannot find file in global table.");
+    return 1;
+  }
+
+  if (!toc->Validate(entry)) {
+    printerror("Corrupted file records in global table.");
+    return 2;
+  }
+
+  for (int f = 0; f < entry->numFiles; f++) {
+    const GTOCFileEntry &cFile = entry->Files()[f];
+    const GTOCFile *cFileName = cFile.Entry();
+
+    if (cFileName->fileSize > 0 && cFile.fileOffset >= 4 &&
+        static_cast<size_t>(cFile.fileOffset) + cFileName->fileSize >
+            archiveSize) {
+      printerror("File data out of bounds: ", << cFileName->fileName);
+      return 2;
+    }
+  }
+
+  BinWritter wrout(outPath);
+
+  if (!wrout.IsValid()) {
+    printerror("Cannot create: ", << outPath);
+    return 3;
+  }
+
+  if (cType == SARC::C_NONE)
+    return WriteSARC(wrout, archive, entry, false) ? 4 : 0;
+
+  std::unique_ptr<CompressStreamBuf> compressBuf;
+
+  if (cType == SARC::C_AAF)
+    compressBuf.reset(new AAFStreamBuf(&wrout, false));
+  else
+    compressBuf.reset(new ZlibStreamBuf(&wrout));
+
+  std::ostream compressStream(compressBuf.get());
+  BinWritter wr(compressStream);
+
+  if (WriteSARC(wr, archive, entry, cType == SARC::C_AAF) ||
+      compressBuf->Finish())
+    return 4;
+
+  return 0;
+}
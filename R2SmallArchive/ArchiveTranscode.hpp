@@ -0,0 +1,26 @@
+/*      ArchiveTranscode
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "GTOC.hpp"
+#include "SARC.hpp"
+
+// Converts archive into SARC V3, optionally compressed (C_AAF or C_ZLIB).
+// Entries are streamed from archive into output through single buffer,
+// each byte is read and written once.
+int TranscodeArchive(const TSTRING &archivePath, const TSTRING &outPath,
+                     const GTOCList &tocs, SARC::CompressionType cType);
@@ -0,0 +1,85 @@
+/*      GTOC
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "GTOC.hpp"
+#include "PathFilter.hpp"
+#include "RawFile.hpp"
+#include <atomic>
+#include <thread>
+#include <unordered_set>
+
+// Header reads are latency bound, more threads than cores help on cold cache
+static constexpr size_t MAX_DISCOVERY_THREADS = 16;
+static constexpr size_t FILES_PER_DISCOVERY_THREAD = 16;
+
+const GTOCEntry *FindArchive(const GTOCList &tocs, uint hash,
+                             const GTOC **toc) {
+  for (auto t : tocs)
+    if (const GTOCEntry *found = t->FindEntry(hash)) {
+      if (toc)
+        *toc = t;
+
+      return found;
+    }
+
+  return nullptr;
+}
+
+std::vector<FoundArchive> DiscoverArchives(const TSTRING &root,
+                                           const GTOCList &tocs) {
+  const std::vector<TSTRING> files = ScanDirectory(root, PathFilter());
+  std::vector<FoundArchive> found(files.size(), FoundArchive{});
+  std::atomic<size_t> nextFile{0};
+
+  auto worker = [&] {
+    for (size_t f; (f = nextFile.fetch_add(1)) < files.size();) {
+      RawFile cFile(files[f], RawFile::READ);
+      uint hash;
+
+      if (cFile.Size() < 4 ||
+          !cFile.ReadAt(0, reinterpret_cast<char *>(&hash), 4))
+        continue;
+
+      found[f].entry = FindArchive(tocs, hash, &found[f].toc);
+      found[f].hash = hash;
+    }
+  };
+
+  const size_t numThreads =
+      std::min(MAX_DISCOVERY_THREADS,
+               files.size() / FILES_PER_DISCOVERY_THREAD + 1);
+  std::vector<std::thread> threads;
+
+  for (size_t t = 1; t < numThreads; t++)
+    threads.emplace_back(worker);
+
+  worker();
+
+  for (auto &t : threads)
+    t.join();
+
+  std::vector<FoundArchive> archives;
+  std::unordered_set<uint> hashes;
+
+  for (size_t f = 0; f < files.size(); f++)
+    if (found[f].entry && hashes.insert(found[f].hash).second) {
+      found[f].path = files[f];
+      archives.push_back(std::move(found[f]));
+    }
+
+  return archives;
+}
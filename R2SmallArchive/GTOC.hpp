@@ -0,0 +1,194 @@
+/*      GTOC
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "MappedFile.hpp"
+#include "datas/MasterPrinter.hpp"
+#include "datas/esString.h"
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+struct GTOCFile {
+  uint hash1, hash2;
+  int fileSize;
+  char fileName[1];
+};
+
+struct GTOCFileEntry {
+  int fileEntryOffset, fileOffset;
+
+  const GTOCFile *Entry() const {
+    return reinterpret_cast<const GTOCFile *>(
+        reinterpret_cast<const char *>(this) + fileEntryOffset);
+  }
+};
+
+struct GTOCEntry {
+  uint hash1, hash2;
+  int numFiles;
+
+  const GTOCFileEntry *Files() const {
+    return reinterpret_cast<const GTOCFileEntry *>(this + 1);
+  }
+
+};
+
+struct GTOC {
+  typedef std::unique_ptr<GTOC> Ptr;
+  static const int gtocID = CompileFourCC("GT0C");
+
+  TSTRING path;
+  MappedFile file;
+  std::vector<const GTOCEntry *> archives;
+  // Open addressing table of archive indices + 1, keyed by hash2
+  std::vector<uint> lookup;
+  int lookupBits = 0;
+
+  int Load(const TSTRING &inPath) {
+    path = inPath;
+
+    if (!file.Open(path)) {
+      printerror("Cannot open gtoc file: ", << path);
+      return 1;
+    }
+
+    const int *header = reinterpret_cast<const int *>(file.Data());
+
+    if (file.Size() < 8 || header[0] != gtocID) {
+      printerror("Invalid file format, expected gtoc.");
+      return 1;
+    }
+
+    const int numArchives = header[1];
+
+    if (numArchives < 0 ||
+        static_cast<size_t>(numArchives) > file.Size() / sizeof(GTOCEntry)) {
+      printerror("Corrupted gtoc file: ", << path);
+      return 2;
+    }
+
+    archives.reserve(numArchives);
+    const char *cPos = file.Data() + 8;
+
+    for (int a = 0; a < numArchives; a++) {
+      const GTOCEntry *cEntry = reinterpret_cast<const GTOCEntry *>(cPos);
+
+      if (!file.Contains(cEntry, sizeof(GTOCEntry)) || cEntry->numFiles < 0 ||
+          !file.Contains(cEntry->Files(),
+                         cEntry->numFiles * sizeof(GTOCFileEntry))) {
+        printerror("Corrupted gtoc file: ", << path);
+        return 2;
+      }
+
+      archives.push_back(cEntry);
+      cPos += sizeof(GTOCEntry) + cEntry->numFiles * sizeof(GTOCFileEntry);
+    }
+
+    BuildLookup();
+
+    return 0;
+  }
+
+  size_t Slot(uint hash) const {
+    return static_cast<uint>(hash * 0x9E3779B1U) >> (32 - lookupBits);
+  }
+
+  void BuildLookup() {
+    lookupBits = 4;
+
+    while ((size_t(1) << lookupBits) < archives.size() * 2)
+      lookupBits++;
+
+    const size_t mask = (size_t(1) << lookupBits) - 1;
+    lookup.assign(mask + 1, 0);
+
+    for (size_t a = 0; a < archives.size(); a++) {
+      const uint hash = archives[a]->hash2;
+      size_t slot = Slot(hash);
+
+      while (lookup[slot] && archives[lookup[slot] - 1]->hash2 != hash)
+        slot = (slot + 1) & mask;
+
+      // First archive with same hash wins
+      if (!lookup[slot])
+        lookup[slot] = static_cast<uint>(a + 1);
+    }
+  }
+
+  const GTOCEntry *FindEntry(uint hash) const {
+    const size_t mask = lookup.size() - 1;
+
+    for (size_t slot = Slot(hash); lookup[slot]; slot = (slot + 1) & mask)
+      if (archives[lookup[slot] - 1]->hash2 == hash)
+        return archives[lookup[slot] - 1];
+
+    return nullptr;
+  }
+
+  // File records are checked only for archives, that are being extracted
+  bool Validate(const GTOCEntry *entry) const {
+    const size_t nameOffset = offsetof(GTOCFile, fileName);
+
+    for (int f = 0; f < entry->numFiles; f++) {
+      const GTOCFileEntry &cFile = entry->Files()[f];
+      const ptrdiff_t recordOffset =
+          reinterpret_cast<const char *>(&cFile) - file.Data() +
+          cFile.fileEntryOffset;
+
+      if (recordOffset < 0 ||
+          static_cast<size_t>(recordOffset) + nameOffset >= file.Size())
+        return false;
+
+      const char *name = file.Data() + recordOffset + nameOffset;
+
+      if (!memchr(name, 0, file.Size() - recordOffset - nameOffset))
+        return false;
+    }
+
+    return true;
+  }
+};
+
+inline GTOC::Ptr LoadGTOC(const std::string &path) {
+  GTOC::Ptr gtoc(new GTOC());
+
+  if (gtoc->Load(esStringConvert<TCHAR>(path.c_str())))
+    return nullptr;
+
+  return gtoc;
+}
+
+typedef std::vector<const GTOC *> GTOCList;
+
+// Searches tables in order, toc is set to table containing archive
+const GTOCEntry *FindArchive(const GTOCList &tocs, uint hash,
+                             const GTOC **toc = nullptr);
+
+struct FoundArchive {
+  TSTRING path;
+  uint hash;
+  const GTOC *toc;
+  const GTOCEntry *entry;
+};
+
+// Finds archives under root by hash in their first 4 bytes.
+// Headers are read in parallel, files unknown to tables are skipped.
+// Archives are returned in scan order, first of same hash wins.
+std::vector<FoundArchive> DiscoverArchives(const TSTRING &root,
+                                           const GTOCList &tocs);
@@ -0,0 +1,297 @@
+/*      PathIndex
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "PathIndex.hpp"
+#include "ContentStore.hpp"
+#include "RawFile.hpp"
+#include <algorithm>
+#include <fstream>
+#include <unordered_map>
+
+static const uint INDEX_ID = CompileFourCC("R2IX");
+static const uint INDEX_VERSION = 1;
+
+// File layout: header, sources, archives, files, strings
+struct IndexHeader {
+  uint id;
+  uint version;
+  uint numSources;
+  uint numArchives;
+  uint numFiles;
+  uint stringsSize;
+};
+
+// GTOC file, index was built from
+struct IndexSource {
+  uint64_t size;
+  int64_t mtime;
+};
+
+// Path relative to game root
+struct IndexArchive {
+  uint pathOffset;
+  uint hash;
+};
+
+// Sorted by name hash
+struct IndexFile {
+  uint64_t nameHash;
+  uint nameOffset;
+  uint archive;
+  uint offset;
+  uint size;
+};
+
+static std::string NormalizePath(const std::string &path) {
+  std::string retVal = path;
+
+  for (auto &c : retVal)
+    if (c == '\\')
+      c = '/';
+    else if (c >= 'A' && c <= 'Z')
+      c += 'a' - 'A';
+
+  return retVal;
+}
+
+static uint64_t PathHash(const std::string &normalizedPath) {
+  Hash64 hash;
+  hash.Update(normalizedPath.data(), normalizedPath.size());
+  return hash.Digest();
+}
+
+static bool SourceStamps(const std::vector<TSTRING> &gtocPaths,
+                         std::vector<IndexSource> &sources) {
+  for (auto &p : gtocPaths) {
+    IndexSource cSource;
+    cSource.size = FileStat(p, cSource.mtime);
+
+    if (cSource.size == NO_FILE)
+      return false;
+
+    sources.push_back(cSource);
+  }
+
+  return true;
+}
+
+int PathIndex::Load(const TSTRING &indexPath,
+                    const std::vector<TSTRING> &gtocPaths,
+                    const TSTRING &gameRoot) {
+  header = nullptr;
+
+  if (!file.Open(indexPath) || file.Size() < sizeof(IndexHeader))
+    return 1;
+
+  const IndexHeader *cHeader =
+      reinterpret_cast<const IndexHeader *>(file.Data());
+
+  if (cHeader->id != INDEX_ID || cHeader->version != INDEX_VERSION ||
+      cHeader->numSources != gtocPaths.size())
+    return 1;
+
+  const size_t expectedSize =
+      sizeof(IndexHeader) + cHeader->numSources * sizeof(IndexSource) +
+      cHeader->numArchives * sizeof(IndexArchive) +
+      cHeader->numFiles * sizeof(IndexFile) + cHeader->stringsSize;
+
+  if (file.Size() != expectedSize)
+    return 1;
+
+  const IndexSource *sources =
+      reinterpret_cast<const IndexSource *>(cHeader + 1);
+  std::vector<IndexSource> currentSources;
+
+  if (!SourceStamps(gtocPaths, currentSources))
+    return 1;
+
+  for (size_t s = 0; s < currentSources.size(); s++)
+    if (sources[s].size != currentSources[s].size ||
+        sources[s].mtime != currentSources[s].mtime)
+      return 1;
+
+  archives = reinterpret_cast<const IndexArchive *>(sources +
+                                                     cHeader->numSources);
+  files = reinterpret_cast<const IndexFile *>(archives + cHeader->numArchives);
+  strings = reinterpret_cast<const char *>(files + cHeader->numFiles);
+
+  // Every string lookup is terminated
+  if (cHeader->stringsSize && strings[cHeader->stringsSize - 1])
+    return 1;
+
+  header = cHeader;
+  root = gameRoot;
+
+  if (root.size() && root.back() != '/' && root.back() != '\\')
+    root.push_back('/');
+
+  return 0;
+}
+
+int PathIndex::Build(const TSTRING &indexPath,
+                     const std::vector<TSTRING> &gtocPaths,
+                     const GTOCList &tocs, const TSTRING &gameRoot) {
+  if (gameRoot.empty()) {
+    printerror("Game_root_path is not set.");
+    return 1;
+  }
+
+  std::vector<IndexSource> sources;
+
+  if (!SourceStamps(gtocPaths, sources)) {
+    printerror("Cannot access gtoc files.");
+    return 1;
+  }
+
+  TSTRING cRoot = gameRoot;
+
+  if (cRoot.back() != '/' && cRoot.back() != '\\')
+    cRoot.push_back('/');
+
+  printline("Searching for archives in: ", << cRoot);
+
+  std::unordered_map<uint, uint> archiveIDs;
+  std::vector<IndexArchive> archives;
+  std::string strings;
+
+  for (auto &a : DiscoverArchives(cRoot, tocs)) {
+    archiveIDs[a.hash] = static_cast<uint>(archives.size());
+    archives.push_back({static_cast<uint>(strings.size()), a.hash});
+    strings.append(esString(a.path.substr(cRoot.size())));
+    strings.push_back(0);
+  }
+
+  std::vector<IndexFile> files;
+
+  for (auto t : tocs)
+    for (auto a : t->archives) {
+      auto found = archiveIDs.find(a->hash2);
+
+      if (found == archiveIDs.end())
+        continue;
+
+      if (!t->Validate(a)) {
+        printwarning("Corrupted file records of archive: ",
+                     << strings.c_str() + archives[found->second].pathOffset);
+        continue;
+      }
+
+      for (int f = 0; f < a->numFiles; f++) {
+        const GTOCFileEntry &cFile = a->Files()[f];
+        const GTOCFile *cFileName = cFile.Entry();
+
+        if (cFileName->fileSize < 1 || cFile.fileOffset < 4)
+          continue;
+
+        const std::string name = NormalizePath(cFileName->fileName);
+        files.push_back({PathHash(name), static_cast<uint>(strings.size()),
+                         found->second, static_cast<uint>(cFile.fileOffset),
+                         static_cast<uint>(cFileName->fileSize)});
+        strings.append(name);
+        strings.push_back(0);
+      }
+    }
+
+  if (strings.size() > 0xFFFFFFFF) {
+    printerror("Path index is too large.");
+    return 2;
+  }
+
+  // First occurrence of a path wins
+  std::stable_sort(files.begin(), files.end(),
+                   [](const IndexFile &f1, const IndexFile &f2) {
+                     return f1.nameHash < f2.nameHash;
+                   });
+
+  auto lastFile = std::unique(
+      files.begin(), files.end(),
+      [&](const IndexFile &f1, const IndexFile &f2) {
+        return f1.nameHash == f2.nameHash &&
+               !strcmp(strings.c_str() + f1.nameOffset,
+                       strings.c_str() + f2.nameOffset);
+      });
+  files.erase(lastFile, files.end());
+
+  const IndexHeader header = {INDEX_ID,
+                              INDEX_VERSION,
+                              static_cast<uint>(sources.size()),
+                              static_cast<uint>(archives.size()),
+                              static_cast<uint>(files.size()),
+                              static_cast<uint>(strings.size())};
+
+  std::ofstream out(indexPath, std::ios::out | std::ios::binary);
+
+  if (out.fail()) {
+    printerror("Cannot create: ", << indexPath);
+    return 2;
+  }
+
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(sources.data()),
+            sources.size() * sizeof(IndexSource));
+  out.write(reinterpret_cast<const char *>(archives.data()),
+            archives.size() * sizeof(IndexArchive));
+  out.write(reinterpret_cast<const char *>(files.data()),
+            files.size() * sizeof(IndexFile));
+  out.write(strings.data(), strings.size());
+
+  if (out.fail()) {
+    printerror("Cannot write: ", << indexPath);
+    return 2;
+  }
+
+  printline("Indexed ", << files.size() << " files in " << archives.size()
+                        << " archives.");
+
+  return 0;
+}
+
+bool PathIndex::Find(const std::string &path, Location &location) const {
+  if (!header)
+    return false;
+
+  const std::string name = NormalizePath(path);
+  const uint64_t hash = PathHash(name);
+  const IndexFile *filesEnd = files + header->numFiles;
+  const IndexFile *found = std::lower_bound(
+      files, filesEnd, hash, [](const IndexFile &f, uint64_t hash) {
+        return f.nameHash < hash;
+      });
+
+  for (; found < filesEnd && found->nameHash == hash; found++) {
+    if (found->nameOffset >= header->stringsSize ||
+        found->archive >= header->numArchives ||
+        name != strings + found->nameOffset)
+      continue;
+
+    const uint pathOffset = archives[found->archive].pathOffset;
+
+    if (pathOffset >= header->stringsSize)
+      return false;
+
+    location.archive = root + static_cast<TSTRING>(esString(
+                                  std::string(strings + pathOffset)));
+    location.offset = found->offset;
+    location.size = found->size;
+
+    return true;
+  }
+
+  return false;
+}
+
+size_t PathIndex::NumFiles() const { return header ? header->numFiles : 0; }
@@ -0,0 +1,61 @@
+/*      PathIndex
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "GTOC.hpp"
+#include "MappedFile.hpp"
+#include <string>
+#include <vector>
+
+struct IndexHeader;
+struct IndexArchive;
+struct IndexFile;
+
+// Persistent index of all files described by global TOCs.
+// Resolves file path into archive, offset and size, so single file can be
+// read without extracting whole archive.
+// Index is memory mapped, lookup is binary search over path hashes.
+class PathIndex {
+public:
+  struct Location {
+    TSTRING archive;
+    size_t offset;
+    size_t size;
+  };
+
+  // Returns 1, when index is missing or was built from other GTOC files.
+  int Load(const TSTRING &indexPath, const std::vector<TSTRING> &gtocPaths,
+           const TSTRING &gameRoot);
+
+  // Archives are found under game root by hash stored in their first 4
+  // bytes, files of archives that are not found are not indexed.
+  static int Build(const TSTRING &indexPath,
+                   const std::vector<TSTRING> &gtocPaths,
+                   const GTOCList &tocs, const TSTRING &gameRoot);
+
+  // Path is case insensitive, '/' or '\\' separated.
+  bool Find(const std::string &path, Location &location) const;
+  size_t NumFiles() const;
+
+private:
+  MappedFile file;
+  TSTRING root;
+  const IndexHeader *header = nullptr;
+  const IndexArchive *archives = nullptr;
+  const IndexFile *files = nullptr;
+  const char *strings = nullptr;
+};
@@ -15,197 +15,179 @@
         along with this program.If not, see <https://www.gnu.org/licenses/>.
 */
 
-#include "datas/MultiThread.hpp"
+#include "ArchiveExtract.hpp"
+#include "ArchivePack.hpp"
+#include "ArchiveTranscode.hpp"
+#include "ContentStore.hpp"
+#include "GTOC.hpp"
+#include "PathFilter.hpp"
+#include "PathIndex.hpp"
+#include "RawFile.hpp"
 #include "datas/SettingsManager.hpp"
 #include "datas/binreader.hpp"
 #include "datas/fileinfo.hpp"
 #include "project.h"
 #include "pugixml.hpp"
+#include <algorithm>
 
 static struct R2SmallArchive : SettingsManager {
   DECLARE_REFLECTOR;
   bool Generate_Log = false;
   std::string sarc0_gtoc_file_path = "Path into sarc.0.gtoc",
               expentities_gtoc_file_path = "Path into expentities.gtoc";
-} settings;
-
-REFLECTOR_START_WNAMES(R2SmallArchive, sarc0_gtoc_file_path,
-                       expentities_gtoc_file_path, Generate_Log);
-
-struct GTOCFile {
-  uint hash1, hash2;
-  int fileSize;
-  char fileName[1];
-};
-
-struct GTOCFileEntry {
-  int fileEntryOffset, fileOffset;
-
-  const GTOCFile *Entry() const {
-    return reinterpret_cast<const GTOCFile *>(
-        reinterpret_cast<const char *>(this) + fileEntryOffset);
-  }
-};
-
-struct GTOCEntry {
-  uint hash1, hash2;
-  int numFiles;
-
-  const GTOCFileEntry *Files() const {
-    return reinterpret_cast<const GTOCFileEntry *>(this + 1);
-  }
-
-  void mkdirs(const TSTRING &inFilepath) const {
-    for (int f = 0; f < numFiles; f++) {
-      const char *cfle = Files()[f].Entry()->fileName;
-      TSTRING filePath = esStringConvert<TCHAR>(cfle);
-
-      for (size_t s = 0; s < filePath.length(); s++)
-        if (filePath[s] == '\\' || filePath[s] == '/') {
-          TSTRING genpath = inFilepath;
-          genpath.append(filePath.substr(0, s));
-          _tmkdir(genpath.c_str());
-        }
-    }
+  std::string Content_store_path;
+  bool Content_store_reflinks = false;
+  std::string Game_root_path;
+  std::string Path_index_file;
+  std::string Extract_extensions;
+  std::string Extract_globs;
+  std::string Ignore_extensions;
+  std::string Ignore_globs;
+
+  ContentStore _store;
+  PathFilter _include;
+  PathFilter _exclude;
+
+  void Process() {
+    _include.AddExtensions(Extract_extensions);
+    _include.AddGlobs(Extract_globs);
+    _exclude.AddExtensions(Ignore_extensions);
+    _exclude.AddGlobs(Ignore_globs);
   }
-};
-
-struct GTOC {
-  typedef std::unique_ptr<GTOC> Ptr;
-  static const int gtocID = CompileFourCC("GT0C");
 
-  char *masterBuffer;
-  std::vector<GTOCEntry *> archives;
+  ExtractSettings Extraction() {
+    ExtractSettings retVal;
+    retVal.store = _store.IsOpen() ? &_store : nullptr;
+    retVal.include = &_include;
+    retVal.exclude = &_exclude;
 
-  GTOC() : masterBuffer(nullptr) {}
-  ~GTOC() {
-    if (masterBuffer)
-      free(masterBuffer);
+    return retVal;
   }
+} settings;
 
-  int Load(BinReader *rd) {
-    int ID;
-    rd->Read(ID);
+REFLECTOR_START_WNAMES(R2SmallArchive, sarc0_gtoc_file_path,
+                       expentities_gtoc_file_path, Generate_Log,
+                       Content_store_path, Content_store_reflinks,
+                       Game_root_path, Path_index_file, Extract_extensions,
+                       Extract_globs, Ignore_extensions, Ignore_globs);
 
-    if (ID != gtocID) {
-      printerror("Invalid file format, expected gtoc.");
-      return 1;
-    }
+static bool FilehandleITFC(const TCHAR *fle, const GTOCList &tocs,
+                           ArchiveJob &job) {
+  printline("Loading file: ", << fle);
 
-    int numArchives;
-    rd->Read(numArchives);
-    archives.resize(numArchives);
-    const size_t fleSize = rd->GetSize() - 8;
-    masterBuffer = static_cast<char *>(malloc(fleSize));
-    rd->ReadBuffer(masterBuffer, fleSize);
-    char *masterCopy = masterBuffer;
-
-    for (auto &a : archives) {
-      a = reinterpret_cast<GTOCEntry *>(masterCopy);
-      masterCopy += sizeof(GTOCEntry) + a->numFiles * sizeof(GTOCFileEntry);
-    }
+  RawFile archive(fle, RawFile::READ);
 
-    return 0;
+  if (!archive.IsValid()) {
+    printerror("Cannot open file.");
+    return false;
   }
 
-  GTOCEntry *FindEntry(uint hash) const {
-    for (auto &a : archives)
-      if (a->hash2 == hash)
-        return a;
+  uint archiveHash;
 
-    return nullptr;
+  if (archive.Size() < 4 ||
+      !archive.ReadAt(0, reinterpret_cast<char *>(&archiveHash), 4)) {
+    printerror("Invalid file.");
+    return false;
   }
-};
 
-GTOC::Ptr LoadGTOC(const std::string &path) {
-  TSTRING filepath = esStringConvert<TCHAR>(path.c_str());
-  BinReader rd(filepath);
+  job.entry = FindArchive(tocs, archiveHash, &job.toc);
 
-  if (!rd.IsValid()) {
-    printerror("Cannot open gtoc file.");
-    return nullptr;
+  if (!job.entry) {
+    printerror("Cannot find file in global table.");
+    return false;
   }
 
-  GTOC *gtoc = new GTOC();
-  if (gtoc->Load(&rd)) {
-    delete gtoc;
-    return nullptr;
-  }
+  job.path = fle;
+  job.outDir = TFileInfo(job.path).GetPath();
 
-  return GTOC::Ptr(gtoc);
+  return true;
 }
 
-void FilehandleITFC(const TCHAR *fle, GTOC::Ptr *globalTOC) {
-  printline("Loading file: ", << fle);
-
-  TSTRING filepath = fle;
-  BinReader rd(fle);
+static void MakeFileDirs(const TSTRING &filePath) {
+  for (size_t s = 1; s < filePath.length(); s++)
+    if (filePath[s] == '\\' || filePath[s] == '/')
+      _tmkdir(filePath.substr(0, s).c_str());
+}
 
-  if (!rd.IsValid()) {
-    printerror("Cannot open file.");
-    return;
+// -i: rebuild index, -q: print locations, -x: extract files into folder
+static int PathMode(int argc, TCHAR *argv[], GTOC::Ptr *mainGTOC,
+                    const TSTRING &defaultIndexPath) {
+  const TCHAR mode = argv[1][1];
+  const TSTRING indexPath =
+      settings.Path_index_file.empty()
+          ? defaultIndexPath
+          : esStringConvert<TCHAR>(settings.Path_index_file.c_str());
+  const std::vector<TSTRING> gtocPaths = {
+      esStringConvert<TCHAR>(settings.sarc0_gtoc_file_path.c_str()),
+      esStringConvert<TCHAR>(settings.expentities_gtoc_file_path.c_str())};
+  const TSTRING gameRoot =
+      esStringConvert<TCHAR>(settings.Game_root_path.c_str());
+  PathIndex index;
+
+  if (mode == 'i' || index.Load(indexPath, gtocPaths, gameRoot)) {
+    printline("Building path index: ", << indexPath);
+
+    if (PathIndex::Build(indexPath, gtocPaths,
+                         {mainGTOC[0].get(), mainGTOC[1].get()}, gameRoot) ||
+        index.Load(indexPath, gtocPaths, gameRoot)) {
+      printerror("Cannot build path index.");
+      return 3;
+    }
   }
 
-  const size_t sarcSize = rd.GetSize();
-  char *dataBuffer = static_cast<char *>(malloc(sarcSize));
-  rd.ReadBuffer(dataBuffer, sarcSize);
-
-  const GTOCEntry *cEntry =
-      (*globalTOC)->FindEntry(*reinterpret_cast<uint *>(dataBuffer));
+  if (mode == 'i')
+    return 0;
 
-  if (!cEntry)
-    cEntry =
-        (*(globalTOC + 1))->FindEntry(*reinterpret_cast<uint *>(dataBuffer));
+  const int firstPath = mode == 'x' ? 3 : 2;
 
-  if (!cEntry) {
-    printerror("Cannot find file in global table.");
-    return;
+  if (argc <= firstPath) {
+    printerror("Expected file paths.");
+    return 1;
   }
 
-  TFileInfo finfo(filepath);
-  cEntry->mkdirs(finfo.GetPath());
-  const int numFiles = cEntry->numFiles;
+  TSTRING outDir = mode == 'x' ? argv[2] : TSTRING();
 
-  for (int f = 0; f < numFiles; f++) {
-    const GTOCFileEntry &cFile = cEntry->Files()[f];
-    const GTOCFile *cFileName = cFile.Entry();
+  if (outDir.size() && outDir.back() != '/' && outDir.back() != '\\')
+    outDir.push_back('/');
 
-    if (cFileName->fileSize < 1 || cFile.fileOffset < 4)
-      continue;
+  int status = 0;
 
-    TSTRING cFilePath =
-        finfo.GetPath() + esStringConvert<TCHAR>(cFileName->fileName);
-    std::ofstream fileOut(cFilePath,
-                          std::ios_base::binary | std::ios_base::out);
+  for (int a = firstPath; a < argc; a++) {
+    PathIndex::Location location;
 
-    if (fileOut.fail()) {
-      printerror("Couldn't create file: ", << cFilePath);
+    if (!index.Find(esString(argv[a]), location)) {
+      printerror("File not found: ", << argv[a]);
+      status = 4;
       continue;
     }
 
-    fileOut.write(dataBuffer + cFile.fileOffset, cFileName->fileSize);
-    fileOut.close();
-  }
+    if (mode == 'q') {
+      printline(argv[a], << ": " << location.archive << " offset: "
+                         << location.offset << " size: " << location.size);
+      continue;
+    }
 
-  free(dataBuffer);
+    RawFile archive(location.archive, RawFile::READ);
+    int64_t archiveTime;
 
-  printer << numFiles << " files extracted." >> 1;
-  return;
-}
+    if (!archive.IsValid() ||
+        FileStat(location.archive, archiveTime) == NO_FILE ||
+        archive.Size() < location.offset + location.size) {
+      printerror("Cannot read archive: ", << location.archive);
+      status = 5;
+      continue;
+    }
 
-struct SarcQueueTraits {
-  int queue;
-  int queueEnd;
-  TCHAR **files;
-  GTOC::Ptr *mainGTOC;
-  typedef void return_type;
+    const TSTRING outPath = outDir + argv[a];
+    MakeFileDirs(outPath);
 
-  return_type RetreiveItem() { FilehandleITFC(files[queue], mainGTOC); }
+    if (!WriteEntry(archive, location.offset, location.size, outPath,
+                    archiveTime, settings.Extraction().store))
+      status = 5;
+  }
 
-  operator bool() { return queue < queueEnd; }
-  void operator++(int) { queue++; }
-  int NumQueues() const { return queueEnd - 1; }
-};
+  return status;
+}
 
 int _tmain(int argc, _TCHAR *argv[]) {
   setlocale(LC_ALL, "");
@@ -222,6 +204,7 @@ int _tmain(int argc, _TCHAR *argv[]) {
       configInfo.GetPath() + configInfo.GetFileName() + _T(".config");
 
   settings.FromXML(configName);
+  settings.Process();
 
   pugi::xml_document doc = {};
   settings.ToXML(doc);
@@ -236,6 +219,14 @@ int _tmain(int argc, _TCHAR *argv[]) {
   if (settings.Generate_Log)
     settings.CreateLog(configInfo.GetPath() + configInfo.GetFileName());
 
+  if (settings.Content_store_path.size() &&
+      !settings._store.Open(
+          esStringConvert<TCHAR>(settings.Content_store_path.c_str()),
+          settings.Content_store_reflinks)) {
+    printwarning("Cannot open content store: ",
+                 << settings.Content_store_path.c_str());
+  }
+
   GTOC::Ptr mainGTOC[2] = {LoadGTOC(settings.sarc0_gtoc_file_path),
                            LoadGTOC(settings.expentities_gtoc_file_path)};
 
@@ -243,14 +234,113 @@ int _tmain(int argc, _TCHAR *argv[]) {
     if (!t)
       return 2;
 
-  SarcQueueTraits sarQue;
-  sarQue.files = argv;
-  sarQue.queue = 1;
-  sarQue.queueEnd = argc;
-  sarQue.mainGTOC = mainGTOC;
+  if (argv[1][0] == '-' &&
+      (argv[1][1] == 'i' || argv[1][1] == 'q' || argv[1][1] == 'x'))
+    return PathMode(argc, argv, mainGTOC,
+                    configInfo.GetPath() + configInfo.GetFileName() +
+                        _T(".index"));
+
+  const GTOCList tocs = {mainGTOC[0].get(), mainGTOC[1].get()};
+
+  if (argv[1][0] == '-' && argv[1][1] == 'p') {
+    if (argc < 4) {
+      printerror("Expected source folder and archives.");
+      return 1;
+    }
+
+    // Each pack loads and replaces tables, they must not stay mapped here
+    const std::vector<std::string> tocPaths = {
+        settings.sarc0_gtoc_file_path, settings.expentities_gtoc_file_path};
+    int status = 0;
+
+    for (auto &t : mainGTOC)
+      t.reset();
+
+    for (int a = 3; a < argc; a++)
+      if (int result = PackArchive(argv[a], argv[2], tocPaths))
+        status = result;
+
+    return status;
+  }
+
+  // -t, -tf (AAF), -tc (zlib)
+  if (argv[1][0] == '-' && argv[1][1] == 't') {
+    if (argc < 4) {
+      printerror("Expected output folder and archives.");
+      return 1;
+    }
+
+    const SARC::CompressionType cType =
+        argv[1][2] == 'f' ? SARC::C_AAF
+                          : (argv[1][2] == 'c' ? SARC::C_ZLIB : SARC::C_NONE);
+    TSTRING outDir = argv[2];
+
+    if (outDir.back() != '/' && outDir.back() != '\\')
+      outDir.push_back('/');
+
+    int status = 0;
+
+    for (int a = 3; a < argc; a++) {
+      TFileInfo archiveInfo(argv[a]);
+      // Compressed archives use .eez, .blz, ... extensions
+      TSTRING outPath = outDir + archiveInfo.GetFileName() +
+                        archiveInfo.GetExtension();
+
+      if (cType != SARC::C_NONE)
+        outPath.push_back('z');
+
+      if (int result = TranscodeArchive(argv[a], outPath, tocs, cType))
+        status = result;
+      else
+        printline("Created: ", << outPath);
+    }
+
+    return status;
+  }
+
+  std::vector<ArchiveJob> archives;
+
+  if (argv[1][0] == '-' && argv[1][1] == 'g') {
+    if (argc < 4) {
+      printerror("Expected game folder and output folder.");
+      return 1;
+    }
+
+    TSTRING outDir = argv[3];
+
+    if (outDir.back() != '/' && outDir.back() != '\\')
+      outDir.push_back('/');
+
+    printline("Searching for archives in: ", << argv[2]);
+
+    for (auto &a : DiscoverArchives(argv[2], tocs))
+      archives.push_back({a.path, outDir, a.toc, a.entry});
+
+    printline("Found ", << archives.size() << " archives.");
+  } else {
+    for (int a = 1; a < argc; a++) {
+      ArchiveJob cJob;
+
+      if (FilehandleITFC(argv[a], tocs, cJob))
+        archives.push_back(cJob);
+    }
+  }
 
   printer.PrintThreadID(true);
-  RunThreadedQueue(sarQue);
+  const size_t numExtracted =
+      ExtractArchives(archives, settings.Extraction());
+  printer.PrintThreadID(false);
+
+  printer << numExtracted << " files extracted." >> 1;
+
+  if (settings._store.IsOpen()) {
+    const ContentStore::Stats storeStats = settings._store.GetStats();
+    printline("Content store: ",
+              << storeStats.numStored << " files stored ("
+              << (storeStats.bytesStored >> 20) << " MB), "
+              << storeStats.numReused << " reused ("
+              << (storeStats.bytesReused >> 20) << " MB)");
+  }
 
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,647 @@
+/*      ArchiveMerge
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ArchiveMerge.hpp"
+#include "ArchiveImage.hpp"
+#include "ArchiveVFS.hpp"
+#include "RawFile.hpp"
+#include "datas/fileinfo.hpp"
+#include <algorithm>
+#include <unordered_map>
+
+static constexpr size_t COPY_CHUNK_SIZE = 0x100000;
+static constexpr size_t ENTRY_ALIGNMENT = 0x10;
+static constexpr size_t BLOCK_SIZE = AAF::MAX_BLOCK_SIZE;
+
+static size_t AlignUp(size_t offset, size_t alignment) {
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+namespace {
+struct Selected {
+  ArchiveImage *input;
+  size_t id;
+};
+
+struct Segment {
+  ArchiveImage *input;
+  // Range within input image, block span for AAF copies
+  size_t begin;
+  size_t end;
+  size_t outOffset;
+  bool blockCopy;
+};
+
+// Writes AAF, that is composed from new blocks and copied compressed blocks.
+class AAFBlockWriter {
+public:
+  AAFBlockWriter(RawFile &output, bool bigEndian)
+      : out(output), bigEndian(bigEndian),
+        block(BufferPool::Acquire(BLOCK_SIZE)) {}
+
+  bool IsValid() const { return static_cast<bool>(block); }
+  size_t Tell() const { return flushedSize + fill; }
+  // No pending data, next block can be copied
+  bool AtBlockBoundary() const { return !fill; }
+
+  bool Append(const char *data, size_t size) {
+    while (size) {
+      const size_t toCopy = std::min(size, BLOCK_SIZE - fill);
+      memcpy(block.Data() + fill, data, toCopy);
+      fill += toCopy;
+      data += toCopy;
+      size -= toCopy;
+
+      if (fill == BLOCK_SIZE && !FlushBlock())
+        return false;
+    }
+
+    return true;
+  }
+
+  bool PadTo(size_t offset) {
+    while (Tell() < offset) {
+      const size_t toFill = std::min(offset - Tell(), BLOCK_SIZE - fill);
+      memset(block.Data() + fill, 0, toFill);
+      fill += toFill;
+
+      if (fill == BLOCK_SIZE && !FlushBlock())
+        return false;
+    }
+
+    return true;
+  }
+
+  // Copies compressed block as is, writer must be at block boundary.
+  bool CopyBlock(const ArchiveImage &input, const AAFReadBuf::Block &cBlock) {
+    EWAM ew;
+    ew.header.uncompressedSize = cBlock.uncompressedSize;
+    ew.SetCompressedSize(cBlock.compressedSize);
+
+    if (!WriteHeader(ew) ||
+        !CopyRange(input.file, cBlock.fileOffset, out,
+                   cursor + sizeof(EWAM::Header), cBlock.compressedSize))
+      return false;
+
+    return EndBlock(ew);
+  }
+
+  bool Finish() {
+    if ((fill || !numBlocks) && !FlushBlock())
+      return false;
+
+    if (flushedSize > SARC::MAX_OFFSET) {
+      printerror("[AAF] Archives over 4 GB are not supported.");
+      return false;
+    }
+
+    AAF::Header header;
+    header.uncompressedSize = static_cast<uint>(flushedSize);
+    header.blockCount = numBlocks;
+    header.blockSize = numBlocks > 1 ? BLOCK_SIZE : header.uncompressedSize;
+
+    if (bigEndian)
+      AAF::SwapHeader<true>(header);
+
+    return out.WriteAt(0, reinterpret_cast<const char *>(&header),
+                       sizeof(header));
+  }
+
+private:
+  RawFile &out;
+  bool bigEndian;
+  BufferPool::Buffer block;
+  size_t fill = 0;
+  size_t flushedSize = 0;
+  size_t cursor = sizeof(AAF::Header);
+  uint numBlocks = 0;
+
+  bool WriteHeader(const EWAM &ew) {
+    EWAM::Header header = ew.header;
+
+    if (bigEndian)
+      EWAM::SwapHeader<true>(header);
+
+    return out.WriteAt(cursor, reinterpret_cast<const char *>(&header),
+                       sizeof(header));
+  }
+
+  bool EndBlock(const EWAM &ew) {
+    static const char padding[0x10] = {};
+    const size_t dataEnd =
+        cursor + sizeof(EWAM::Header) + ew.header.compressedSize;
+    cursor += ew.header.nextBlock;
+    flushedSize += ew.header.uncompressedSize;
+    numBlocks++;
+
+    return out.WriteAt(dataEnd, padding, cursor - dataEnd);
+  }
+
+  bool FlushBlock() {
+    EWAM ew;
+    BufferPool::Buffer compressed;
+    size_t compressedSize;
+    ew.header.uncompressedSize = static_cast<int>(fill);
+
+    if (EWAM::Deflate(block.Data(), fill, compressed, compressedSize) !=
+        Z_STREAM_END) {
+      printerror("[ZLIB] Expected Z_STREAM_END.");
+      return false;
+    }
+
+    ew.SetCompressedSize(compressedSize);
+    fill = 0;
+
+    if (!WriteHeader(ew) ||
+        !out.WriteAt(cursor + sizeof(EWAM::Header), compressed.Data(),
+                     compressedSize))
+      return false;
+
+    return EndBlock(ew);
+  }
+};
+
+struct Format {
+  int version;
+  SARC::CompressionType compression;
+  bool bigEndian;
+};
+} // namespace
+
+static bool CopyEntry(ArchiveImage &input, size_t offset, size_t size,
+                      RawFile &out, size_t outOffset) {
+  if (input.compression == SARC::C_NONE)
+    return CopyRange(input.file, offset, out, outOffset, size);
+
+  BufferPool::Buffer buffer =
+      BufferPool::Acquire(std::min(size, COPY_CHUNK_SIZE));
+
+  if (!buffer)
+    return false;
+
+  for (size_t cPos = 0; cPos < size;) {
+    const size_t toCopy = std::min(size - cPos, COPY_CHUNK_SIZE);
+
+    if (!input.ReadImage(offset + cPos, buffer.Data(), toCopy) ||
+        !out.WriteAt(outOffset + cPos, buffer.Data(), toCopy))
+      return false;
+
+    cPos += toCopy;
+  }
+
+  return true;
+}
+
+template <class F>
+static bool StreamEntry(ArchiveImage &input, size_t offset, size_t size,
+                        F &&sink) {
+  BufferPool::Buffer buffer =
+      BufferPool::Acquire(std::min(size, COPY_CHUNK_SIZE));
+
+  if (!buffer)
+    return false;
+
+  for (size_t cPos = 0; cPos < size;) {
+    const size_t toCopy = std::min(size - cPos, COPY_CHUNK_SIZE);
+
+    if (!input.ReadImage(offset + cPos, buffer.Data(), toCopy) ||
+        !sink(buffer.Data(), toCopy))
+      return false;
+
+    cPos += toCopy;
+  }
+
+  return true;
+}
+
+// Splits selected AAF entries of one input into runs of touched blocks.
+static void BlockSegments(ArchiveImage &input,
+                          const std::vector<Selected> &entries,
+                          std::vector<Segment> &segments) {
+  auto &blocks = input.aafBuf.Blocks();
+  std::vector<bool> touched(blocks.size());
+
+  for (auto &e : entries) {
+    const size_t offset = input.sarc->FileOffset(e.id);
+    const size_t size = input.sarc->FileSize(e.id);
+
+    if (!offset)
+      continue;
+
+    const size_t lastBlock = input.BlockID(offset + (size ? size - 1 : 0));
+
+    for (size_t b = input.BlockID(offset); b <= lastBlock; b++)
+      touched[b] = true;
+  }
+
+  for (size_t b = 0; b < blocks.size(); b++) {
+    if (!touched[b])
+      continue;
+
+    const size_t firstBlock = b;
+
+    while (b + 1 < blocks.size() && touched[b + 1])
+      b++;
+
+    Segment cSegment;
+    cSegment.input = &input;
+    cSegment.begin = blocks[firstBlock].offset;
+    cSegment.end = blocks[b].offset + blocks[b].uncompressedSize;
+    cSegment.outOffset = 0;
+    cSegment.blockCopy = true;
+    segments.push_back(cSegment);
+  }
+}
+
+// Entries with data, grouped by input and sorted by input offset,
+// so every input is read front to back.
+static std::vector<size_t> ReadOrder(const std::vector<Selected> &entries) {
+  std::unordered_map<const ArchiveImage *, size_t> inputRanks;
+  std::vector<size_t> order;
+
+  for (size_t e = 0; e < entries.size(); e++) {
+    inputRanks.emplace(entries[e].input, inputRanks.size());
+
+    if (entries[e].input->sarc->FileOffset(entries[e].id))
+      order.push_back(e);
+  }
+
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    const Selected &sa = entries[a];
+    const Selected &sb = entries[b];
+
+    if (sa.input != sb.input)
+      return inputRanks[sa.input] < inputRanks[sb.input];
+
+    return sa.input->sarc->FileOffset(sa.id) <
+           sb.input->sarc->FileOffset(sb.id);
+  });
+
+  return order;
+}
+
+static int WriteArchive(const TSTRING &path, const Format &format,
+                        const std::vector<Selected> &entries) {
+  SARC::Ptr sarc(format.version == 2 ? static_cast<SARC *>(new SARC2())
+                                     : static_cast<SARC *>(new SARC3()));
+  sarc->bigEndian = format.bigEndian;
+
+  for (auto &e : entries)
+    sarc->AddFileEntry(e.input->sarc->FileName(e.id),
+                       e.input->sarc->FileSize(e.id),
+                       !e.input->sarc->FileOffset(e.id));
+
+  const size_t dataBegin = sarc->DataOffset();
+  const std::vector<size_t> order = ReadOrder(entries);
+  std::vector<Segment> segments;
+  std::vector<size_t> entrySegments(entries.size(), -1);
+  size_t dataEnd = dataBegin;
+
+  if (format.compression == SARC::C_AAF) {
+    // Entries from AAF inputs keep their position within blocks,
+    // so whole blocks can be copied. Other inputs are packed.
+    for (size_t e : order) {
+      ArchiveImage *cInput = entries[e].input;
+      const size_t offset = cInput->sarc->FileOffset(entries[e].id);
+      auto found = std::find_if(
+          segments.begin(), segments.end(), [&](const Segment &s) {
+            return s.input == cInput && offset >= s.begin && offset < s.end;
+          });
+
+      if (found == segments.end() && cInput->compression == SARC::C_AAF) {
+        std::vector<Selected> inputEntries;
+
+        for (auto &s : entries)
+          if (s.input == cInput)
+            inputEntries.push_back(s);
+
+        BlockSegments(*cInput, inputEntries, segments);
+        found = std::find_if(
+            segments.begin(), segments.end(), [&](const Segment &s) {
+              return s.input == cInput && offset >= s.begin && offset < s.end;
+            });
+      }
+
+      if (found == segments.end()) {
+        Segment cSegment;
+        cSegment.input = cInput;
+        cSegment.begin = offset;
+        cSegment.end = offset + cInput->sarc->FileSize(entries[e].id);
+        cSegment.blockCopy = false;
+        segments.push_back(cSegment);
+        found = std::prev(segments.end());
+      }
+
+      entrySegments[e] = std::distance(segments.begin(), found);
+    }
+
+    for (auto &s : segments) {
+      dataEnd = AlignUp(dataEnd, s.blockCopy ? BLOCK_SIZE : ENTRY_ALIGNMENT);
+      s.outOffset = dataEnd;
+      dataEnd += s.end - s.begin;
+    }
+
+    for (size_t e = 0; e < entries.size(); e++) {
+      if (entrySegments[e] == static_cast<size_t>(-1))
+        continue;
+
+      const Segment &cSegment = segments[entrySegments[e]];
+      const size_t offset = entries[e].input->sarc->FileOffset(entries[e].id);
+      sarc->SetFileOffset(e, cSegment.outOffset + offset - cSegment.begin);
+    }
+  } else {
+    // Output follows read order, zlib output is written sequentially
+    for (size_t e : order) {
+      dataEnd = AlignUp(dataEnd, ENTRY_ALIGNMENT);
+      sarc->SetFileOffset(e, dataEnd);
+      dataEnd += entries[e].input->sarc->FileSize(entries[e].id);
+    }
+  }
+
+  if (dataEnd > SARC::MAX_OFFSET) {
+    printerror("Archive data would exceed 4 GB, which cannot be addressed "
+               "by archive offsets. Split archive first.");
+    return 1;
+  }
+
+  sarc->presetOffsets = true;
+
+  std::stringstream tocStream;
+  BinWritter tocWriter(tocStream);
+
+  if (sarc->Write(&tocWriter))
+    return 1;
+  const std::string toc = tocStream.str();
+
+  if (format.compression == SARC::C_ZLIB) {
+    BinWritter wr(path);
+
+    if (!wr.IsValid()) {
+      printerror("Cannot create: ", << path);
+      return 1;
+    }
+
+    ZlibStreamBuf zlibBuf(&wr);
+    std::ostream zlibStream(&zlibBuf);
+    zlibStream.write(toc.data(), toc.size());
+    size_t cPos = toc.size();
+    const std::string padding(ENTRY_ALIGNMENT, 0);
+
+    for (size_t e : order) {
+      const size_t outOffset = sarc->FileOffset(e);
+      zlibStream.write(padding.data(), outOffset - cPos);
+      const size_t size = sarc->FileSize(e);
+
+      if (!StreamEntry(*entries[e].input,
+                       entries[e].input->sarc->FileOffset(entries[e].id), size,
+                       [&](const char *data, size_t dataSize) {
+                         return !zlibStream.write(data, dataSize).fail();
+                       }))
+        return 2;
+
+      cPos = outOffset + size;
+    }
+
+    return zlibBuf.Finish() ? 2 : 0;
+  }
+
+  RawFile out(path, RawFile::WRITE);
+
+  if (!out.IsValid()) {
+    printerror("Cannot create: ", << path);
+    return 1;
+  }
+
+  if (format.compression == SARC::C_NONE) {
+    if (!out.WriteAt(0, toc.data(), toc.size()))
+      return 2;
+
+    for (size_t e : order)
+      if (!CopyEntry(*entries[e].input,
+                     entries[e].input->sarc->FileOffset(entries[e].id),
+                     sarc->FileSize(e), out, sarc->FileOffset(e)))
+        return 2;
+
+    return 0;
+  }
+
+  AAFBlockWriter wr(out, format.bigEndian);
+
+  if (!wr.IsValid() || !wr.Append(toc.data(), toc.size()))
+    return 2;
+
+  size_t numCopied = 0;
+  size_t numCompressed = 0;
+
+  for (auto &s : segments) {
+    if (!wr.PadTo(s.outOffset))
+      return 2;
+
+    auto sink = [&](const char *data, size_t dataSize) {
+      return wr.Append(data, dataSize);
+    };
+
+    if (!s.blockCopy) {
+      if (!StreamEntry(*s.input, s.begin, s.end - s.begin, sink))
+        return 2;
+
+      continue;
+    }
+
+    auto &blocks = s.input->aafBuf.Blocks();
+
+    for (size_t b = s.input->BlockID(s.begin);
+         b < blocks.size() && blocks[b].offset < s.end; b++) {
+      // Only full blocks can be copied, partial block would shift data.
+      // Once partial block is recompressed, following blocks are too,
+      // until writer gets back to block boundary.
+      if (blocks[b].uncompressedSize == BLOCK_SIZE && wr.AtBlockBoundary()) {
+        if (!wr.CopyBlock(*s.input, blocks[b]))
+          return 2;
+
+        numCopied++;
+      } else {
+        if (!StreamEntry(*s.input, blocks[b].offset,
+                         blocks[b].uncompressedSize, sink))
+          return 2;
+
+        numCompressed++;
+      }
+    }
+  }
+
+  if (!wr.Finish())
+    return 2;
+
+  printline("AAF blocks copied: ", << numCopied << ", recompressed: "
+                                   << numCompressed);
+
+  return 0;
+}
+
+static TSTRING GetArchiveName(const TSTRING &path) {
+  const size_t lastSlash = path.find_last_of(_T("/\\"));
+  TSTRING retVal =
+      path.substr(lastSlash == path.npos ? 0 : lastSlash + 1);
+
+  for (auto &c : retVal)
+    c = tolower(c);
+
+  return retVal;
+}
+
+int MergeArchives(const TSTRING &output, const std::vector<TSTRING> &inputs,
+                  const std::vector<std::string> &priority) {
+  std::vector<std::unique_ptr<ArchiveImage>> archives;
+  std::vector<size_t> ranks;
+
+  for (size_t i = 0; i < inputs.size(); i++) {
+    archives.emplace_back(new ArchiveImage);
+
+    if (archives.back()->Load(inputs[i]))
+      return 1;
+
+    const TSTRING archiveName = GetArchiveName(inputs[i]);
+    size_t rank = priority.size() + inputs.size() - i;
+
+    for (size_t p = 0; p < priority.size(); p++) {
+      if (GetArchiveName(esString(priority[p])) == archiveName) {
+        rank = p;
+        break;
+      }
+    }
+
+    ranks.push_back(rank);
+  }
+
+  std::unordered_map<std::string, size_t> entryLookup;
+  std::vector<Selected> entries;
+  std::vector<size_t> entryRanks;
+  size_t numConflicts = 0;
+
+  for (size_t i = 0; i < archives.size(); i++) {
+    const SARC &cSarc = *archives[i]->sarc;
+
+    for (size_t f = 0; f < cSarc.NumFiles(); f++) {
+      const std::string path = ArchiveVFS::NormalizePath(cSarc.FileName(f));
+      auto found = entryLookup.find(path);
+      Selected cEntry = {archives[i].get(), f};
+
+      if (found == entryLookup.end()) {
+        entryLookup.emplace(path, entries.size());
+        entries.push_back(cEntry);
+        entryRanks.push_back(ranks[i]);
+        continue;
+      }
+
+      numConflicts++;
+
+      if (ranks[i] < entryRanks[found->second]) {
+        entries[found->second] = cEntry;
+        entryRanks[found->second] = ranks[i];
+      }
+    }
+  }
+
+  printline("Merging ", << entries.size() << " files, " << numConflicts
+                        << " conflicts resolved.");
+
+  const ArchiveImage &first = *archives.front();
+  const Format format = {first.sarc->GetVersion(), first.compression,
+                         first.sarc->bigEndian};
+
+  return WriteArchive(output, format, entries);
+}
+
+int SplitArchive(const TSTRING &input, size_t maxSize) {
+  ArchiveImage archive;
+
+  if (archive.Load(input))
+    return 1;
+
+  const SARC &cSarc = *archive.sarc;
+  std::vector<Selected> external;
+  std::vector<Selected> stored;
+
+  for (size_t f = 0; f < cSarc.NumFiles(); f++)
+    (cSarc.FileOffset(f) ? stored : external).push_back({&archive, f});
+
+  std::sort(stored.begin(), stored.end(),
+            [&](const Selected &a, const Selected &b) {
+              return cSarc.FileOffset(a.id) < cSarc.FileOffset(b.id);
+            });
+
+  // AAF parts are measured by touched blocks, since those are copied
+  auto spanBegin = [&](const Selected &e) {
+    const size_t offset = cSarc.FileOffset(e.id);
+    return archive.compression == SARC::C_AAF
+               ? archive.aafBuf.Blocks()[archive.BlockID(offset)].offset
+               : offset;
+  };
+
+  auto spanEnd = [&](const Selected &e) {
+    const size_t end = cSarc.FileOffset(e.id) + cSarc.FileSize(e.id);
+
+    if (archive.compression != SARC::C_AAF)
+      return end;
+
+    auto &cBlock = archive.aafBuf.Blocks()[archive.BlockID(end ? end - 1 : 0)];
+    return cBlock.offset + cBlock.uncompressedSize;
+  };
+
+  std::vector<std::vector<Selected>> parts(1, external);
+  bool partHasData = false;
+  size_t partBegin = 0;
+  size_t partSize = 0;
+
+  for (auto &e : stored) {
+    const size_t size = cSarc.FileSize(e.id);
+    const bool overflow = archive.compression == SARC::C_AAF
+                              ? spanEnd(e) - partBegin > maxSize
+                              : partSize + size > maxSize;
+
+    if (partHasData && overflow) {
+      parts.emplace_back();
+      partHasData = false;
+    }
+
+    if (!partHasData) {
+      partBegin = spanBegin(e);
+      partSize = 0;
+      partHasData = true;
+    }
+
+    parts.back().push_back(e);
+    partSize += size;
+  }
+
+  TFileInfo fInfo(input);
+  const Format format = {cSarc.GetVersion(), archive.compression,
+                         cSarc.bigEndian};
+
+  for (size_t p = 0; p < parts.size(); p++) {
+    const TSTRING partPath = fInfo.GetPath() + fInfo.GetFileName() + _T("_") +
+                             ToTSTRING(static_cast<int>(p)) +
+                             fInfo.GetExtension();
+    printline("Creating archive: ", << partPath);
+
+    if (int rVal = WriteArchive(partPath, format, parts[p]))
+      return rVal;
+  }
+
+  return 0;
+}
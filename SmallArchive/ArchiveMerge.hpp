@@ -0,0 +1,34 @@
+/*      ArchiveMerge
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "datas/esString.h"
+#include <string>
+#include <vector>
+
+// Merges archives into one, output has format of first input.
+// Entries with same path are taken from archive, that is listed first in
+// priority (archive file names), unlisted archives override earlier inputs.
+// Uncompressed data are copied directly, AAF blocks are copied without
+// recompression, when they don't have to be moved within a block.
+int MergeArchives(const TSTRING &output, const std::vector<TSTRING> &inputs,
+                  const std::vector<std::string> &priority);
+
+// Splits archive into <name>_<N><ext> archives of same format,
+// each holding at most maxSize bytes of file data (unless single file is
+// larger).
+int SplitArchive(const TSTRING &input, size_t maxSize);
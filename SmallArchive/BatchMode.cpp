@@ -0,0 +1,584 @@
+/*      BatchMode
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "BatchMode.hpp"
+#include "datas/MasterPrinter.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+
+static void SkipSpace(const std::string &input, size_t &pos) {
+  while (pos < input.size() &&
+         (input[pos] == ' ' || input[pos] == '\t' || input[pos] == '\r'))
+    pos++;
+}
+
+static void AppendUTF8(std::string &output, uint code) {
+  if (code < 0x80) {
+    output.push_back(static_cast<char>(code));
+  } else if (code < 0x800) {
+    output.push_back(static_cast<char>(0xC0 | (code >> 6)));
+    output.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+  } else if (code < 0x10000) {
+    output.push_back(static_cast<char>(0xE0 | (code >> 12)));
+    output.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+    output.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+  } else {
+    output.push_back(static_cast<char>(0xF0 | (code >> 18)));
+    output.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+    output.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+    output.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+  }
+}
+
+static bool ParseHex4(const std::string &input, size_t pos, uint &code) {
+  if (pos + 4 > input.size())
+    return false;
+
+  code = 0;
+
+  for (size_t c = pos; c < pos + 4; c++) {
+    const char cChar = input[c];
+    code <<= 4;
+
+    if (cChar >= '0' && cChar <= '9')
+      code |= cChar - '0';
+    else if (cChar >= 'a' && cChar <= 'f')
+      code |= cChar - 'a' + 10;
+    else if (cChar >= 'A' && cChar <= 'F')
+      code |= cChar - 'A' + 10;
+    else
+      return false;
+  }
+
+  return true;
+}
+
+static bool ParseString(const std::string &input, size_t &pos,
+                        std::string &output) {
+  if (pos >= input.size() || input[pos] != '"')
+    return false;
+
+  for (pos++; pos < input.size(); pos++) {
+    const char cChar = input[pos];
+
+    if (cChar == '"') {
+      pos++;
+      return true;
+    }
+
+    if (cChar != '\\') {
+      output.push_back(cChar);
+      continue;
+    }
+
+    if (++pos >= input.size())
+      return false;
+
+    switch (input[pos]) {
+    case 'b':
+      output.push_back('\b');
+      break;
+    case 'f':
+      output.push_back('\f');
+      break;
+    case 'n':
+      output.push_back('\n');
+      break;
+    case 'r':
+      output.push_back('\r');
+      break;
+    case 't':
+      output.push_back('\t');
+      break;
+    case 'u': {
+      uint code;
+
+      if (!ParseHex4(input, pos + 1, code))
+        return false;
+
+      pos += 4;
+
+      // Surrogate pair
+      if (code >= 0xD800 && code < 0xDC00) {
+        uint lowCode;
+
+        if (input.compare(pos + 1, 2, "\\u") ||
+            !ParseHex4(input, pos + 3, lowCode) || lowCode < 0xDC00 ||
+            lowCode > 0xDFFF)
+          return false;
+
+        code = 0x10000 + ((code - 0xD800) << 10) + (lowCode - 0xDC00);
+        pos += 6;
+      }
+
+      AppendUTF8(output, code);
+      break;
+    }
+    default:
+      output.push_back(input[pos]);
+      break;
+    }
+  }
+
+  return false;
+}
+
+bool BatchJob::Parse(const std::string &line) {
+  fields.clear();
+  size_t pos = 0;
+  SkipSpace(line, pos);
+
+  if (pos >= line.size() || line[pos++] != '{')
+    return false;
+
+  SkipSpace(line, pos);
+
+  if (pos < line.size() && line[pos] == '}') {
+    pos++;
+  } else {
+    while (true) {
+      std::string key;
+      std::string value;
+
+      if (!ParseString(line, pos, key))
+        return false;
+
+      SkipSpace(line, pos);
+
+      if (pos >= line.size() || line[pos++] != ':')
+        return false;
+
+      SkipSpace(line, pos);
+
+      if (pos < line.size() && line[pos] == '"') {
+        if (!ParseString(line, pos, value))
+          return false;
+      } else {
+        // Numbers, booleans and null are kept as written
+        const size_t begin = pos;
+
+        while (pos < line.size() &&
+               (isalnum(static_cast<uchar>(line[pos])) || line[pos] == '-' ||
+                line[pos] == '+' || line[pos] == '.'))
+          pos++;
+
+        if (pos == begin)
+          return false;
+
+        value = line.substr(begin, pos - begin);
+      }
+
+      fields[key] = value;
+      SkipSpace(line, pos);
+
+      if (pos >= line.size())
+        return false;
+
+      if (line[pos] == '}') {
+        pos++;
+        break;
+      }
+
+      if (line[pos++] != ',')
+        return false;
+
+      SkipSpace(line, pos);
+    }
+  }
+
+  SkipSpace(line, pos);
+
+  return pos == line.size();
+}
+
+const std::string &BatchJob::Get(const std::string &key) const {
+  static const std::string empty;
+  auto found = fields.find(key);
+
+  return found == fields.end() ? empty : found->second;
+}
+
+std::string JSONEscape(const std::string &input) {
+  static const char digits[] = "0123456789abcdef";
+  std::string output;
+  output.reserve(input.size());
+
+  for (auto c : input) {
+    if (c == '"' || c == '\\') {
+      output.push_back('\\');
+      output.push_back(c);
+    } else if (static_cast<uchar>(c) < 0x20) {
+      output.append("\\u00");
+      output.push_back(digits[c >> 4]);
+      output.push_back(digits[c & 0xF]);
+    } else {
+      output.push_back(c);
+    }
+  }
+
+  return output;
+}
+
+namespace {
+// Persistent workers, queued jobs are finished on destruction.
+class WorkerPool {
+public:
+  WorkerPool(size_t numWorkers) {
+    for (size_t w = 0; w < numWorkers; w++)
+      workers.emplace_back(&WorkerPool::Work, this);
+  }
+
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+
+    signal.notify_all();
+
+    for (auto &w : workers)
+      w.join();
+  }
+
+  void Push(std::function<void()> job) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queue.push_back(std::move(job));
+    }
+
+    signal.notify_one();
+  }
+
+private:
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> queue;
+  std::mutex mutex;
+  std::condition_variable signal;
+  bool stop = false;
+
+  void Work() {
+    while (true) {
+      std::function<void()> job;
+
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        signal.wait(lock, [this] { return stop || !queue.empty(); });
+
+        if (queue.empty())
+          return;
+
+        job = std::move(queue.front());
+        queue.pop_front();
+      }
+
+      job();
+    }
+  }
+};
+
+// Destination of result lines, shared by jobs of single input.
+class ResultOutput {
+public:
+  virtual ~ResultOutput() = default;
+
+  void WriteLine(const std::string &line) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Write(line + '\n');
+  }
+
+protected:
+  virtual void Write(const std::string &data) = 0;
+
+private:
+  std::mutex mutex;
+};
+
+class StdOutput : public ResultOutput {
+protected:
+  void Write(const std::string &data) override {
+    fwrite(data.data(), 1, data.size(), stdout);
+    fflush(stdout);
+  }
+};
+
+#ifndef _WIN32
+// Connection is closed, after last result is written.
+class SocketOutput : public ResultOutput {
+public:
+  SocketOutput(int fd) : fd(fd) {}
+  ~SocketOutput() { close(fd); }
+
+protected:
+  void Write(const std::string &data) override {
+    for (size_t cPos = 0; cPos < data.size();) {
+      const ssize_t written =
+          send(fd, data.data() + cPos, data.size() - cPos, MSG_NOSIGNAL);
+
+      if (written < 0 && errno == EINTR)
+        continue;
+
+      // Client is gone
+      if (written <= 0)
+        return;
+
+      cPos += written;
+    }
+  }
+
+private:
+  int fd;
+};
+#endif
+
+struct BatchContext {
+  const batch_handler &handler;
+  WorkerPool pool;
+  std::atomic<bool> shutdown{false};
+  std::function<void()> onShutdown;
+
+  BatchContext(const batch_handler &handler, size_t numWorkers)
+      : handler(handler), pool(numWorkers) {}
+
+  void Dispatch(const std::string &line, size_t lineNumber,
+                const std::shared_ptr<ResultOutput> &output) {
+    BatchJob job;
+
+    if (!job.Parse(line)) {
+      output->WriteLine("{\"id\":\"" + std::to_string(lineNumber) +
+                        "\",\"status\":\"error\",\"code\":-1,"
+                        "\"message\":\"Invalid job\"}");
+      return;
+    }
+
+    const std::string &op = job.Get("op");
+    std::string id = job.Get("id");
+
+    if (id.empty())
+      id = std::to_string(lineNumber);
+
+    if (op == "shutdown") {
+      output->WriteLine("{\"id\":\"" + JSONEscape(id) +
+                        "\",\"op\":\"shutdown\",\"status\":\"ok\",\"code\":0}");
+      shutdown = true;
+
+      if (onShutdown)
+        onShutdown();
+
+      return;
+    }
+
+    pool.Push([this, job, id, output] {
+      const auto start = std::chrono::steady_clock::now();
+      std::string extra;
+      const int code = handler(job, extra);
+      const auto duration = std::chrono::steady_clock::now() - start;
+      const long long timeMS =
+          std::chrono::duration_cast<std::chrono::milliseconds>(duration)
+              .count();
+
+      output->WriteLine("{\"id\":\"" + JSONEscape(id) + "\",\"op\":\"" +
+                        JSONEscape(job.Get("op")) + "\",\"status\":\"" +
+                        (code ? "error" : "ok") +
+                        "\",\"code\":" + std::to_string(code) +
+                        ",\"time_ms\":" + std::to_string(timeMS) + extra +
+                        "}");
+    });
+  }
+};
+
+static void ReadLines(std::istream &input, BatchContext &context,
+                      const std::shared_ptr<ResultOutput> &output) {
+  std::string cLine;
+  size_t lineNumber = 0;
+
+  while (!context.shutdown && std::getline(input, cLine)) {
+    lineNumber++;
+
+    if (cLine.size() && cLine.back() == '\r')
+      cLine.pop_back();
+
+    if (cLine.find_first_not_of(" \t") != cLine.npos)
+      context.Dispatch(cLine, lineNumber, output);
+  }
+}
+
+#ifndef _WIN32
+static void ReadConnection(int fd, BatchContext &context,
+                           const std::shared_ptr<ResultOutput> &output) {
+  std::string pending;
+  char buffer[0x1000];
+  size_t lineNumber = 0;
+
+  while (!context.shutdown) {
+    const ssize_t numRead = recv(fd, buffer, sizeof(buffer), 0);
+
+    if (numRead < 0 && errno == EINTR)
+      continue;
+
+    if (numRead <= 0)
+      break;
+
+    pending.append(buffer, numRead);
+    size_t lineBegin = 0;
+
+    for (size_t lineEnd; !context.shutdown &&
+                         (lineEnd = pending.find('\n', lineBegin)) !=
+                             pending.npos;
+         lineBegin = lineEnd + 1) {
+      std::string cLine = pending.substr(lineBegin, lineEnd - lineBegin);
+      lineNumber++;
+
+      if (cLine.size() && cLine.back() == '\r')
+        cLine.pop_back();
+
+      if (cLine.find_first_not_of(" \t") != cLine.npos)
+        context.Dispatch(cLine, lineNumber, output);
+    }
+
+    pending.erase(0, lineBegin);
+  }
+}
+
+static int RunSocket(const TSTRING &socketPath, BatchContext &context) {
+  const std::string path = esString(socketPath);
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+
+  if (path.size() >= sizeof(address.sun_path)) {
+    printerror("Socket path is too long: ", << socketPath);
+    return 1;
+  }
+
+  memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+  const int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (listenFd < 0) {
+    printerror("Cannot create socket.");
+    return 1;
+  }
+
+  unlink(path.c_str());
+
+  if (bind(listenFd, reinterpret_cast<sockaddr *>(&address),
+           sizeof(address)) ||
+      listen(listenFd, 16)) {
+    printerror("Cannot listen on: ", << socketPath);
+    close(listenFd);
+    return 1;
+  }
+
+  printline("Listening on: ", << socketPath);
+
+  // Wakes up accept
+  context.onShutdown = [listenFd] { ::shutdown(listenFd, SHUT_RDWR); };
+
+  // Reader threads are detached, shared state outlives this function
+  struct Clients {
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::vector<int> fds;
+  };
+
+  auto clients = std::make_shared<Clients>();
+
+  while (!context.shutdown) {
+    const int clientFd = accept(listenFd, nullptr, nullptr);
+
+    if (clientFd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+
+      break;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(clients->mutex);
+      clients->fds.push_back(clientFd);
+    }
+
+    std::thread([&context, clients, clientFd] {
+      // Socket is closed with last reference, after fd is unlisted
+      auto output = std::make_shared<SocketOutput>(clientFd);
+      ReadConnection(clientFd, context, output);
+      std::lock_guard<std::mutex> lock(clients->mutex);
+      clients->fds.erase(
+          std::find(clients->fds.begin(), clients->fds.end(), clientFd));
+      clients->finished.notify_all();
+    }).detach();
+  }
+
+  {
+    // Stop reading from other clients, their results are still written
+    std::unique_lock<std::mutex> lock(clients->mutex);
+
+    for (auto c : clients->fds)
+      ::shutdown(c, SHUT_RD);
+
+    clients->finished.wait(lock, [&] { return clients->fds.empty(); });
+  }
+
+  close(listenFd);
+  unlink(path.c_str());
+
+  return 0;
+}
+#endif
+} // namespace
+
+int RunBatch(const batch_handler &handler, const TSTRING &socketPath,
+             size_t numWorkers) {
+  BatchContext context(handler, numWorkers ? numWorkers : 1);
+
+  if (socketPath.empty()) {
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    ReadLines(std::cin, context, std::make_shared<StdOutput>());
+    return 0;
+  }
+
+#ifdef _WIN32
+  printerror("Socket input is not supported on this platform.");
+  return 1;
+#else
+  signal(SIGPIPE, SIG_IGN);
+  return RunSocket(socketPath, context);
+#endif
+}
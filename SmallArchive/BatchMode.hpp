@@ -0,0 +1,49 @@
+/*      BatchMode
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "datas/esString.h"
+#include <functional>
+#include <map>
+#include <string>
+
+// Job parsed from single line JSON object.
+// Only flat objects of string, number and boolean values are supported.
+class BatchJob {
+public:
+  bool Parse(const std::string &line);
+  // Returns empty string for missing keys
+  const std::string &Get(const std::string &key) const;
+
+private:
+  std::map<std::string, std::string> fields;
+};
+
+std::string JSONEscape(const std::string &input);
+
+// Runs job, returns 0 on success.
+// Additional result members can be appended as: ,"key":value
+typedef std::function<int(const BatchJob &job, std::string &result)>
+    batch_handler;
+
+// Reads jobs as JSON lines from stdin, or from connections on unix domain
+// socket, when socketPath is set. Jobs run on single pool of workers,
+// results are written as JSON lines, in order of completion:
+// {"id":...,"op":"...","status":"ok|error","code":N,"time_ms":N,...}
+// Returns after end of input, or "shutdown" job on socket.
+int RunBatch(const batch_handler &handler, const TSTRING &socketPath,
+             size_t numWorkers);
@@ -15,7 +15,6 @@
         along with this program.If not, see <https://www.gnu.org/licenses/>.
 */
 
-#include "datas/DirectoryScanner.hpp"
 #include "datas/MasterPrinter.hpp"
 #include "datas/MultiThread.hpp"
 #include "datas/SettingsManager.hpp"
@@ -23,46 +22,103 @@
 #include "datas/binwritter.hpp"
 #include "datas/esString.h"
 #include "datas/fileinfo.hpp"
-#include "lookup3.h"
+#include "ArchiveImage.hpp"
+#include "ArchiveMerge.hpp"
+#include "BatchMode.hpp"
+#include "ContentStore.hpp"
+#include "PackLayout.hpp"
+#include "PathFilter.hpp"
+#include "SARC.hpp"
+#include "SourceCache.hpp"
 #include "project.h"
 #include "pugixml.hpp"
-#include "zlib.h"
+#include <algorithm>
+#include <cstdarg>
+#include <thread>
 
 static struct SmallArchive : SettingsManager {
   DECLARE_REFLECTOR;
   bool Generate_Log = false;
   bool Generate_TOC = true;
+  bool Use_huge_pages = false;
+  bool Group_by_type = false;
+  bool Block_aware_layout = true;
+  int Large_entry_alignment = 0;
+  int Source_cache_size = 256;
   std::string Ignore_extensions = ".hmddsc;.atx1;.atx2;.atx3;.ee;.eez;.bl;.blz;.fl;.flz;.nl;.nlz;.sarc;.toc";
-
-  std::vector<TSTRING> _ignoredExts;
+  std::string Ignore_globs;
+  std::string Ignore_directories = ".git;.svn";
+  std::string Access_order_trace;
+  std::string Merge_priority;
+  std::string Content_store_path;
+  bool Content_store_reflinks = false;
+
+  ContentStore _store;
+  PathFilter _filter;
+  PackLayout _layout;
+  std::vector<std::string> _mergePriority;
 
   void Process() {
-    size_t curOffset = 0;
+    _layout.groupByType = Group_by_type;
+    _layout.largeEntryAlignment =
+        Large_entry_alignment > 0 ? Large_entry_alignment : 0;
+
+    if (Access_order_trace.size()) {
+      const TSTRING tracePath = esString(Access_order_trace);
+      std::ifstream traceStream(tracePath);
+      std::vector<std::string> accessOrder;
+      std::string cLine;
+
+      while (std::getline(traceStream, cLine))
+        if (cLine.size())
+          accessOrder.push_back(cLine);
+
+      if (traceStream.bad() || accessOrder.empty()) {
+        printwarning("Cannot load access order trace: ",
+                     << Access_order_trace.c_str());
+      }
+
+      _layout.AccessOrder(accessOrder);
+    }
+
+    SourceCache::Get().SetLimit(
+        Source_cache_size > 0 ? static_cast<size_t>(Source_cache_size) << 20
+                              : 0);
+
+    _filter.AddExtensions(Ignore_extensions);
+    _filter.AddGlobs(Ignore_globs);
+    _filter.AddDirectories(Ignore_directories);
+
+    if (Content_store_path.size() &&
+        !_store.Open(esString(Content_store_path), Content_store_reflinks)) {
+      printwarning("Cannot open content store: ",
+                   << Content_store_path.c_str());
+    }
+
     size_t lastOffset = 0;
 
-    do {
-      curOffset = Ignore_extensions.find(';', lastOffset);
-      std::string sub(Ignore_extensions.cbegin() + lastOffset,
-                      curOffset == std::string::npos
-                          ? Ignore_extensions.cend()
-                          : Ignore_extensions.cbegin() + curOffset);
-      _ignoredExts.emplace_back(esString(sub));
-      lastOffset = curOffset + 1;
-    } while (curOffset != std::string::npos);
-  }
+    while (lastOffset < Merge_priority.size()) {
+      size_t curOffset = Merge_priority.find(';', lastOffset);
 
-  bool IsExcluded(const TSTRING &input) {
-    for (auto &e : _ignoredExts)
-      if (input.find(e) != input.npos)
-        return true;
+      if (curOffset == Merge_priority.npos)
+        curOffset = Merge_priority.size();
 
-    return false;
-  }
+      if (curOffset > lastOffset)
+        _mergePriority.push_back(
+            Merge_priority.substr(lastOffset, curOffset - lastOffset));
 
+      lastOffset = curOffset + 1;
+    }
+  }
 } settings;
 
 REFLECTOR_START_WNAMES(SmallArchive, Generate_Log, Generate_TOC,
-                       Ignore_extensions);
+                       Ignore_extensions, Ignore_globs, Ignore_directories,
+                       Use_huge_pages, Group_by_type, Block_aware_layout,
+                       Large_entry_alignment, Source_cache_size,
+                       Access_order_trace,
+                       Merge_priority, Content_store_path,
+                       Content_store_reflinks);
 
 static const char help[] = "\nWill extract/create SARC/AAF archives.\n\n\
 Settings (.config file):\n\
@@ -70,800 +126,639 @@ Settings (.config file):\n\
         Will generate text log of console output next to application location.\n\
     Ignore_extensions:\n\
         Won't add files with those extensions into the archives.\n\
+    Ignore_globs:\n\
+        Won't add files matching those patterns, for example: *_old.*;temp/*\n\
+    Ignore_directories:\n\
+        Won't add or scan directories with those names.\n\
     Generate_TOC: \n\
-        Will generate TOC file next to the extracted archive.\n\n\
+        Will generate TOC file next to the extracted archive.\n\
+    Use_huge_pages: \n\
+        Will back large work buffers by transparent huge pages (Linux only).\n\
+    Group_by_type: \n\
+        Will place file data of same extension next to each other.\n\
+    Block_aware_layout: \n\
+        Will keep files from straddling AAF blocks when creating AAF archives.\n\
+    Large_entry_alignment: \n\
+        Aligns data of files 64kB and larger, for example 4096. 0 is disabled.\n\
+    Source_cache_size: \n\
+        Size of source file cache in MB, shared by archives created at once.\n\
+        0 is disabled.\n\
+    Access_order_trace: \n\
+        Path to a text file with archive paths in load order, one per line.\n\
+        Listed files are placed first, in that order.\n\
+    Merge_priority: \n\
+        Archive names, which files win on merge, highest first.\n\
+        Otherwise later archives override earlier ones.\n\
+    Content_store_path: \n\
+        Extracted files are stored once by content in this folder\n\
+        and extracted as hardlinks into it.\n\
+    Content_store_reflinks: \n\
+        Use reflinks (copy on write) instead of hardlinks, where supported.\n\n\
 CLI Parameters:\n\
     -h  Will show help.\n\
     -a <archive name> <version> <folder>\n\
         Will create SARC archive.\n\
         Supported versions: 2, 3\n\
     -c  Same as -a, but compresses archive.\n\
-    -f  Same as -a, but compresses archive as an AAF.\n\t";
+    -f  Same as -a, but compresses archive as an AAF.\n\
+    -m <archive name> <archive 1> ... <archive N>\n\
+        Will merge archives into one, format of first archive is used.\n\
+    -s <archive> <max size in MB>\n\
+        Will split archive into <archive>_N archives.\n\
+    -d [socket path]\n\
+        Will run jobs from JSON lines on stdin or unix socket, for example:\n\
+        {\"id\":\"1\",\"op\":\"extract\",\"path\":\"archive.ee\"}\n\
+        Supported ops: extract, pack (from TOC), list, verify.\n\t";
 
 static const char pressKeyCont[] = "\nPress any key to close.";
 
-struct SARCFileEntry {
-  std::string fileName;
-  int offset;
-  int length;
+// File data are copied in chunks of this size
+static constexpr size_t COPY_CHUNK_SIZE = 0x100000;
 
-  SARCFileEntry() = default;
-  SARCFileEntry(const std::string str, int fSize)
-      : fileName(str), length(fSize) {}
+void mkdirs(const SARC &sarc, const TSTRING &inFilepath) {
+  const size_t numFiles = sarc.NumFiles();
 
-  void Load(BinReader *rd) {
-    rd->ReadContainer(fileName);
-    rd->Read(offset);
-    rd->Read(length);
+  for (size_t f = 0; f < numFiles; f++) {
+    const std::string &cfle = sarc.FileName(f);
+    for (size_t s = 0; s < cfle.length(); s++)
+      if (cfle[s] == '\\' || cfle[s] == '/') {
+        TSTRING genpath = inFilepath;
+        genpath.append(esString(cfle.substr(0, s)));
+        _tmkdir(genpath.c_str());
+      }
   }
+}
 
-  void Write(BinWritter *bw) const {
-    uint allignment = fileName.size() & 0x3;
+int ExtractFiles(const SARC &sarc, BinReader *rd, const TSTRING &inFile,
+                 SARC::CompressionType compType) {
+  TFileInfo fInf(inFile);
+  TSTRING inFilepath = fInf.GetPath();
 
-    if (allignment)
-      allignment = 4 - allignment;
+  printline("Generating folder structure.");
+  mkdirs(sarc, inFilepath);
+  printline("Extracting files.");
 
-    bw->Write(allignment + fileName.size());
-    bw->WriteContainer(fileName);
-    bw->Skip(allignment);
-    bw->Write(offset);
-    bw->Write(length);
-  }
-};
+  std::ofstream tocFile;
 
-struct _SARC3FileEntry {
-  int fileNameOffset;
-  int offset;
-  int length;
-  int fileNameHash, hash02;
-};
+  if (settings.Generate_TOC) {
+    auto tocFileName = inFile + _T(".toc");
+    tocFile.open(tocFileName);
 
-struct SARC3FileEntry : _SARC3FileEntry {
-  std::string fileName;
+    if (tocFile.fail()) {
+      printerror("Cannot create: ", << tocFileName);
+    } else {
+      tocFile << "TOC" << (sarc.bigEndian ? 'B' : 'L') << sarc.GetVersion();
 
-  void Load(BinReader *rd, const char *masterBuffer) {
-    rd->Read(static_cast<_SARC3FileEntry &>(*this));
-    fileName = masterBuffer + fileNameOffset;
-  }
+      switch (compType) {
+      case SARC::C_NONE:
+        tocFile << 'U';
+        break;
+      case SARC::C_ZLIB:
+        tocFile << 'C';
+        break;
+      case SARC::C_AAF:
+        tocFile << 'A';
+        break;
+      }
 
-  void Write(BinWritter *wr) const {
-    wr->Write(static_cast<const _SARC3FileEntry &>(*this));
+      tocFile << std::endl;
+    }
   }
-};
 
-struct SARC {
-  static constexpr int ID = CompileFourCC("SARC");
+  const size_t numFiles = sarc.NumFiles();
+  size_t numFailed = 0;
 
-  enum CompressionType { C_NONE, C_ZLIB, C_AAF };
+  std::vector<size_t> order;
 
-  virtual int Load(BinReader *rd) = 0;
-  virtual void Write(BinWritter *wr) = 0;
-  virtual void AddFileEntry(const std::string &filePath, int fileSize,
-                            bool external) = 0;
-  virtual void ExtractFiles(BinReader *rd, const TSTRING &inFilepath,
-                            CompressionType compType) = 0;
-  virtual void mkdirs(const TSTRING &inFilepath) = 0;
-  virtual int GetVersion() const = 0;
-};
+  for (size_t f = 0; f < numFiles; f++) {
+    const size_t offset = sarc.FileOffset(f);
 
-template <class C> struct SARC_t : SARC {
-  std::vector<C> files;
-
-  void ExtractFiles(BinReader *rd, const TSTRING &inFile,
-                    CompressionType compType) {
-    TFileInfo fInf(inFile);
-    TSTRING inFilepath = fInf.GetPath();
-
-    printline("Generating folder structure.");
-    mkdirs(inFilepath);
-    printline("Extracting files.");
-
-    std::ofstream tocFile;
-
-    if (settings.Generate_TOC) {
-      auto tocFileName = inFile + _T(".toc");
-      tocFile.open(tocFileName);
-
-      if (tocFile.fail()) {
-        printerror("Cannot create: ", << tocFileName);
-      } else {
-        tocFile << "TOCL" << GetVersion();
-
-        switch (compType) {
-        case C_NONE:
-          tocFile << 'U';
-          break;
-        case C_ZLIB:
-          tocFile << 'C';
-          break;
-        case C_AAF:
-          tocFile << 'A';
-          break;
-        }
+    if (settings.Generate_TOC && !tocFile.fail()) {
+      tocFile << sarc.FileName(f).c_str();
 
-        tocFile << std::endl;
-      }
-    }
+      if (!offset)
+        tocFile << " E";
 
-    for (auto &f : files) {
-      if (settings.Generate_TOC && !tocFile.fail()) {
-        tocFile << f.fileName.c_str();
+      tocFile << std::endl;
+    }
 
-        if (!f.offset)
-          tocFile << " E";
+    if (offset)
+      order.push_back(f);
+  }
 
-        tocFile << std::endl;
+  tocFile.close();
+
+  // Data are read in offset order, so compressed archives are not rewound
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return sarc.FileOffset(a) < sarc.FileOffset(b);
+  });
+
+  for (size_t f : order) {
+    const size_t offset = sarc.FileOffset(f);
+    const size_t length = sarc.FileSize(f);
+
+    TSTRING genpath = inFilepath;
+    genpath.append(esString(sarc.FileName(f)));
+
+    // Output file may be hardlinked into store, so it must not be opened
+    if (settings._store.IsOpen()) {
+      const bool stored = settings._store.Put(
+          genpath, length,
+          [&](size_t entryOffset, char *buffer, size_t size) {
+            rd->Seek(offset + entryOffset);
+            rd->ReadBuffer(buffer, size);
+            return rd->IsValid();
+          });
+
+      if (!stored) {
+        printerror("Cannot store: ", << genpath);
+        numFailed++;
       }
 
-      if (f.offset > 0) {
-        TSTRING genpath = inFilepath;
-        genpath.append(esString(f.fileName));
-        std::ofstream result =
-            std::ofstream(genpath, std::ios::out | std::ios::binary);
-
-        if (result.fail())
-          continue;
-
-        if (f.offset > 0) {
-          rd->Seek(f.offset);
-          char *tmp = static_cast<char *>(malloc(f.length));
-          rd->ReadBuffer(tmp, f.length);
-          result.write(tmp, f.length);
-          free(tmp);
-        }
-        result.close();
-      }
+      continue;
     }
 
-    tocFile.close();
-  }
+    std::ofstream result =
+        std::ofstream(genpath, std::ios::out | std::ios::binary);
 
-  void mkdirs(const TSTRING &inFilepath) {
-    for (auto &f : files) {
-      std::string cfle = f.fileName;
-      for (size_t s = 0; s < cfle.length(); s++)
-        if (cfle[s] == '\\' || cfle[s] == '/') {
-          TSTRING genpath = inFilepath;
-          genpath.append(esString(cfle.substr(0, s)));
-          _tmkdir(genpath.c_str());
-        }
+    if (result.fail()) {
+      printerror("Cannot create: ", << genpath);
+      numFailed++;
+      continue;
     }
-  }
-};
 
-struct SARC2 : SARC_t<SARCFileEntry> {
-  struct {
-    int hlen;
-    int hid;
-    int version;
-    uint tocSize;
-  } header;
+    rd->Seek(offset);
+    BufferPool::Buffer tmp =
+        BufferPool::Acquire(std::min(length, COPY_CHUNK_SIZE));
 
-  SARC2() : header{4, ID, 2} {}
-
-  void AddFileEntry(const std::string &filePath, int fileSize,
-                    bool external) override {
-    files.emplace_back(filePath, fileSize);
-    files[files.size() - 1].offset = external ? -1 : 0;
-  }
-
-  int GetVersion() const override { return 2; }
-
-  int Load(BinReader *rd) override {
-    rd->Read(header);
-
-    if (header.hlen != 4 || header.hid != ID)
-      return 1;
+    if (!tmp) {
+      printerror("Cannot allocate copy buffer for: ", << genpath);
+      numFailed++;
+      continue;
+    }
 
-    if (header.version > 2)
-      return 2;
+    for (size_t cPos = 0; cPos < length;) {
+      const size_t toCopy = std::min(length - cPos, COPY_CHUNK_SIZE);
+      rd->ReadBuffer(tmp.Data(), toCopy);
+      result.write(tmp.Data(), toCopy);
+      cPos += toCopy;
+    }
 
-    const uint tocEnd = header.tocSize + sizeof(header);
+    result.close();
+  }
 
-    while (rd->Tell() < tocEnd) {
-      SARCFileEntry cf;
-      cf.Load(rd);
+  return numFailed ? 3 : 0;
+}
 
-      if (!cf.fileName.size())
-        break;
+struct SARCPacker {
+  enum SARCVersion { V2 = 2, V3 = 3 };
 
-      files.push_back(cf);
-    }
+  bool bigEndian = false;
 
-    return 0;
-  }
+  int Create(BinWritter &out, const std::vector<TSTRING> &files,
+             SARCVersion ver, const TSTRING &dir, bool blockLayout) {
+    std::unique_ptr<SARC> sarcInstance;
 
-  void Write(BinWritter *bw) override {
-    const size_t begin = bw->Tell();
+    if (ver == V2)
+      sarcInstance = std::unique_ptr<SARC>(new SARC2());
+    else
+      sarcInstance = std::unique_ptr<SARC>(new SARC3());
 
-    bw->Write(header);
+    sarcInstance->bigEndian = bigEndian;
 
-    const size_t tocStart = bw->Tell();
+    std::vector<PackEntry> entries;
+    std::vector<TSTRING> sources;
+    std::vector<bool> externals;
 
-    for (auto f : files)
-      f.Write(bw);
+    for (auto &f : files) {
+      bool external = false;
 
-    bw->ApplyPadding();
+      if (f[f.size() - 2] == ' ' && f[f.size() - 1] == 'E') {
+        external = true;
+      }
 
-    size_t lastOffset = bw->Tell();
+      sources.emplace_back(f.cbegin(), f.cend() - (external ? 2 : 0));
+      externals.push_back(external);
+    }
 
-    header.tocSize = lastOffset - tocStart;
+    const std::vector<size_t> sizes = FileSizes(sources);
+    size_t numSources = 0;
 
-    bw->Seek(begin);
-    bw->Write(header);
+    for (size_t f = 0; f < sources.size(); f++) {
+      const TSTRING &cFleName = sources[f];
+      const size_t fleSize = sizes[f];
 
-    for (auto f : files) {
-      if (f.offset < 0) {
-        f.offset = 0;
+      if (fleSize == NO_FILE) {
+        printerror("Cannot open: ", << cFleName);
         continue;
       }
 
-      f.offset = lastOffset;
+      if (fleSize > SARC::MAX_OFFSET) {
+        printerror("File is too large for archive (4 GB limit): ",
+                   << cFleName);
+        return 1;
+      }
 
-      uint allignment = f.length & 0xF;
+      const TCHAR lastDirChar = *std::prev(dir.end());
+      const int additionalDirSize =
+          lastDirChar == '/' || lastDirChar == '\\' ? 0 : 1;
 
-      if (allignment)
-        allignment = 0x10 - allignment;
+      PackEntry cEntry;
+      cEntry.name = esString(cFleName.substr(dir.size() + additionalDirSize));
+      cEntry.size = fleSize;
+      cEntry.external = externals[f];
 
-      lastOffset += allignment + f.length;
-      f.Write(bw);
+      sarcInstance->AddFileEntry(cEntry.name, fleSize, cEntry.external);
+      entries.push_back(cEntry);
+      sources[numSources++] = cFleName;
     }
 
-    bw->ApplyPadding();
-  }
-};
-
-struct SARC3 : SARC_t<SARC3FileEntry> {
-  struct {
-    int hlen;
-    int hid;
-    int version;
-    uint dataOffset;
-    uint bufferLen;
-  } header;
-
-  std::string nameBuffer;
+    sources.resize(numSources);
 
-  SARC3() : header{4, ID, 3} {}
+    PackLayout layout = settings._layout;
+    layout.blockSize =
+        blockLayout && settings.Block_aware_layout ? AAF::MAX_BLOCK_SIZE : 0;
 
-  void AddFileEntry(const std::string &filePath, int fileSize,
-                    bool external) override {
-    SARC3FileEntry nEntry;
+    const size_t dataBegin = out.Tell() + sarcInstance->DataOffset();
+    const size_t dataEnd = layout.Place(entries, dataBegin);
 
-    nEntry.fileNameOffset = nameBuffer.size();
-    nameBuffer.append(filePath).push_back(0);
-    nEntry.fileNameHash = JenkinsLookup3(filePath.c_str());
-    nEntry.hash02 = 0;
-    nEntry.length = fileSize;
-    nEntry.offset = external ? -1 : 0;
-
-    files.push_back(nEntry);
-  }
+    if (dataEnd > SARC::MAX_OFFSET) {
+      printerror("Archive data would exceed 4 GB, which cannot be addressed "
+                 "by archive offsets. Split files into more archives.");
+      return 1;
+    }
 
-  int GetVersion() const override { return 3; }
+    for (size_t e = 0; e < entries.size(); e++)
+      if (!entries[e].external)
+        sarcInstance->SetFileOffset(e, entries[e].offset);
 
-  int Load(BinReader *rd) override {
-    rd->Read(header);
+    sarcInstance->presetOffsets = true;
 
-    if (header.hlen != 4 || header.hid != ID)
+    if (sarcInstance->Write(&out))
       return 1;
 
-    if (header.version != 3)
-      return 2;
-
-    nameBuffer.resize(header.bufferLen);
-    rd->ReadContainer(nameBuffer, header.bufferLen);
+    if (blockLayout) {
+      const PackLayout::Report report = layout.Evaluate(entries, dataBegin);
 
-    while (rd->Tell() + sizeof(_SARC3FileEntry) <= header.dataOffset) {
-      SARC3FileEntry cf;
-      cf.Load(rd, nameBuffer.c_str());
-      files.push_back(cf);
+      printline("Layout: ", << report.numEntries << " files, "
+                             << report.blockReads << " block reads (minimum "
+                             << report.minBlockReads << "), "
+                             << report.straddling << " straddling, "
+                             << (report.padding >> 10) << " kB padding.");
     }
 
-    return 0;
-  }
+    std::vector<size_t> dataOrder;
 
-  void Write(BinWritter *wr) override {
-    const size_t begin = wr->Tell();
+    for (size_t e = 0; e < entries.size(); e++)
+      if (!entries[e].external)
+        dataOrder.push_back(e);
 
-    wr->Write(header);
-    wr->WriteContainer(nameBuffer);
-    wr->ApplyPadding(4);
-    header.bufferLen = wr->Tell() - begin - sizeof(header);
+    std::sort(dataOrder.begin(), dataOrder.end(), [&](size_t a, size_t b) {
+      return entries[a].offset < entries[b].offset;
+    });
 
-    const size_t TOCbegin = wr->Tell();
+    BufferPool::Buffer tempBuffer = BufferPool::Acquire(COPY_CHUNK_SIZE);
+    const std::string padding(0x1000, 0);
+    SourceCache &cache = SourceCache::Get();
 
-    for (auto &f : files)
-      f.Write(wr);
+    if (!tempBuffer) {
+      printerror("Cannot allocate copy buffer.");
+      return 1;
+    }
 
-    wr->ApplyPadding();
-    header.dataOffset = wr->Tell();
+    for (auto e : dataOrder) {
+      for (size_t cPos = out.Tell(); cPos < entries[e].offset;) {
+        const size_t padSize =
+            std::min(padding.size(), entries[e].offset - cPos);
+        out.WriteBuffer(padding.data(), padSize);
+        cPos += padSize;
+      }
 
-    wr->Seek(begin);
-    wr->Write(header);
-    wr->Seek(TOCbegin);
+      // Shared with other pack jobs, that include same file
+      if (cache.Accepts(entries[e].size)) {
+        SourceCache::data_type data =
+            cache.Acquire(sources[e], entries[e].size);
 
-    for (auto &f : files) {
-      if (f.offset < 0) {
-        f.offset = 0;
+        if (!data) {
+          printerror("Cannot read: ", << sources[e]);
+          return 1;
+        }
+
+        out.WriteBuffer(data->data(), data->size());
         continue;
       }
 
-      f.offset = header.dataOffset;
-      uint allignment = f.length & 0xF;
+      BinReader rd(sources[e]);
 
-      if (allignment)
-        allignment = 0x10 - allignment;
+      if (!rd.IsValid() || rd.GetSize() != entries[e].size) {
+        printerror("Cannot read: ", << sources[e]);
+        return 1;
+      }
 
-      header.dataOffset += allignment + f.length;
-      f.Write(wr);
+      for (size_t cPos = 0; cPos < entries[e].size;) {
+        const size_t toCopy =
+            std::min(entries[e].size - cPos, COPY_CHUNK_SIZE);
+        rd.ReadBuffer(tempBuffer.Data(), toCopy);
+        out.WriteBuffer(tempBuffer.Data(), toCopy);
+        cPos += toCopy;
+      }
     }
+
+    return 0;
+  }
+
+  int Scan(BinWritter &out, const TSTRING &dir, SARCVersion ver,
+           bool blockLayout = false) {
+    return Create(out, ScanDirectory(dir, settings._filter), ver, dir,
+                  blockLayout);
   }
-};
 
-struct EWAM {
-  static constexpr int ID = CompileFourCC("EWAM");
+  // Archive is compressed while being written, so only one compression
+  // block of uncompressed data is held in memory.
+  int Compressed(BinWritter &out, const std::vector<TSTRING> &files,
+                 SARCVersion ver, const TSTRING &dir,
+                 SARC::CompressionType cType) {
+    std::unique_ptr<CompressStreamBuf> compressBuf;
 
-  struct {
-    int compressedSize;
-    int uncompressedSize;
-    int nextBlock;
-    int id;
-  } header;
-  char *intermediateData;
+    if (cType == SARC::C_AAF)
+      compressBuf.reset(new AAFStreamBuf(&out, bigEndian));
+    else
+      compressBuf.reset(new ZlibStreamBuf(&out));
 
-  int Load(BinReader *rd) {
-    rd->Read(header);
+    std::ostream compressStream(compressBuf.get());
+    BinWritter wr(compressStream);
 
-    if (header.id != ID)
+    if (Create(wr, files, ver, dir, cType == SARC::C_AAF))
       return 1;
 
-    char *compressedStream = static_cast<char *>(malloc(header.compressedSize));
-    intermediateData = static_cast<char *>(malloc(header.uncompressedSize));
-    rd->ReadBuffer(compressedStream, header.compressedSize);
-
-    z_stream infstream;
-    infstream.zalloc = Z_NULL;
-    infstream.zfree = Z_NULL;
-    infstream.opaque = Z_NULL;
-    infstream.avail_in = header.compressedSize;
-    infstream.next_in = reinterpret_cast<Bytef *>(compressedStream);
-    infstream.avail_out = header.uncompressedSize;
-    infstream.next_out = reinterpret_cast<Bytef *>(intermediateData);
-    inflateInit2(&infstream, -MAX_WBITS);
-    int state = inflate(&infstream, Z_FINISH);
-    inflateEnd(&infstream);
-    free(compressedStream);
-
-    if (state != Z_STREAM_END) {
-      printerror("[ZLIB] Expected Z_STREAM_END.");
+    if (compressBuf->Finish())
       return 2;
-    }
 
     return 0;
   }
 
-  int Write(BinWritter *wr) {
-    char *compressedStream =
-        static_cast<char *>(malloc(header.uncompressedSize));
-    z_stream infstream;
-    infstream.zalloc = Z_NULL;
-    infstream.zfree = Z_NULL;
-    infstream.opaque = Z_NULL;
-    infstream.avail_in = header.uncompressedSize;
-    infstream.next_in = reinterpret_cast<Bytef *>(intermediateData);
-    infstream.avail_out = header.uncompressedSize;
-    infstream.next_out = reinterpret_cast<Bytef *>(compressedStream);
-
-    deflateInit2(&infstream, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
-                 Z_DEFAULT_STRATEGY);
-    int state = deflate(&infstream, Z_FINISH);
-    deflateEnd(&infstream);
-
-    if (state != Z_STREAM_END) {
-      printerror("[ZLIB] Expected Z_STREAM_END.");
-      return 2;
-    }
-
-    header.compressedSize = infstream.total_out;
-
-    const size_t begin = wr->Tell();
+  int FromTOC(std::istream &str, BinWritter &out, const TSTRING &dir) {
+    std::string cLine;
+    std::getline(str, cLine);
+    int ver = atohLUT[cLine[4]];
+    SARC::CompressionType cType = SARC::C_NONE;
+    bigEndian = cLine[3] == 'B';
 
-    wr->Write(header);
-    wr->WriteBuffer(compressedStream, header.compressedSize);
-    wr->ApplyPadding();
-    header.nextBlock = wr->Tell() - begin;
+    if (cLine[3] != 'L' && !bigEndian) {
+      printwarning("[TOC] Unexpected endian token: ", << cLine[3]);
+    }
 
-    const size_t end = wr->Tell();
+    if (cLine[5] == 'C')
+      cType = SARC::C_ZLIB;
+    else if (cLine[5] == 'A')
+      cType = SARC::C_AAF;
+    else if (cLine[5] != 'U') {
+      printwarning("[TOC] Unexpected compression token: ", << cLine[5]);
+    }
 
-    wr->Seek(begin);
-    wr->Write(header);
-    wr->Seek(end);
-    free(compressedStream);
+    if (ver < 2 || ver > 3) {
+      printerror("[TOC] Unknown version!");
+      return 1;
+    }
 
-    return 0;
-  }
+    std::vector<TSTRING> files;
 
-  EWAM() : intermediateData(nullptr), header{0, 0, 0, ID} {}
+    while (std::getline(str, cLine), cLine.size()) {
+      const bool external =
+          cLine.size() > 2 && !cLine.compare(cLine.size() - 2, 2, " E");
 
-  ~EWAM() {
-    if (intermediateData)
-      free(intermediateData);
-  }
-};
+      if (settings._filter.IsExcluded(
+              external ? cLine.substr(0, cLine.size() - 2) : cLine))
+        continue;
 
-struct AAF {
-  static constexpr int ID = CompileFourCC("AAF\0");
-  static constexpr int ID2[] = {CompileFourCC("AVAL"), CompileFourCC("ANCH"),
-                                CompileFourCC("EARC"), CompileFourCC("HIVE"),
-                                CompileFourCC("FORM"), CompileFourCC("ATIS"),
-                                CompileFourCC("COOL")};
-  static constexpr int MAX_BLOCK_SIZE = 0x2000000;
-
-  struct Header {
-    int id;
-    int version;
-    int id2[7];
-    int uncompressedSize;
-    int blockSize;
-    int blockCount;
-
-    Header()
-        : id(ID), version(1), id2{ID2[0], ID2[1], ID2[2], ID2[3],
-                                  ID2[4], ID2[5], ID2[6]} {}
-  } header;
-
-  std::vector<std::unique_ptr<EWAM>> blocks;
-
-  int Load(BinReader *rd) {
-    rd->Read(header);
-
-    if (header.id != ID)
-      return 1;
+      files.push_back(dir + static_cast<TSTRING>(esString(cLine)));
+    }
 
-    if (memcmp(header.id2, ID2, sizeof(ID2)))
+    if (cType == SARC::C_NONE) {
+      if (Create(out, files, static_cast<SARCVersion>(ver), dir, false))
+        return 2;
+    } else if (Compressed(out, files, static_cast<SARCVersion>(ver), dir,
+                          cType)) {
       return 2;
-
-    for (int b = 0; b < header.blockCount; b++) {
-      EWAM *cb = new EWAM;
-      size_t cpos = rd->Tell();
-      int rtval = cb->Load(rd);
-
-      if (rtval)
-        return 3;
-
-      blocks.emplace_back(cb);
-      rd->Seek(cpos + cb->header.nextBlock);
     }
 
     return 0;
   }
+};
 
-  int Write(BinWritter *wr, char *buffer, size_t buffSize) {
-    header.blockCount = buffSize / MAX_BLOCK_SIZE;
-    header.uncompressedSize = buffSize;
-    const size_t lastBlockSize = buffSize % MAX_BLOCK_SIZE;
+int ExtractArchive(const TSTRING &path) {
+  ArchiveImage archive;
 
-    if (lastBlockSize)
-      header.blockCount++;
+  if (int status = archive.Load(path))
+    return status;
 
-    if (header.blockCount > 1)
-      header.blockSize = MAX_BLOCK_SIZE;
-    else
-      header.blockSize = lastBlockSize;
+  if (archive.compression == SARC::C_AAF)
+    printline("AAF detected.");
 
-    wr->Write(header);
+  printline("SARC V", << archive.sarc->GetVersion() << " detected.");
 
-    for (int b = 1; b < header.blockCount; b++) {
-      EWAM ew;
-      ew.intermediateData = buffer + (b - 1) * MAX_BLOCK_SIZE;
-      ew.header.uncompressedSize = MAX_BLOCK_SIZE;
+  return ExtractFiles(*archive.sarc, archive.Reader(), path,
+                      archive.compression);
+}
 
-      if (ew.Write(wr))
-        return 1;
+int PackTOC(const TSTRING &tocPath) {
+  TFileInfo fInf(tocPath);
+  TSTRING aFile = fInf.GetPath() + fInf.GetFileName();
+  printline("Creating archive: ", << aFile);
+  SARCPacker pck;
+  BinWritter wr(aFile);
+  std::ifstream textStream(tocPath);
+
+  if (!wr.IsValid() || textStream.fail() ||
+      pck.FromTOC(textStream, wr, fInf.GetPath())) {
+    printerror("Cannot create archive!");
+    return 2;
+  }
 
-      ew.intermediateData = nullptr;
-    }
+  printline("Archive created.");
 
-    EWAM ew;
-    ew.intermediateData = buffer + (header.blockCount - 1) * MAX_BLOCK_SIZE;
-    ew.header.uncompressedSize = lastBlockSize;
+  return 0;
+}
 
-    if (ew.Write(wr))
-      return 1;
+int FilehandleITFC(const _TCHAR *fle) {
+  printline("Loading Archive: ", << fle);
+  int magic = 0;
 
-    ew.intermediateData = nullptr;
+  {
+    BinReader rd(fle);
 
-    return 0;
-  }
+    if (!rd.IsValid()) {
+      printline("Could not load file.");
+      return 1;
+    }
 
-  void GetNewStream(std::stringstream *str) {
-    for (auto &b : blocks)
-      str->write(b->intermediateData, b->header.uncompressedSize);
+    rd.Read(magic);
   }
-};
 
-int CompressArchive(BinWritter *wr, char *buffer, size_t bufferSize) {
-  std::string compressedStream;
-  compressedStream.resize(bufferSize);
-  z_stream infstream;
-  infstream.zalloc = Z_NULL;
-  infstream.zfree = Z_NULL;
-  infstream.opaque = Z_NULL;
-  infstream.avail_in = bufferSize;
-  infstream.next_in = reinterpret_cast<Bytef *>(buffer);
-  infstream.avail_out = bufferSize;
-  infstream.next_out = reinterpret_cast<Bytef *>(&compressedStream[0]);
-
-  deflateInit2(&infstream, Z_BEST_COMPRESSION, Z_DEFLATED, MAX_WBITS, 8,
-               Z_DEFAULT_STRATEGY);
-  int state = deflate(&infstream, Z_FINISH);
-  deflateEnd(&infstream);
-
-  if (state != Z_STREAM_END) {
-    printerror("[ZLIB] Expected Z_STREAM_END.");
-    return 1;
+  if (magic == CompileFourCC("TOCL") || magic == CompileFourCC("TOCB")) {
+    printline("TOC detected.");
+    return PackTOC(fle);
   }
 
-  compressedStream.resize(infstream.total_out);
-  wr->WriteContainer(compressedStream);
-
-  return 0;
+  return ExtractArchive(fle);
 }
 
-struct SARCPacker {
-  enum SARCVersion { V2 = 2, V3 = 3 };
-
-  void Create(BinWritter &out, const DirectoryScanner::storage_type &files,
-              SARCVersion ver, const TSTRING &dir) {
-    std::unique_ptr<SARC> sarcInstance;
-
-    if (ver == V2)
-      sarcInstance = std::unique_ptr<SARC>(new SARC2());
-    else
-      sarcInstance = std::unique_ptr<SARC>(new SARC3());
-
-    size_t maxSize = 0;
+static int ListArchive(const TSTRING &path, std::string &result) {
+  ArchiveImage archive;
 
-    for (auto &f : files) {
-      bool external = false;
+  if (int status = archive.Load(path))
+    return status;
 
-      if (f[f.size() - 2] == ' ' && f[f.size() - 1] == 'E') {
-        external = true;
-      }
+  static const char *compressionNames[] = {"none", "zlib", "aaf"};
+  const SARC &sarc = *archive.sarc;
+  const size_t numFiles = sarc.NumFiles();
 
-      TSTRING cFleName(f.cbegin(), f.cend() - (external ? 2 : 0));
+  result += ",\"version\":" + std::to_string(sarc.GetVersion()) +
+            ",\"compression\":\"" + compressionNames[archive.compression] +
+            "\",\"files\":[";
 
-      if (settings.IsExcluded(cFleName))
-        continue;
+  for (size_t f = 0; f < numFiles; f++) {
+    const size_t offset = sarc.FileOffset(f);
 
-      BinReader rd(cFleName);
+    if (f)
+      result += ',';
 
-      if (!rd.IsValid()) {
-        printerror("Cannot open: ", << cFleName);
-        continue;
-      }
+    result += "{\"name\":\"" + JSONEscape(sarc.FileName(f)) +
+              "\",\"offset\":" + std::to_string(offset) +
+              ",\"size\":" + std::to_string(sarc.FileSize(f));
 
-      const size_t fleSize = rd.GetSize();
+    if (!offset)
+      result += ",\"external\":true";
 
-      if (fleSize > maxSize)
-        maxSize = fleSize;
+    result += '}';
+  }
 
-      const TCHAR lastDirChar = *std::prev(dir.end());
-      const int additionalDirSize =
-          lastDirChar == '/' || lastDirChar == '\\' ? 0 : 1;
+  result += ']';
 
-      std::string localFilePath =
-          esString(cFleName.substr(dir.size() + additionalDirSize));
+  return 0;
+}
 
-      sarcInstance->AddFileEntry(localFilePath, fleSize, external);
-    }
+// Reads all file data, AAF blocks are inflated once in offset order.
+static int VerifyArchive(const TSTRING &path, std::string &result) {
+  ArchiveImage archive;
 
-    sarcInstance->Write(&out);
-    std::string tempBuffer;
-    tempBuffer.resize(maxSize);
+  if (int status = archive.Load(path))
+    return status;
 
-    for (auto &f : files) {
-      if ((f[f.size() - 2] == ' ' && f[f.size() - 1] == 'E') ||
-          settings.IsExcluded(f))
-        continue;
+  const SARC &sarc = *archive.sarc;
+  const size_t numFiles = sarc.NumFiles();
+  std::vector<size_t> order;
 
-      BinReader rd(f);
+  for (size_t f = 0; f < numFiles; f++)
+    if (sarc.FileOffset(f))
+      order.push_back(f);
 
-      if (!rd.IsValid())
-        continue;
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return sarc.FileOffset(a) < sarc.FileOffset(b);
+  });
 
-      rd.ReadContainer(tempBuffer, rd.GetSize());
-      out.ApplyPadding();
-      out.WriteContainer(tempBuffer);
-    }
-  }
+  BufferPool::Buffer buffer = BufferPool::Acquire(COPY_CHUNK_SIZE);
+  size_t numBytes = 0;
+  size_t numFailed = 0;
 
-  void Scan(BinWritter &out, const TSTRING &dir, SARCVersion ver) {
-    DirectoryScanner ds;
-    ds.Scan(dir);
-    Create(out, ds.Files(), ver, dir);
+  if (!buffer) {
+    printerror("Cannot allocate copy buffer.");
+    return 2;
   }
 
-  int FromTOC(std::istream &str, BinWritter &out, const TSTRING &dir) {
-    std::string cLine;
-    std::getline(str, cLine);
-    int ver = atohLUT[cLine[4]];
-    SARC::CompressionType cType = SARC::C_NONE;
+  for (auto f : order) {
+    const size_t offset = sarc.FileOffset(f);
+    const size_t size = sarc.FileSize(f);
 
-    if (cLine[5] == 'C')
-      cType = SARC::C_ZLIB;
-    else if (cLine[5] == 'A')
-      cType = SARC::C_AAF;
-    else if (cLine[5] != 'U') {
-      printwarning("[TOC] Unexpected compression token: ", << cLine[5]);
+    // Reads beyond zlib stream end fail instead
+    if (offset + size < offset || (archive.compression != SARC::C_ZLIB &&
+                                   offset + size > archive.imageSize)) {
+      printerror("File data out of bounds: ", << sarc.FileName(f).c_str());
+      numFailed++;
+      continue;
     }
 
-    if (ver < 2 || ver > 3) {
-      printerror("[TOC] Unknown version!");
-      return 1;
-    }
+    for (size_t cPos = 0; cPos < size;) {
+      const size_t toRead = std::min(size - cPos, COPY_CHUNK_SIZE);
 
-    DirectoryScanner::storage_type files;
+      if (!archive.ReadImage(offset + cPos, buffer.Data(), toRead)) {
+        printerror("Cannot read file data: ", << sarc.FileName(f).c_str());
+        numFailed++;
+        break;
+      }
 
-    while (std::getline(str, cLine), cLine.size()) {
-      files.push_back(dir + static_cast<TSTRING>(esString(cLine)));
+      cPos += toRead;
     }
 
-    if (cType == SARC::C_NONE) {
-      Create(out, files, static_cast<SARCVersion>(ver), dir);
-    } else {
-      std::stringstream ms;
-      BinWritter wr(ms);
-
-      Create(wr, files, static_cast<SARCVersion>(ver), dir);
-
-      std::string rBuffer = ms.str();
-
-      ms.str("");
-
-      if (cType == SARC::C_AAF) {
-        AAF aaf;
+    numBytes += size;
+  }
 
-        if (aaf.Write(&out, &rBuffer[0], rBuffer.size()))
-          return 2;
-      } else {
-        if (CompressArchive(&out, &rBuffer[0], rBuffer.size()))
-          return 2;
-      }
-    }
+  result += ",\"files\":" + std::to_string(numFiles) +
+            ",\"bytes\":" + std::to_string(numBytes) +
+            ",\"failed\":" + std::to_string(numFailed);
 
-    return 0;
-  }
-};
+  return numFailed ? 3 : 0;
+}
 
-int FileExtractArchive(BinReader *rd, const TCHAR *file,
-                       SARC::CompressionType compType) {
-  SARC *SARCInstance = new SARC2();
-  int resltld = SARCInstance->Load(rd);
+static int BatchHandler(const BatchJob &job, std::string &result) {
+  const std::string &op = job.Get("op");
+  const std::string &path = job.Get("path");
 
-  if (resltld == 1) {
+  if (path.empty()) {
+    result += ",\"message\":\"Missing path\"";
     return 1;
-  } else if (resltld == 2) {
-    rd->Seek(0);
-    delete SARCInstance;
-    SARCInstance = new SARC3();
-    resltld = SARCInstance->Load(rd);
   }
 
-  if (resltld)
-    return 1;
+  const TSTRING tPath = esString(path);
 
-  printline("SARC V", << SARCInstance->GetVersion() << " detected.");
+  if (op == "extract")
+    return ExtractArchive(tPath);
+  else if (op == "pack")
+    return PackTOC(tPath);
+  else if (op == "list")
+    return ListArchive(tPath, result);
+  else if (op == "verify")
+    return VerifyArchive(tPath, result);
 
-  SARCInstance->ExtractFiles(rd, file, compType);
+  result += ",\"message\":\"Unknown op\"";
 
-  return 0;
+  return 1;
 }
 
-void FilehandleITFC(const _TCHAR *fle) {
-  printline("Loading Archive: ", << fle);
-  TSTRING infile = fle;
-  BinReader rd(infile);
-
-  if (!rd.IsValid()) {
-    printline("Could not load file.");
-    return;
-  }
-
-  int magic;
-  rd.Read(magic);
-  rd.Seek(0);
+// Results are written into stdout in batch mode, log goes to stderr
+static int ErrorPrint(const wchar_t *format, ...) {
+  va_list args;
+  va_start(args, format);
+  const int retVal = vfwprintf(stderr, format, args);
+  va_end(args);
 
-  if (magic == AAF::ID) {
-    printline("AAF detected.");
-    AAF AAFInstance;
-    int resltld = AAFInstance.Load(&rd);
-
-    if (resltld == 3) {
-      printerror("Corrupted AAF file!");
-      return;
-    } else if (resltld == 2) {
-      printerror("Invalid AAF file!");
-      return;
-    }
-
-    std::stringstream ss;
-    AAFInstance.GetNewStream(&ss);
-    rd.SetStream(ss);
-
-    FileExtractArchive(&rd, fle, SARC::C_AAF);
-  } else if (magic == 4) {
-    FileExtractArchive(&rd, fle, SARC::C_NONE);
-  } else if (magic == CompileFourCC("TOCL")) {
-    printline("TOC detected.");
-    TFileInfo fInf(infile);
-    TSTRING aFile = fInf.GetPath() + fInf.GetFileName();
-    printline("Creating archive: ", << aFile);
-    SARCPacker pck;
-    BinWritter wr(aFile);
-    std::istream dummy(0);
-    rd.SetStream(dummy);
-    std::ifstream textStream(infile);
-
-    if (!wr.IsValid() || pck.FromTOC(textStream, wr, fInf.GetPath())) {
-      printerror("Cannot create archive!");
-      textStream.close();
-      return;
-    }
-
-    textStream.close();
-
-    printline("Archive created.");
-  } else if (static_cast<uchar>(magic) == 0x78) {
-    const size_t fileSize = rd.GetSize();
-    std::string buffer;
-    std::string oBuffer;
-    std::stringstream ss;
-    BinWritter lwr(ss);
-    buffer.resize(fileSize < (AAF::MAX_BLOCK_SIZE / 2)
-                      ? fileSize
-                      : (AAF::MAX_BLOCK_SIZE / 2));
-    oBuffer.resize(AAF::MAX_BLOCK_SIZE / 2);
-    rd.ReadContainer(buffer, buffer.size());
-
-    z_stream infstream;
-    infstream.zalloc = Z_NULL;
-    infstream.zfree = Z_NULL;
-    infstream.opaque = Z_NULL;
-    infstream.avail_in = buffer.size();
-    infstream.next_in = reinterpret_cast<Bytef *>(&buffer[0]);
-    infstream.avail_out = oBuffer.size();
-    infstream.next_out = reinterpret_cast<Bytef *>(&oBuffer[0]);
-    inflateInit2(&infstream, MAX_WBITS);
-    int state = 0;
-
-    while (state = inflate(&infstream, Z_SYNC_FLUSH), !state) {
-      if (!infstream.avail_in) {
-        rd.ReadContainer(buffer, buffer.size());
-        infstream.avail_in = buffer.size();
-        infstream.next_in = reinterpret_cast<Bytef *>(&buffer[0]);
-      }
+  return retVal;
+}
 
-      if (!infstream.avail_out) {
-        lwr.WriteContainer(oBuffer);
-        infstream.avail_out = oBuffer.size();
-        infstream.next_out = reinterpret_cast<Bytef *>(&oBuffer[0]);
-      }
-    }
+static void PrintStats() {
+  const BufferPool::Stats poolStats = BufferPool::GetStats();
+  printline("Buffer pool: ", << poolStats.allocations << " allocations, "
+                             << poolStats.allocationsAvoided
+                             << " avoided, peak size: "
+                             << (poolStats.peakPoolSize >> 20) << " MB");
+
+  if (settings._store.IsOpen()) {
+    const ContentStore::Stats storeStats = settings._store.GetStats();
+    printline("Content store: ",
+              << storeStats.numStored << " files stored ("
+              << (storeStats.bytesStored >> 20) << " MB), "
+              << storeStats.numReused << " reused ("
+              << (storeStats.bytesReused >> 20) << " MB)");
+  }
 
-    if (state != Z_STREAM_END) {
-      printerror("[ZLIB] Expected Z_STREAM_END.");
-      return;
-    }
+  const SourceCache::Stats cacheStats = SourceCache::Get().GetStats();
 
-    oBuffer.resize((AAF::MAX_BLOCK_SIZE / 2) - infstream.avail_out);
-    lwr.WriteContainer(oBuffer);
-    inflateEnd(&infstream);
-    BinReader lrd(ss);
-    FileExtractArchive(&lrd, fle, SARC::C_ZLIB);
-  } else {
-    printerror("Unknown file type!");
+  if (cacheStats.numShared) {
+    printline("Source cache: ",
+              << cacheStats.numReads << " files read ("
+              << (cacheStats.bytesRead >> 20) << " MB), "
+              << cacheStats.numShared << " shared ("
+              << (cacheStats.bytesShared >> 20) << " MB)");
   }
 }
 
@@ -882,13 +777,19 @@ struct SarcQueueTraits {
 
 int _tmain(int argc, _TCHAR *argv[]) {
   setlocale(LC_ALL, "");
-  printer.AddPrinterFunction(wprintf);
+  const bool batchMode = argc > 1 && argv[1][0] == '-' && argv[1][1] == 'd';
+
+  if (batchMode) {
+    printer.AddPrinterFunction(ErrorPrint);
+  } else {
+    printer.AddPrinterFunction(wprintf);
 
-  printline(SmallArchive_DESC " V" SmallArchive_VERSION
-                              "\n" SmallArchive_COPYRIGHT
-                              "\nSimply drag'n'drop files into "
-                              "application or use as " SmallArchive_PRODUCT_NAME
-                              " file1 file2 ...\n");
+    printline(SmallArchive_DESC " V" SmallArchive_VERSION
+                                "\n" SmallArchive_COPYRIGHT
+                                "\nSimply drag'n'drop files into "
+                                "application or use as " SmallArchive_PRODUCT_NAME
+                                " file1 file2 ...\n");
+  }
 
   TFileInfo configInfo(*argv);
   const TSTRING configName =
@@ -896,6 +797,22 @@ int _tmain(int argc, _TCHAR *argv[]) {
 
   settings.FromXML(configName);
   settings.Process();
+  BufferPool::UseHugePages(settings.Use_huge_pages);
+
+  if (batchMode) {
+    if (settings.Generate_Log)
+      settings.CreateLog(configInfo.GetPath() + configInfo.GetFileName());
+
+    printer.PrintThreadID(true);
+    const int result =
+        RunBatch(BatchHandler, argc > 2 ? argv[2] : TSTRING(),
+                 std::max(std::thread::hardware_concurrency(), 1u));
+    printer.PrintThreadID(false);
+
+    PrintStats();
+
+    return result;
+  }
 
   pugi::xml_document doc = {};
   settings.ToXML(doc);
@@ -930,7 +847,12 @@ int _tmain(int argc, _TCHAR *argv[]) {
         return 2;
       }
 
-      pck.Scan(wr, argv[4], static_cast<SARCPacker::SARCVersion>(version));
+      if (pck.Scan(wr, argv[4],
+                   static_cast<SARCPacker::SARCVersion>(version))) {
+        printerror("Cannot create archive!");
+        return 3;
+      }
+
       printline("Archive created.");
 
       return 0;
@@ -950,26 +872,45 @@ int _tmain(int argc, _TCHAR *argv[]) {
         return 2;
       }
 
-      std::stringstream ms;
-      BinWritter wr(ms);
+      if (pck.Compressed(wrout, ScanDirectory(argv[4], settings._filter),
+                         static_cast<SARCPacker::SARCVersion>(version),
+                         argv[4],
+                         argv[1][1] == 'f' ? SARC::C_AAF : SARC::C_ZLIB)) {
+        printerror("Cannot create archive!");
+        return 3;
+      }
 
-      pck.Scan(wr, argv[4], static_cast<SARCPacker::SARCVersion>(version));
+      printline("Archive created.");
 
-      std::string rBuffer = ms.str();
+      return 0;
+    } else if (argv[1][1] == 'm' && argc > 3) {
+      printline("Merging archives into: ", << argv[2]);
 
-      ms.str("");
+      if (MergeArchives(argv[2],
+                        std::vector<TSTRING>(argv + 3, argv + argc),
+                        settings._mergePriority)) {
+        printerror("Cannot merge archives!");
+        return 3;
+      }
 
-      if (argv[1][1] == 'f') {
-        AAF aaf;
+      printline("Archive created.");
 
-        if (aaf.Write(&wrout, &rBuffer[0], rBuffer.size()))
-          return 3;
-      } else {
-        if (CompressArchive(&wrout, &rBuffer[0], rBuffer.size()))
-          return 3;
+      return 0;
+    } else if (argv[1][1] == 's' && argc > 3) {
+      const std::string maxSizeParam = esString(argv[3]);
+      const int maxSize = atoi(maxSizeParam.c_str());
+
+      if (maxSize <= 0) {
+        printerror("Invalid max size parameter!");
+        return 2;
       }
 
-      printline("Archive created.");
+      if (SplitArchive(argv[2], static_cast<size_t>(maxSize) << 20)) {
+        printerror("Cannot split archive!");
+        return 3;
+      }
+
+      printline("Archive split.");
 
       return 0;
     }
@@ -985,6 +926,9 @@ int _tmain(int argc, _TCHAR *argv[]) {
 
   printer.PrintThreadID(true);
   RunThreadedQueue(sarQue);
+  printer.PrintThreadID(false);
+
+  PrintStats();
 
   // getchar();
   return 0;
@@ -0,0 +1,789 @@
+/*      BlockDecoder
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "BlockDecoder.hpp"
+#include "formats/DDS.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+typedef uint8_t pixel_block[16][4];
+typedef void (*block_func)(const uint8_t *src, pixel_block &pixels);
+
+// Partitions of 2 subsets, bit per pixel
+static const uint16_t partitions2[64] = {
+    0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80,
+    0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+    0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE,
+    0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+    0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A,
+    0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+    0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C,
+    0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22};
+
+// Partitions of 3 subsets, 2 bits per pixel
+static const uint32_t partitions3[64] = {
+    0xAA685050, 0x6A5A5040, 0x5A5A4200, 0x5450A0A8, 0xA5A50000, 0xA0A05050,
+    0x5555A0A0, 0x5A5A5050, 0xAA550000, 0xAA555500, 0xAAAA5500, 0x90909090,
+    0x94949494, 0xA4A4A4A4, 0xA9A59450, 0x2A0A4250, 0xA5945040, 0x0A425054,
+    0xA5A5A500, 0x55A0A0A0, 0xA8A85454, 0x6A6A4040, 0xA4A45000, 0x1A1A0500,
+    0x0050A4A4, 0xAAA59090, 0x14696914, 0x69691400, 0xA08585A0, 0xAA821414,
+    0x50A4A450, 0x6A5A0200, 0xA9A58000, 0x5090A0A8, 0xA8A09050, 0x24242424,
+    0x00AA5500, 0x24924924, 0x24499224, 0x50A50A50, 0x500AA550, 0xAAAA4444,
+    0x66660000, 0xA5A0A5A0, 0x50A050A0, 0x69286928, 0x44AAAA44, 0x66666600,
+    0xAA444444, 0x54A854A8, 0x95809580, 0x96969600, 0xA85454A8, 0x80959580,
+    0xAA141414, 0x96960000, 0xAAAA1414, 0xA05050A0, 0xA0A5A5A0, 0x96000000,
+    0x40804080, 0xA9A8A9A8, 0xAAAAAA44, 0x2A4A5254};
+
+// Anchor pixel of second subset
+static const uint8_t anchors2[64] = {
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 2,  8,  2,  2,  8,  8,  15, 2,  8,  2,  2,  8,  8,  2,  2,
+    15, 15, 6,  8,  2,  8,  15, 15, 2,  8,  2,  2,  2,  15, 15, 6,
+    6,  2,  6,  8,  15, 15, 2,  2,  15, 15, 15, 15, 15, 2,  2,  15};
+
+// Anchor pixels of second and third subset
+static const uint8_t anchors3[2][64] = {
+    {3,  3,  15, 15, 8,  3,  15, 15, 8,  8,  6,  6,  6,  5,  3,  3,
+     3,  3,  8,  15, 3,  3,  6,  10, 5,  8,  8,  6,  8,  5,  15, 15,
+     8,  15, 3,  5,  6,  10, 8,  15, 15, 3,  15, 5,  15, 15, 15, 15,
+     3,  15, 5,  5,  5,  8,  5,  10, 5,  10, 8,  13, 15, 12, 3,  3},
+    {15, 8,  8,  3,  15, 15, 3,  8,  15, 15, 15, 15, 15, 15, 15, 8,
+     15, 8,  15, 3,  15, 8,  15, 8,  3,  15, 6,  10, 15, 15, 10, 8,
+     15, 3,  15, 10, 10, 8,  9,  10, 6,  15, 8,  15, 3,  6,  6,  8,
+     15, 3,  15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 3,  15, 15, 8}};
+
+static const int weights2[4] = {0, 21, 43, 64};
+static const int weights3[8] = {0, 9, 18, 27, 37, 46, 55, 64};
+static const int weights4[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                 34, 38, 43, 47, 51, 55, 60, 64};
+
+static const int *Weights(int numBits) {
+  return numBits == 2 ? weights2 : numBits == 3 ? weights3 : weights4;
+}
+
+// LSB first reader of 128 bit block
+class BitReader {
+public:
+  BitReader(const uint8_t *src) {
+    memcpy(&low, src, 8);
+    memcpy(&high, src + 8, 8);
+  }
+
+  uint32_t Read(int count) {
+    if (!count)
+      return 0;
+
+    const uint64_t value =
+        pos < 64 ? (low >> pos) | (pos ? high << (64 - pos) : 0)
+                 : high >> (pos - 64);
+    pos += count;
+
+    return static_cast<uint32_t>(value & ((1ULL << count) - 1));
+  }
+
+  int Position() const { return pos; }
+
+private:
+  uint64_t low;
+  uint64_t high;
+  int pos = 0;
+};
+
+static int Subset(int numSubsets, int partition, int pixel) {
+  if (numSubsets == 2)
+    return (partitions2[partition] >> pixel) & 1;
+
+  if (numSubsets == 3)
+    return (partitions3[partition] >> (pixel * 2)) & 3;
+
+  return 0;
+}
+
+static bool IsAnchor(int numSubsets, int partition, int pixel) {
+  if (!pixel)
+    return true;
+
+  if (numSubsets == 2)
+    return pixel == anchors2[partition];
+
+  if (numSubsets == 3)
+    return pixel == anchors3[0][partition] || pixel == anchors3[1][partition];
+
+  return false;
+}
+
+static void From565(uint16_t value, int *color) {
+  const int r = value >> 11;
+  const int g = (value >> 5) & 0x3F;
+  const int b = value & 0x1F;
+  color[0] = r << 3 | r >> 2;
+  color[1] = g << 2 | g >> 4;
+  color[2] = b << 3 | b >> 2;
+  color[3] = 0xFF;
+}
+
+static void DecodeColorBlock(const uint8_t *src, pixel_block &pixels,
+                             bool fourColorsOnly) {
+  uint16_t color0, color1;
+  uint32_t indices;
+  memcpy(&color0, src, 2);
+  memcpy(&color1, src + 2, 2);
+  memcpy(&indices, src + 4, 4);
+
+  int palette[4][4];
+  From565(color0, palette[0]);
+  From565(color1, palette[1]);
+
+  if (color0 > color1 || fourColorsOnly) {
+    for (int c = 0; c < 4; c++) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+  } else {
+    for (int c = 0; c < 4; c++) {
+      palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+      palette[3][c] = 0;
+    }
+  }
+
+  for (int p = 0; p < 16; p++)
+    for (int c = 0; c < 4; c++)
+      pixels[p][c] = static_cast<uint8_t>(palette[(indices >> (p * 2)) & 3][c]);
+}
+
+static void DecodeAlphaBlock(const uint8_t *src, pixel_block &pixels,
+                             int channel) {
+  const int alpha0 = src[0];
+  const int alpha1 = src[1];
+  int palette[8] = {alpha0, alpha1};
+
+  if (alpha0 > alpha1) {
+    for (int j = 2; j < 8; j++)
+      palette[j] = ((8 - j) * alpha0 + (j - 1) * alpha1) / 7;
+  } else {
+    for (int j = 2; j < 6; j++)
+      palette[j] = ((6 - j) * alpha0 + (j - 1) * alpha1) / 5;
+
+    palette[6] = 0;
+    palette[7] = 0xFF;
+  }
+
+  uint64_t indices = 0;
+  memcpy(&indices, src + 2, 6);
+
+  for (int p = 0; p < 16; p++)
+    pixels[p][channel] =
+        static_cast<uint8_t>(palette[(indices >> (p * 3)) & 7]);
+}
+
+static void DecodeSignedAlphaBlock(const uint8_t *src, pixel_block &pixels,
+                                   int channel) {
+  const int alpha0 = std::max(static_cast<int8_t>(src[0]), int8_t(-127));
+  const int alpha1 = std::max(static_cast<int8_t>(src[1]), int8_t(-127));
+  int palette[8] = {alpha0, alpha1};
+
+  if (alpha0 > alpha1) {
+    for (int j = 2; j < 8; j++)
+      palette[j] = ((8 - j) * alpha0 + (j - 1) * alpha1) / 7;
+  } else {
+    for (int j = 2; j < 6; j++)
+      palette[j] = ((6 - j) * alpha0 + (j - 1) * alpha1) / 5;
+
+    palette[6] = -127;
+    palette[7] = 127;
+  }
+
+  uint64_t indices = 0;
+  memcpy(&indices, src + 2, 6);
+
+  for (int p = 0; p < 16; p++)
+    pixels[p][channel] = static_cast<uint8_t>(
+        (palette[(indices >> (p * 3)) & 7] + 127) * 255 / 254);
+}
+
+static void DecodeBC1(const uint8_t *src, pixel_block &pixels) {
+  DecodeColorBlock(src, pixels, false);
+}
+
+static void DecodeBC2(const uint8_t *src, pixel_block &pixels) {
+  DecodeColorBlock(src + 8, pixels, true);
+
+  for (int p = 0; p < 16; p++)
+    pixels[p][3] = static_cast<uint8_t>(((src[p / 2] >> (p % 2 * 4)) & 0xF) *
+                                        17);
+}
+
+static void DecodeBC3(const uint8_t *src, pixel_block &pixels) {
+  DecodeColorBlock(src + 8, pixels, true);
+  DecodeAlphaBlock(src, pixels, 3);
+}
+
+static void DecodeBC4(const uint8_t *src, pixel_block &pixels) {
+  DecodeAlphaBlock(src, pixels, 0);
+
+  for (auto &p : pixels) {
+    p[1] = p[2] = p[0];
+    p[3] = 0xFF;
+  }
+}
+
+static void DecodeBC4S(const uint8_t *src, pixel_block &pixels) {
+  DecodeSignedAlphaBlock(src, pixels, 0);
+
+  for (auto &p : pixels) {
+    p[1] = p[2] = p[0];
+    p[3] = 0xFF;
+  }
+}
+
+static void DecodeBC5(const uint8_t *src, pixel_block &pixels) {
+  DecodeAlphaBlock(src, pixels, 0);
+  DecodeAlphaBlock(src + 8, pixels, 1);
+
+  for (auto &p : pixels) {
+    p[2] = 0;
+    p[3] = 0xFF;
+  }
+}
+
+static void DecodeBC5S(const uint8_t *src, pixel_block &pixels) {
+  DecodeSignedAlphaBlock(src, pixels, 0);
+  DecodeSignedAlphaBlock(src + 8, pixels, 1);
+
+  for (auto &p : pixels) {
+    p[2] = 0;
+    p[3] = 0xFF;
+  }
+}
+
+// BC6H endpoint fields, channel * 4 + endpoint, then partition
+enum BC6HField { RW, RX, RY, RZ, GW, GX, GY, GZ, BW, BX, BY, BZ, D };
+
+// Bits from..to of field, in stream order
+struct BC6HBits {
+  uint8_t field;
+  uint8_t to;
+  uint8_t from;
+};
+
+struct BC6HMode {
+  int numSubsets;
+  bool transformed;
+  int endpointBits;
+  int deltaBits[3];
+  BC6HBits layout[24];
+};
+
+static const BC6HMode bc6hModes[14] = {
+    {2, true, 10, {5, 5, 5},
+     {{GY, 4, 4}, {BY, 4, 4}, {BZ, 4, 4}, {RW, 9, 0}, {GW, 9, 0},
+      {BW, 9, 0}, {RX, 4, 0}, {GZ, 4, 4}, {GY, 3, 0}, {GX, 4, 0},
+      {BZ, 0, 0}, {GZ, 3, 0}, {BX, 4, 0}, {BZ, 1, 1}, {BY, 3, 0},
+      {RY, 4, 0}, {BZ, 2, 2}, {RZ, 4, 0}, {BZ, 3, 3}, {D, 4, 0}}},
+    {2, true, 7, {6, 6, 6},
+     {{GY, 5, 5}, {GZ, 4, 4}, {GZ, 5, 5}, {RW, 6, 0}, {BZ, 0, 0},
+      {BZ, 1, 1}, {BY, 4, 4}, {GW, 6, 0}, {BY, 5, 5}, {BZ, 2, 2},
+      {GY, 4, 4}, {BW, 6, 0}, {BZ, 3, 3}, {BZ, 5, 5}, {BZ, 4, 4},
+      {RX, 5, 0}, {GY, 3, 0}, {GX, 5, 0}, {GZ, 3, 0}, {BX, 5, 0},
+      {BY, 3, 0}, {RY, 5, 0}, {RZ, 5, 0}, {D, 4, 0}}},
+    {2, true, 11, {5, 4, 4},
+     {{RW, 9, 0}, {GW, 9, 0}, {BW, 9, 0}, {RX, 4, 0}, {RW, 10, 10},
+      {GY, 3, 0}, {GX, 3, 0}, {GW, 10, 10}, {BZ, 0, 0}, {GZ, 3, 0},
+      {BX, 3, 0}, {BW, 10, 10}, {BZ, 1, 1}, {BY, 3, 0}, {RY, 4, 0},
+      {BZ, 2, 2}, {RZ, 4, 0}, {BZ, 3, 3}, {D, 4, 0}}},
+    {2, true, 11, {4, 5, 4},
+     {{RW, 9, 0}, {GW, 9, 0}, {BW, 9, 0}, {RX, 3, 0}, {RW, 10, 10},
+      {GZ, 4, 4}, {GY, 3, 0}, {GX, 4, 0}, {GW, 10, 10}, {GZ, 3, 0},
+      {BX, 3, 0}, {BW, 10, 10}, {BZ, 1, 1}, {BY, 3, 0}, {RY, 3, 0},
+      {BZ, 0, 0}, {BZ, 2, 2}, {RZ, 3, 0}, {GY, 4, 4}, {BZ, 3, 3},
+      {D, 4, 0}}},
+    {2, true, 11, {4, 4, 5},
+     {{RW, 9, 0}, {GW, 9, 0}, {BW, 9, 0}, {RX, 3, 0}, {RW, 10, 10},
+      {BY, 4, 4}, {GY, 3, 0}, {GX, 3, 0}, {GW, 10, 10}, {BZ, 0, 0},
+      {GZ, 3, 0}, {BX, 4, 0}, {BW, 10, 10}, {BY, 3, 0}, {RY, 3, 0},
+      {BZ, 1, 1}, {BZ, 2, 2}, {RZ, 3, 0}, {BZ, 4, 4}, {BZ, 3, 3},
+      {D, 4, 0}}},
+    {2, true, 9, {5, 5, 5},
+     {{RW, 8, 0}, {BY, 4, 4}, {GW, 8, 0}, {GY, 4, 4}, {BW, 8, 0},
+      {BZ, 4, 4}, {RX, 4, 0}, {GZ, 4, 4}, {GY, 3, 0}, {GX, 4, 0},
+      {BZ, 0, 0}, {GZ, 3, 0}, {BX, 4, 0}, {BZ, 1, 1}, {BY, 3, 0},
+      {RY, 4, 0}, {BZ, 2, 2}, {RZ, 4, 0}, {BZ, 3, 3}, {D, 4, 0}}},
+    {2, true, 8, {6, 5, 5},
+     {{RW, 7, 0}, {GZ, 4, 4}, {BY, 4, 4}, {GW, 7, 0}, {BZ, 2, 2},
+      {GY, 4, 4}, {BW, 7, 0}, {BZ, 3, 3}, {BZ, 4, 4}, {RX, 5, 0},
+      {GY, 3, 0}, {GX, 4, 0}, {BZ, 0, 0}, {GZ, 3, 0}, {BX, 4, 0},
+      {BZ, 1, 1}, {BY, 3, 0}, {RY, 5, 0}, {RZ, 5, 0}, {D, 4, 0}}},
+    {2, true, 8, {5, 6, 5},
+     {{RW, 7, 0}, {BZ, 0, 0}, {BY, 4, 4}, {GW, 7, 0}, {GY, 5, 5},
+      {GY, 4, 4}, {BW, 7, 0}, {GZ, 5, 5}, {BZ, 4, 4}, {RX, 4, 0},
+      {GZ, 4, 4}, {GY, 3, 0}, {GX, 5, 0}, {GZ, 3, 0}, {BX, 4, 0},
+      {BZ, 1, 1}, {BY, 3, 0}, {RY, 4, 0}, {BZ, 2, 2}, {RZ, 4, 0},
+      {BZ, 3, 3}, {D, 4, 0}}},
+    {2, true, 8, {5, 5, 6},
+     {{RW, 7, 0}, {BZ, 1, 1}, {BY, 4, 4}, {GW, 7, 0}, {BY, 5, 5},
+      {GY, 4, 4}, {BW, 7, 0}, {BZ, 5, 5}, {BZ, 4, 4}, {RX, 4, 0},
+      {GZ, 4, 4}, {GY, 3, 0}, {GX, 4, 0}, {BZ, 0, 0}, {GZ, 3, 0},
+      {BX, 5, 0}, {BY, 3, 0}, {RY, 4, 0}, {BZ, 2, 2}, {RZ, 4, 0},
+      {BZ, 3, 3}, {D, 4, 0}}},
+    {2, false, 6, {6, 6, 6},
+     {{RW, 5, 0}, {GZ, 4, 4}, {BZ, 0, 0}, {BZ, 1, 1}, {BY, 4, 4},
+      {GW, 5, 0}, {GY, 5, 5}, {BY, 5, 5}, {BZ, 2, 2}, {GY, 4, 4},
+      {BW, 5, 0}, {GZ, 5, 5}, {BZ, 3, 3}, {BZ, 5, 5}, {BZ, 4, 4},
+      {RX, 5, 0}, {GY, 3, 0}, {GX, 5, 0}, {GZ, 3, 0}, {BX, 5, 0},
+      {BY, 3, 0}, {RY, 5, 0}, {RZ, 5, 0}, {D, 4, 0}}},
+    {1, false, 10, {10, 10, 10},
+     {{RW, 9, 0}, {GW, 9, 0}, {BW, 9, 0}, {RX, 9, 0}, {GX, 9, 0},
+      {BX, 9, 0}}},
+    {1, true, 11, {9, 9, 9},
+     {{RW, 9, 0}, {GW, 9, 0}, {BW, 9, 0}, {RX, 8, 0}, {RW, 10, 10},
+      {GX, 8, 0}, {GW, 10, 10}, {BX, 8, 0}, {BW, 10, 10}}},
+    {1, true, 12, {8, 8, 8},
+     {{RW, 9, 0}, {GW, 9, 0}, {BW, 9, 0}, {RX, 7, 0}, {RW, 10, 11},
+      {GX, 7, 0}, {GW, 10, 11}, {BX, 7, 0}, {BW, 10, 11}}},
+    {1, true, 16, {4, 4, 4},
+     {{RW, 9, 0}, {GW, 9, 0}, {BW, 9, 0}, {RX, 3, 0}, {RW, 10, 15},
+      {GX, 3, 0}, {GW, 10, 15}, {BX, 3, 0}, {BW, 10, 15}}},
+};
+
+// Mode index by 5 bit mode value, -1 is reserved
+static int BC6HModeIndex(uint32_t modeValue) {
+  switch (modeValue) {
+  case 0x02:
+    return 2;
+  case 0x06:
+    return 3;
+  case 0x0A:
+    return 4;
+  case 0x0E:
+    return 5;
+  case 0x12:
+    return 6;
+  case 0x16:
+    return 7;
+  case 0x1A:
+    return 8;
+  case 0x1E:
+    return 9;
+  case 0x03:
+    return 10;
+  case 0x07:
+    return 11;
+  case 0x0B:
+    return 12;
+  case 0x0F:
+    return 13;
+  default:
+    return -1;
+  }
+}
+
+static int SignExtend(int value, int numBits) {
+  const int shift = 32 - numBits;
+  return static_cast<int>(static_cast<uint32_t>(value) << shift) >> shift;
+}
+
+static int BC6HUnquantize(int value, int numBits, bool isSigned) {
+  if (!isSigned) {
+    if (numBits >= 15 || !value)
+      return value;
+
+    if (value == (1 << numBits) - 1)
+      return 0xFFFF;
+
+    return ((value << 16) + 0x8000) >> numBits;
+  }
+
+  if (numBits >= 16)
+    return value;
+
+  const bool negative = value < 0;
+  int retVal = negative ? -value : value;
+
+  if (!retVal)
+    return 0;
+
+  if (retVal >= (1 << (numBits - 1)) - 1)
+    retVal = 0x7FFF;
+  else
+    retVal = ((retVal << 15) + 0x4000) >> (numBits - 1);
+
+  return negative ? -retVal : retVal;
+}
+
+// Interpolated value into half float bits, then into 0-255
+static uint8_t BC6HFinish(int value, bool isSigned) {
+  uint32_t half;
+
+  if (!isSigned) {
+    half = static_cast<uint32_t>((value * 31) >> 6);
+  } else {
+    value = value < 0 ? -(((-value) * 31) >> 5) : (value * 31) >> 5;
+    half = value < 0 ? 0x8000 | static_cast<uint32_t>(-value)
+                     : static_cast<uint32_t>(value);
+  }
+
+  if (half & 0x8000)
+    return 0;
+
+  const uint32_t exponent = half >> 10;
+  const uint32_t mantissa = half & 0x3FF;
+
+  // 1.0 and above
+  if (exponent >= 15)
+    return 0xFF;
+
+  const float unit = exponent ? (1024 + mantissa) / 1024.0f *
+                                    (1.0f / static_cast<float>(1 << (15 - exponent)))
+                              : mantissa / 16777216.0f;
+
+  return static_cast<uint8_t>(unit * 255.0f + 0.5f);
+}
+
+static void DecodeBC6H(const uint8_t *src, pixel_block &pixels,
+                       bool isSigned) {
+  BitReader reader(src);
+  const uint32_t shortMode = reader.Read(2);
+  const int modeIndex =
+      shortMode < 2 ? static_cast<int>(shortMode)
+                    : BC6HModeIndex(shortMode | reader.Read(3) << 2);
+
+  if (modeIndex < 0) {
+    memset(pixels, 0, sizeof(pixel_block));
+
+    for (auto &p : pixels)
+      p[3] = 0xFF;
+
+    return;
+  }
+
+  const BC6HMode &mode = bc6hModes[modeIndex];
+  int fields[13] = {};
+
+  for (auto &b : mode.layout) {
+    // Unused entries are zeroed, RW bit 0 is never alone
+    if (!b.to && !b.from && !b.field)
+      break;
+
+    const int step = b.to >= b.from ? 1 : -1;
+
+    for (int i = b.from;; i += step) {
+      fields[b.field] |= reader.Read(1) << i;
+
+      if (i == b.to)
+        break;
+    }
+  }
+
+  const int numEndpoints = mode.numSubsets * 2;
+  const int endpointMask = (1 << mode.endpointBits) - 1;
+  int endpoints[4][3];
+
+  for (int c = 0; c < 3; c++) {
+    int *values = fields + c * 4;
+
+    if (isSigned)
+      values[0] = SignExtend(values[0], mode.endpointBits);
+
+    for (int e = 1; e < numEndpoints; e++) {
+      if (mode.transformed) {
+        values[e] = SignExtend(values[e], mode.deltaBits[c]);
+        values[e] = (values[0] + values[e]) & endpointMask;
+      }
+
+      if (isSigned)
+        values[e] = SignExtend(values[e], mode.endpointBits);
+    }
+
+    for (int e = 0; e < numEndpoints; e++)
+      endpoints[e][c] =
+          BC6HUnquantize(values[e], mode.endpointBits, isSigned);
+  }
+
+  const int partition = fields[D];
+  const int indexBits = mode.numSubsets == 2 ? 3 : 4;
+  const int *weights = Weights(indexBits);
+
+  for (int p = 0; p < 16; p++) {
+    const int subset = Subset(mode.numSubsets, partition, p);
+    const int index =
+        reader.Read(indexBits - IsAnchor(mode.numSubsets, partition, p));
+    const int *endpoint0 = endpoints[subset * 2];
+    const int *endpoint1 = endpoints[subset * 2 + 1];
+
+    for (int c = 0; c < 3; c++)
+      pixels[p][c] = BC6HFinish((endpoint0[c] * (64 - weights[index]) +
+                                 endpoint1[c] * weights[index] + 32) >>
+                                    6,
+                                isSigned);
+
+    pixels[p][3] = 0xFF;
+  }
+}
+
+static void DecodeBC6HU(const uint8_t *src, pixel_block &pixels) {
+  DecodeBC6H(src, pixels, false);
+}
+
+static void DecodeBC6HS(const uint8_t *src, pixel_block &pixels) {
+  DecodeBC6H(src, pixels, true);
+}
+
+struct BC7Mode {
+  int numSubsets;
+  int partitionBits;
+  int rotationBits;
+  int indexSelectionBits;
+  int colorBits;
+  int alphaBits;
+  int endpointPBits;
+  int sharedPBits;
+  int indexBits;
+  int index2Bits;
+};
+
+static const BC7Mode bc7Modes[8] = {
+    {3, 4, 0, 0, 4, 0, 1, 0, 3, 0}, {2, 6, 0, 0, 6, 0, 0, 1, 3, 0},
+    {3, 6, 0, 0, 5, 0, 0, 0, 2, 0}, {2, 6, 0, 0, 7, 0, 1, 0, 2, 0},
+    {1, 0, 2, 1, 5, 6, 0, 0, 2, 3}, {1, 0, 2, 0, 7, 8, 0, 0, 2, 2},
+    {1, 0, 0, 0, 7, 7, 1, 0, 4, 0}, {2, 6, 0, 0, 5, 5, 1, 0, 2, 0}};
+
+static void DecodeBC7(const uint8_t *src, pixel_block &pixels) {
+  int modeIndex = 0;
+
+  while (modeIndex < 8 && !((src[0] >> modeIndex) & 1))
+    modeIndex++;
+
+  // Reserved mode
+  if (modeIndex == 8) {
+    memset(pixels, 0, sizeof(pixel_block));
+    return;
+  }
+
+  const BC7Mode &mode = bc7Modes[modeIndex];
+  BitReader reader(src);
+  reader.Read(modeIndex + 1);
+  const int partition = reader.Read(mode.partitionBits);
+  const int rotation = reader.Read(mode.rotationBits);
+  const int indexSelection = reader.Read(mode.indexSelectionBits);
+  const int numEndpoints = mode.numSubsets * 2;
+  int endpoints[6][4];
+
+  for (int c = 0; c < 3; c++)
+    for (int e = 0; e < numEndpoints; e++)
+      endpoints[e][c] = reader.Read(mode.colorBits);
+
+  for (int e = 0; e < numEndpoints; e++)
+    endpoints[e][3] = mode.alphaBits ? reader.Read(mode.alphaBits) : 0xFF;
+
+  int pBits[6] = {};
+
+  for (int e = 0; e < numEndpoints && mode.endpointPBits; e++)
+    pBits[e] = reader.Read(1);
+
+  for (int s = 0; s < mode.numSubsets && mode.sharedPBits; s++)
+    pBits[s * 2] = pBits[s * 2 + 1] = reader.Read(1);
+
+  const bool hasPBits = mode.endpointPBits || mode.sharedPBits;
+
+  for (int e = 0; e < numEndpoints; e++)
+    for (int c = 0; c < 4; c++) {
+      const int sourceBits = c < 3 ? mode.colorBits : mode.alphaBits;
+
+      if (!sourceBits)
+        continue;
+
+      const int numBits = sourceBits + hasPBits;
+      const int value = hasPBits ? endpoints[e][c] << 1 | pBits[e]
+                                 : endpoints[e][c];
+      endpoints[e][c] = value << (8 - numBits) | value >> (2 * numBits - 8);
+    }
+
+  int indices[16];
+  int indices2[16] = {};
+
+  for (int p = 0; p < 16; p++)
+    indices[p] =
+        reader.Read(mode.indexBits - IsAnchor(mode.numSubsets, partition, p));
+
+  for (int p = 0; p < 16 && mode.index2Bits; p++)
+    indices2[p] = reader.Read(mode.index2Bits - !p);
+
+  for (int p = 0; p < 16; p++) {
+    const int subset = Subset(mode.numSubsets, partition, p);
+    const int *endpoint0 = endpoints[subset * 2];
+    const int *endpoint1 = endpoints[subset * 2 + 1];
+    int colorBits = mode.indexBits, alphaBits = mode.indexBits;
+    int colorIndex = indices[p], alphaIndex = indices[p];
+
+    if (mode.index2Bits) {
+      if (indexSelection) {
+        colorBits = mode.index2Bits;
+        colorIndex = indices2[p];
+      } else {
+        alphaBits = mode.index2Bits;
+        alphaIndex = indices2[p];
+      }
+    }
+
+    const int colorWeight = Weights(colorBits)[colorIndex];
+    const int alphaWeight = Weights(alphaBits)[alphaIndex];
+
+    for (int c = 0; c < 4; c++) {
+      const int weight = c < 3 ? colorWeight : alphaWeight;
+      pixels[p][c] = static_cast<uint8_t>(
+          (endpoint0[c] * (64 - weight) + endpoint1[c] * weight + 32) >> 6);
+    }
+
+    if (rotation)
+      std::swap(pixels[p][3], pixels[p][rotation - 1]);
+  }
+}
+
+static bool DecodeUncompressed(const char *data, size_t dataSize, int width,
+                               int height, int dxgiFormat, std::string &rgba) {
+  int numChannels;
+  bool swapRB = false;
+
+  switch (dxgiFormat) {
+  case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+  case DXGI_FORMAT_R8G8B8A8_UNORM:
+  case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+    numChannels = 4;
+    break;
+  case DXGI_FORMAT_B8G8R8A8_TYPELESS:
+  case DXGI_FORMAT_B8G8R8A8_UNORM:
+  case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+    numChannels = 4;
+    swapRB = true;
+    break;
+  case DXGI_FORMAT_R8G8_UNORM:
+    numChannels = 2;
+    break;
+  case DXGI_FORMAT_R8_UNORM:
+    numChannels = 1;
+    break;
+  default:
+    return false;
+  }
+
+  const size_t numPixels = static_cast<size_t>(width) * height;
+
+  if (dataSize < numPixels * numChannels)
+    return false;
+
+  rgba.resize(numPixels * 4);
+  const uint8_t *src = reinterpret_cast<const uint8_t *>(data);
+  uint8_t *dst = reinterpret_cast<uint8_t *>(&rgba[0]);
+
+  for (size_t p = 0; p < numPixels; p++, src += numChannels, dst += 4) {
+    if (numChannels == 4) {
+      memcpy(dst, src, 4);
+
+      if (swapRB)
+        std::swap(dst[0], dst[2]);
+    } else {
+      dst[0] = src[0];
+      dst[1] = numChannels == 2 ? src[1] : src[0];
+      dst[2] = numChannels == 2 ? 0 : src[0];
+      dst[3] = 0xFF;
+    }
+  }
+
+  return true;
+}
+
+bool DecodeImage(const char *data, size_t dataSize, int width, int height,
+                 int dxgiFormat, std::string &rgba) {
+  block_func decodeBlock;
+  size_t blockSize = 16;
+
+  switch (dxgiFormat) {
+  case DXGI_FORMAT_BC1_TYPELESS:
+  case DXGI_FORMAT_BC1_UNORM:
+  case DXGI_FORMAT_BC1_UNORM_SRGB:
+    decodeBlock = DecodeBC1;
+    blockSize = 8;
+    break;
+  case DXGI_FORMAT_BC2_TYPELESS:
+  case DXGI_FORMAT_BC2_UNORM:
+  case DXGI_FORMAT_BC2_UNORM_SRGB:
+    decodeBlock = DecodeBC2;
+    break;
+  case DXGI_FORMAT_BC3_TYPELESS:
+  case DXGI_FORMAT_BC3_UNORM:
+  case DXGI_FORMAT_BC3_UNORM_SRGB:
+    decodeBlock = DecodeBC3;
+    break;
+  case DXGI_FORMAT_BC4_TYPELESS:
+  case DXGI_FORMAT_BC4_UNORM:
+    decodeBlock = DecodeBC4;
+    blockSize = 8;
+    break;
+  case DXGI_FORMAT_BC4_SNORM:
+    decodeBlock = DecodeBC4S;
+    blockSize = 8;
+    break;
+  case DXGI_FORMAT_BC5_TYPELESS:
+  case DXGI_FORMAT_BC5_UNORM:
+    decodeBlock = DecodeBC5;
+    break;
+  case DXGI_FORMAT_BC5_SNORM:
+    decodeBlock = DecodeBC5S;
+    break;
+  case DXGI_FORMAT_BC6H_TYPELESS:
+  case DXGI_FORMAT_BC6H_UF16:
+    decodeBlock = DecodeBC6HU;
+    break;
+  case DXGI_FORMAT_BC6H_SF16:
+    decodeBlock = DecodeBC6HS;
+    break;
+  case DXGI_FORMAT_BC7_TYPELESS:
+  case DXGI_FORMAT_BC7_UNORM:
+  case DXGI_FORMAT_BC7_UNORM_SRGB:
+    decodeBlock = DecodeBC7;
+    break;
+  default:
+    return DecodeUncompressed(data, dataSize, width, height, dxgiFormat,
+                              rgba);
+  }
+
+  const int numBlocksX = (width + 3) / 4;
+  const int numBlocksY = (height + 3) / 4;
+
+  if (dataSize < static_cast<size_t>(numBlocksX) * numBlocksY * blockSize)
+    return false;
+
+  rgba.resize(static_cast<size_t>(width) * height * 4);
+  const uint8_t *src = reinterpret_cast<const uint8_t *>(data);
+  uint8_t *dst = reinterpret_cast<uint8_t *>(&rgba[0]);
+  pixel_block pixels;
+
+  for (int by = 0; by < numBlocksY; by++)
+    for (int bx = 0; bx < numBlocksX; bx++, src += blockSize) {
+      decodeBlock(src, pixels);
+
+      // Edge blocks are cropped
+      for (int y = 0; y < 4 && by * 4 + y < height; y++)
+        for (int x = 0; x < 4 && bx * 4 + x < width; x++)
+          memcpy(dst + (static_cast<size_t>(by * 4 + y) * width + bx * 4 + x) *
+                           4,
+                 pixels[y * 4 + x], 4);
+    }
+
+  return true;
+}
@@ -0,0 +1,26 @@
+/*      BlockDecoder
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Decodes image into RGBA8, BC1 to BC7 and 8bit uncompressed formats.
+// BC6H is clamped into 0-1 range, signed formats are biased into 0-255.
+// Returns false for unsupported format or when data are too short.
+bool DecodeImage(const char *data, size_t dataSize, int width, int height,
+                 int dxgiFormat, std::string &rgba);
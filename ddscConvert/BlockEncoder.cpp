@@ -0,0 +1,627 @@
+/*      BlockEncoder
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "BlockEncoder.hpp"
+#include "formats/DDS.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BLOCKENC_SSE2
+#include <emmintrin.h>
+#endif
+
+// Smaller images are not worth spreading across threads
+static constexpr size_t MIN_PARALLEL_BLOCKS = 0x400;
+
+// 4x4 pixels, channels are stored separately
+struct Block {
+  float channels[4][16];
+};
+
+struct ColorCandidate {
+  uint16_t color0;
+  uint16_t color1;
+  uint8_t indices[16];
+  float error;
+};
+
+struct AlphaCandidate {
+  uint8_t alpha0;
+  uint8_t alpha1;
+  uint8_t indices[16];
+  float error;
+};
+
+// Block row of one image, offsets are into source and encoded data
+struct BlockRow {
+  size_t srcOffset;
+  size_t dstOffset;
+  int width;
+  int height;
+  int row;
+};
+
+bool EncodeSourceFromDXGI(int dxgiFormat, EncodeSource &source) {
+  switch (dxgiFormat) {
+  case DXGI_FORMAT_R8G8B8A8_UNORM:
+    source = {4, false, false};
+    return true;
+  case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+    source = {4, false, true};
+    return true;
+  case DXGI_FORMAT_B8G8R8A8_UNORM:
+    source = {4, true, false};
+    return true;
+  case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+    source = {4, true, true};
+    return true;
+  case DXGI_FORMAT_R8G8_UNORM:
+    source = {2, false, false};
+    return true;
+  case DXGI_FORMAT_R8_UNORM:
+    source = {1, false, false};
+    return true;
+  default:
+    return false;
+  }
+}
+
+static const char *blockFormatNames[] = {"BC1", "BC3", "BC4", "BC5"};
+
+bool BlockFormatFromName(const std::string &name, BlockFormat &format) {
+  std::string upperName = name;
+
+  for (auto &c : upperName)
+    c = static_cast<char>(toupper(c));
+
+  for (int f = 0; f < 4; f++)
+    if (upperName == blockFormatNames[f]) {
+      format = static_cast<BlockFormat>(f);
+      return true;
+    }
+
+  return false;
+}
+
+const char *BlockFormatName(BlockFormat format) {
+  return blockFormatNames[static_cast<int>(format)];
+}
+
+bool CanEncode(const EncodeSource &source, BlockFormat format) {
+  switch (format) {
+  case BlockFormat::BC1:
+  case BlockFormat::BC3:
+    return source.numChannels == 4;
+  case BlockFormat::BC5:
+    return source.numChannels >= 2;
+  default:
+    return true;
+  }
+}
+
+BlockFormat DefaultBlockFormat(const char *data, size_t numPixels,
+                               const EncodeSource &source) {
+  if (source.numChannels == 1)
+    return BlockFormat::BC4;
+
+  if (source.numChannels == 2)
+    return BlockFormat::BC5;
+
+  for (size_t p = 0; p < numPixels; p++)
+    if (static_cast<uint8_t>(data[p * 4 + 3]) != 0xFF)
+      return BlockFormat::BC3;
+
+  return BlockFormat::BC1;
+}
+
+int BlockFormatDXGI(BlockFormat format, bool sRGB) {
+  switch (format) {
+  case BlockFormat::BC1:
+    return sRGB ? DXGI_FORMAT_BC1_UNORM_SRGB : DXGI_FORMAT_BC1_UNORM;
+  case BlockFormat::BC3:
+    return sRGB ? DXGI_FORMAT_BC3_UNORM_SRGB : DXGI_FORMAT_BC3_UNORM;
+  case BlockFormat::BC4:
+    return DXGI_FORMAT_BC4_UNORM;
+  default:
+    return DXGI_FORMAT_BC5_UNORM;
+  }
+}
+
+static int BlockSize(BlockFormat format) {
+  return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+// Pixels outside of image are clamped to its edge
+static void LoadBlock(const uint8_t *src, int width, int height,
+                      const EncodeSource &source, int bx, int by,
+                      Block &block) {
+  for (int y = 0; y < 4; y++) {
+    const int sy = std::min(by * 4 + y, height - 1);
+
+    for (int x = 0; x < 4; x++) {
+      const int sx = std::min(bx * 4 + x, width - 1);
+      const uint8_t *pixel =
+          src + (static_cast<size_t>(sy) * width + sx) * source.numChannels;
+      const int p = y * 4 + x;
+
+      for (int c = 0; c < source.numChannels; c++)
+        block.channels[c][p] = pixel[c];
+
+      if (source.swapRB)
+        std::swap(block.channels[0][p], block.channels[2][p]);
+    }
+  }
+}
+
+// Picks nearest palette entry for each pixel.
+// Returns sum of squared errors.
+static float FitIndices(const float (*channels)[16], int numChannels,
+                        const float (*palette)[4], int paletteSize,
+                        uint8_t *indices) {
+  float error = 0;
+#ifdef BLOCKENC_SSE2
+  for (int g = 0; g < 16; g += 4) {
+    __m128 best = _mm_set1_ps(FLT_MAX);
+    __m128i bestIndex = _mm_setzero_si128();
+
+    for (int p = 0; p < paletteSize; p++) {
+      __m128 distance = _mm_setzero_ps();
+
+      for (int c = 0; c < numChannels; c++) {
+        const __m128 delta = _mm_sub_ps(_mm_loadu_ps(channels[c] + g),
+                                        _mm_set1_ps(palette[p][c]));
+        distance = _mm_add_ps(distance, _mm_mul_ps(delta, delta));
+      }
+
+      const __m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+      best = _mm_min_ps(distance, best);
+      bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(p)),
+                               _mm_andnot_si128(closer, bestIndex));
+    }
+
+    alignas(16) int cIndices[4];
+    alignas(16) float cErrors[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(cIndices), bestIndex);
+    _mm_store_ps(cErrors, best);
+
+    for (int i = 0; i < 4; i++) {
+      indices[g + i] = static_cast<uint8_t>(cIndices[i]);
+      error += cErrors[i];
+    }
+  }
+#else
+  for (int i = 0; i < 16; i++) {
+    float best = FLT_MAX;
+
+    for (int p = 0; p < paletteSize; p++) {
+      float distance = 0;
+
+      for (int c = 0; c < numChannels; c++) {
+        const float delta = channels[c][i] - palette[p][c];
+        distance += delta * delta;
+      }
+
+      if (distance < best) {
+        best = distance;
+        indices[i] = static_cast<uint8_t>(p);
+      }
+    }
+
+    error += best;
+  }
+#endif
+
+  return error;
+}
+
+static int Quantize(float value, int maxValue) {
+  const int retVal = static_cast<int>(value * maxValue / 255.0f + 0.5f);
+  return std::max(0, std::min(retVal, maxValue));
+}
+
+static uint16_t To565(const float *color) {
+  return static_cast<uint16_t>(Quantize(color[0], 31) << 11 |
+                               Quantize(color[1], 63) << 5 |
+                               Quantize(color[2], 31));
+}
+
+static void From565(uint16_t value, float *color) {
+  const int r = value >> 11;
+  const int g = (value >> 5) & 0x3F;
+  const int b = value & 0x1F;
+  color[0] = static_cast<float>(r << 3 | r >> 2);
+  color[1] = static_cast<float>(g << 2 | g >> 4);
+  color[2] = static_cast<float>(b << 3 | b >> 2);
+}
+
+static void TryColorEndpoints(const Block &block, const float *endpoint0,
+                              const float *endpoint1, ColorCandidate &best) {
+  ColorCandidate cand;
+  cand.color0 = To565(endpoint0);
+  cand.color1 = To565(endpoint1);
+
+  // color0 > color1 selects 4 color mode
+  if (cand.color0 < cand.color1)
+    std::swap(cand.color0, cand.color1);
+
+  float palette[4][4] = {};
+  From565(cand.color0, palette[0]);
+  From565(cand.color1, palette[1]);
+
+  for (int c = 0; c < 3; c++) {
+    palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+    palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+  }
+
+  // Equal colors select 3 color mode, only first entry is same
+  cand.error = FitIndices(block.channels, 3, palette,
+                          cand.color0 == cand.color1 ? 1 : 4, cand.indices);
+
+  if (cand.error < best.error)
+    best = cand;
+}
+
+// Endpoints are inset by 1/16 of range, to reduce quantization error
+static void InsetEndpoints(float *endpoint0, float *endpoint1) {
+  for (int c = 0; c < 3; c++) {
+    const float inset = (endpoint0[c] - endpoint1[c]) / 16;
+    endpoint0[c] -= inset;
+    endpoint1[c] += inset;
+  }
+}
+
+static void BoundingBoxEndpoints(const Block &block, float *endpoint0,
+                                 float *endpoint1) {
+  float mean[3] = {};
+
+  for (int c = 0; c < 3; c++) {
+    endpoint0[c] = 0;
+    endpoint1[c] = 255;
+
+    for (int p = 0; p < 16; p++) {
+      endpoint0[c] = std::max(endpoint0[c], block.channels[c][p]);
+      endpoint1[c] = std::min(endpoint1[c], block.channels[c][p]);
+      mean[c] += block.channels[c][p] / 16;
+    }
+  }
+
+  // Diagonal of box follows sign of covariance with green
+  for (int c = 0; c < 3; c += 2) {
+    float covariance = 0;
+
+    for (int p = 0; p < 16; p++)
+      covariance += (block.channels[c][p] - mean[c]) *
+                    (block.channels[1][p] - mean[1]);
+
+    if (covariance < 0)
+      std::swap(endpoint0[c], endpoint1[c]);
+  }
+
+  InsetEndpoints(endpoint0, endpoint1);
+}
+
+static void PrincipalAxisEndpoints(const Block &block, float *endpoint0,
+                                   float *endpoint1) {
+  float mean[3] = {};
+
+  for (int c = 0; c < 3; c++)
+    for (int p = 0; p < 16; p++)
+      mean[c] += block.channels[c][p] / 16;
+
+  float covariance[3][3] = {};
+
+  for (int p = 0; p < 16; p++) {
+    const float delta[3] = {block.channels[0][p] - mean[0],
+                            block.channels[1][p] - mean[1],
+                            block.channels[2][p] - mean[2]};
+
+    for (int i = 0; i < 3; i++)
+      for (int j = 0; j < 3; j++)
+        covariance[i][j] += delta[i] * delta[j];
+  }
+
+  // Power iteration
+  float axis[3] = {1, 1, 1};
+
+  for (int i = 0; i < 8; i++) {
+    float next[3];
+
+    for (int r = 0; r < 3; r++)
+      next[r] = covariance[r][0] * axis[0] + covariance[r][1] * axis[1] +
+                covariance[r][2] * axis[2];
+
+    const float length = std::max(
+        std::fabs(next[0]), std::max(std::fabs(next[1]), std::fabs(next[2])));
+
+    // Flat block
+    if (length < FLT_EPSILON) {
+      memcpy(endpoint0, mean, sizeof(mean));
+      memcpy(endpoint1, mean, sizeof(mean));
+      return;
+    }
+
+    for (int c = 0; c < 3; c++)
+      axis[c] = next[c] / length;
+  }
+
+  const float length =
+      std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+  float minT = FLT_MAX;
+  float maxT = -FLT_MAX;
+
+  for (int c = 0; c < 3; c++)
+    axis[c] /= length;
+
+  for (int p = 0; p < 16; p++) {
+    const float t = (block.channels[0][p] - mean[0]) * axis[0] +
+                    (block.channels[1][p] - mean[1]) * axis[1] +
+                    (block.channels[2][p] - mean[2]) * axis[2];
+    minT = std::min(minT, t);
+    maxT = std::max(maxT, t);
+  }
+
+  for (int c = 0; c < 3; c++) {
+    endpoint0[c] = mean[c] + axis[c] * maxT;
+    endpoint1[c] = mean[c] + axis[c] * minT;
+  }
+
+  InsetEndpoints(endpoint0, endpoint1);
+}
+
+// Least squares endpoints for current indices
+static bool RefineColorEndpoints(const Block &block, const ColorCandidate &cand,
+                                 float *endpoint0, float *endpoint1) {
+  static const float weights[4] = {1, 0, 2.0f / 3, 1.0f / 3};
+  float aa = 0, ab = 0, bb = 0;
+  float ax[3] = {}, bx[3] = {};
+
+  for (int p = 0; p < 16; p++) {
+    const float a = weights[cand.indices[p]];
+    const float b = 1 - a;
+    aa += a * a;
+    ab += a * b;
+    bb += b * b;
+
+    for (int c = 0; c < 3; c++) {
+      ax[c] += a * block.channels[c][p];
+      bx[c] += b * block.channels[c][p];
+    }
+  }
+
+  const float determinant = aa * bb - ab * ab;
+
+  if (std::fabs(determinant) < FLT_EPSILON)
+    return false;
+
+  for (int c = 0; c < 3; c++) {
+    endpoint0[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+    endpoint1[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+  }
+
+  return true;
+}
+
+static void EncodeColorBlock(const Block &block, EncodeQuality quality,
+                             uint8_t *dst) {
+  ColorCandidate best;
+  best.error = FLT_MAX;
+  float endpoint0[3], endpoint1[3];
+
+  if (quality == EncodeQuality::Fast)
+    BoundingBoxEndpoints(block, endpoint0, endpoint1);
+  else
+    PrincipalAxisEndpoints(block, endpoint0, endpoint1);
+
+  TryColorEndpoints(block, endpoint0, endpoint1, best);
+
+  if (quality == EncodeQuality::High)
+    for (int i = 0; i < 2 && best.error > 0; i++) {
+      const float lastError = best.error;
+
+      if (!RefineColorEndpoints(block, best, endpoint0, endpoint1))
+        break;
+
+      TryColorEndpoints(block, endpoint0, endpoint1, best);
+
+      if (best.error >= lastError)
+        break;
+    }
+
+  uint32_t indices = 0;
+
+  for (int p = 0; p < 16; p++)
+    indices |= static_cast<uint32_t>(best.indices[p]) << (p * 2);
+
+  memcpy(dst, &best.color0, 2);
+  memcpy(dst + 2, &best.color1, 2);
+  memcpy(dst + 4, &indices, 4);
+}
+
+static void TryAlphaEndpoints(const float (&values)[16], int alpha0,
+                              int alpha1, AlphaCandidate &best) {
+  AlphaCandidate cand;
+  cand.alpha0 = static_cast<uint8_t>(alpha0);
+  cand.alpha1 = static_cast<uint8_t>(alpha1);
+  float palette[8][4] = {};
+  palette[0][0] = static_cast<float>(alpha0);
+  palette[1][0] = static_cast<float>(alpha1);
+
+  // alpha0 > alpha1 selects 8 value mode, otherwise 6 values, 0 and 255
+  if (alpha0 > alpha1) {
+    for (int j = 2; j < 8; j++)
+      palette[j][0] = ((8 - j) * alpha0 + (j - 1) * alpha1) / 7.0f;
+  } else {
+    for (int j = 2; j < 6; j++)
+      palette[j][0] = ((6 - j) * alpha0 + (j - 1) * alpha1) / 5.0f;
+
+    palette[7][0] = 255;
+  }
+
+  cand.error = FitIndices(&values, 1, palette, 8, cand.indices);
+
+  if (cand.error < best.error)
+    best = cand;
+}
+
+static void EncodeAlphaBlock(const float (&values)[16], EncodeQuality quality,
+                             uint8_t *dst) {
+  AlphaCandidate best;
+  best.error = FLT_MAX;
+  const int minValue = static_cast<int>(*std::min_element(values, values + 16));
+  const int maxValue = static_cast<int>(*std::max_element(values, values + 16));
+
+  if (quality == EncodeQuality::Fast || minValue == maxValue) {
+    // Indices are interpolated straight from position within range
+    best.alpha0 = static_cast<uint8_t>(maxValue);
+    best.alpha1 = static_cast<uint8_t>(minValue);
+
+    for (int p = 0; p < 16; p++) {
+      const int step =
+          minValue == maxValue
+              ? 0
+              : static_cast<int>((maxValue - values[p]) * 7 /
+                                     (maxValue - minValue) +
+                                 0.5f);
+      best.indices[p] =
+          static_cast<uint8_t>(step == 0 ? 0 : step == 7 ? 1 : step + 1);
+    }
+  } else {
+    TryAlphaEndpoints(values, maxValue, minValue, best);
+
+    // 6 value mode covers 0 and 255 for free
+    if (quality == EncodeQuality::High) {
+      int innerMin = 255, innerMax = 0;
+
+      for (auto v : values)
+        if (v > 0 && v < 255) {
+          innerMin = std::min(innerMin, static_cast<int>(v));
+          innerMax = std::max(innerMax, static_cast<int>(v));
+        }
+
+      if (innerMin > innerMax) {
+        innerMin = 0;
+        innerMax = 255;
+      }
+
+      TryAlphaEndpoints(values, innerMin, innerMax, best);
+    }
+  }
+
+  uint64_t indices = 0;
+
+  for (int p = 0; p < 16; p++)
+    indices |= static_cast<uint64_t>(best.indices[p]) << (p * 3);
+
+  dst[0] = best.alpha0;
+  dst[1] = best.alpha1;
+
+  for (int i = 0; i < 6; i++)
+    dst[2 + i] = static_cast<uint8_t>(indices >> (i * 8));
+}
+
+static void EncodeBlock(const Block &block, BlockFormat format,
+                        EncodeQuality quality, uint8_t *dst) {
+  switch (format) {
+  case BlockFormat::BC1:
+    EncodeColorBlock(block, quality, dst);
+    break;
+  case BlockFormat::BC3:
+    EncodeAlphaBlock(block.channels[3], quality, dst);
+    EncodeColorBlock(block, quality, dst + 8);
+    break;
+  case BlockFormat::BC4:
+    EncodeAlphaBlock(block.channels[0], quality, dst);
+    break;
+  case BlockFormat::BC5:
+    EncodeAlphaBlock(block.channels[0], quality, dst);
+    EncodeAlphaBlock(block.channels[1], quality, dst + 8);
+    break;
+  }
+}
+
+std::string EncodeMipChains(const char *data, int width, int height,
+                            int numMips, int numElements,
+                            const EncodeSource &source, BlockFormat format,
+                            EncodeQuality quality, int numWorkers) {
+  const int blockSize = BlockSize(format);
+  std::vector<BlockRow> rows;
+  size_t srcOffset = 0;
+  size_t dstOffset = 0;
+
+  for (int e = 0; e < numElements; e++)
+    for (int m = 0; m < numMips; m++) {
+      const int mipWidth = std::max(width >> m, 1);
+      const int mipHeight = std::max(height >> m, 1);
+      const size_t rowSize = static_cast<size_t>((mipWidth + 3) / 4) * blockSize;
+      const int numRows = (mipHeight + 3) / 4;
+
+      for (int r = 0; r < numRows; r++)
+        rows.push_back({srcOffset, dstOffset + r * rowSize, mipWidth,
+                        mipHeight, r});
+
+      srcOffset +=
+          static_cast<size_t>(mipWidth) * mipHeight * source.numChannels;
+      dstOffset += rowSize * numRows;
+    }
+
+  std::string retVal(dstOffset, 0);
+  const uint8_t *src = reinterpret_cast<const uint8_t *>(data);
+  uint8_t *dst = reinterpret_cast<uint8_t *>(&retVal[0]);
+  std::atomic<size_t> nextRow(0);
+
+  auto encodeRows = [&]() {
+    Block block = {};
+
+    for (size_t r; (r = nextRow++) < rows.size();) {
+      const BlockRow &cRow = rows[r];
+      const int numBlocks = (cRow.width + 3) / 4;
+
+      for (int b = 0; b < numBlocks; b++) {
+        LoadBlock(src + cRow.srcOffset, cRow.width, cRow.height, source, b,
+                  cRow.row, block);
+        EncodeBlock(block, format, quality,
+                    dst + cRow.dstOffset + b * blockSize);
+      }
+    }
+  };
+
+  const size_t numBlocks = dstOffset / blockSize;
+  const size_t numThreads =
+      numBlocks < MIN_PARALLEL_BLOCKS
+          ? 1
+          : std::min(rows.size(),
+                     static_cast<size_t>(std::max(numWorkers, 1)));
+  std::vector<std::thread> workers;
+
+  for (size_t w = 1; w < numThreads; w++)
+    workers.emplace_back(encodeRows);
+
+  encodeRows();
+
+  for (auto &w : workers)
+    w.join();
+
+  return retVal;
+}
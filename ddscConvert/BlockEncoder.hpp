@@ -0,0 +1,59 @@
+/*      BlockEncoder
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <cstddef>
+#include <string>
+
+enum class BlockFormat { BC1, BC3, BC4, BC5 };
+
+// Fast: bounding box endpoints.
+// Normal: principal axis endpoints.
+// High: principal axis with least squares refinement, tries both BC4 modes.
+enum class EncodeQuality { Fast, Normal, High };
+
+// Uncompressed 8bit layout, that can be block compressed.
+struct EncodeSource {
+  int numChannels;
+  bool swapRB;
+  bool sRGB;
+};
+
+// Returns false for formats, that cannot be block compressed.
+bool EncodeSourceFromDXGI(int dxgiFormat, EncodeSource &source);
+
+// Accepts BC1, BC3, BC4 and BC5, case insensitive.
+bool BlockFormatFromName(const std::string &name, BlockFormat &format);
+const char *BlockFormatName(BlockFormat format);
+
+// BC1 and BC3 need RGBA, BC5 at least RG source.
+bool CanEncode(const EncodeSource &source, BlockFormat format);
+
+// BC4 for R, BC5 for RG, BC1 or BC3 for RGBA depending on alpha.
+BlockFormat DefaultBlockFormat(const char *data, size_t numPixels,
+                               const EncodeSource &source);
+
+// sRGB is kept for BC1 and BC3.
+int BlockFormatDXGI(BlockFormat format, bool sRGB);
+
+// Encodes numMips long chains of numElements consecutive images
+// (array elements or cubemap faces), data are in DDS order.
+// Block rows of all levels are encoded by up to numWorkers threads.
+std::string EncodeMipChains(const char *data, int width, int height,
+                            int numMips, int numElements,
+                            const EncodeSource &source, BlockFormat format,
+                            EncodeQuality quality, int numWorkers);
@@ -0,0 +1,259 @@
+/*      Manifest
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Manifest.hpp"
+#include "ContentStore.hpp"
+#include "MappedFile.hpp"
+#include "RawFile.hpp"
+#include "datas/MasterPrinter.hpp"
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+static const char MANIFEST_ID[] = "ddscConvert manifest 2\n";
+static constexpr int LOCK_RETRY_MS = 100;
+static constexpr int LOCK_TIMEOUT_MS = 60000;
+
+static TSTRING LinePath(const char *begin, const char *end) {
+  return static_cast<TSTRING>(esString(std::string(begin, end)));
+}
+
+// Record line: R settingsHash path
+// followed by its input lines: I size mtime contentHash path
+// and output lines: O path
+static void ReadRecords(const TSTRING &path,
+                        std::unordered_map<TSTRING, ManifestRecord> &records) {
+  MappedFile file(path);
+  const size_t idSize = sizeof(MANIFEST_ID) - 1;
+
+  if (!file.IsValid() || file.Size() < idSize ||
+      memcmp(file.Data(), MANIFEST_ID, idSize))
+    return;
+
+  const std::string data(file.Data() + idSize, file.Size() - idSize);
+  const char *cLine = data.c_str();
+  ManifestRecord *cRecord = nullptr;
+
+  while (*cLine) {
+    const char *lineEnd = strchr(cLine, '\n');
+
+    if (!lineEnd)
+      break;
+
+    const char type = *cLine;
+    char *cEnd = const_cast<char *>(cLine + 1);
+
+    if (type == 'R') {
+      ManifestRecord record = {};
+      record.settingsHash = strtoull(cEnd, &cEnd, 16);
+      const char *cPath = cEnd + 1;
+      cRecord = nullptr;
+
+      // Malformed lines are dropped with their record
+      if (*cEnd == ' ' && cPath < lineEnd) {
+        cRecord = &records[LinePath(cPath, lineEnd)];
+        *cRecord = std::move(record);
+      }
+    } else if (type == 'I' && cRecord) {
+      ManifestFile cFile;
+      cFile.size = static_cast<size_t>(strtoull(cEnd, &cEnd, 10));
+      cFile.mtime = strtoll(cEnd, &cEnd, 10);
+      cFile.contentHash = strtoull(cEnd, &cEnd, 16);
+      const char *cPath = cEnd + 1;
+
+      if (*cEnd == ' ' && cPath < lineEnd) {
+        cFile.path = LinePath(cPath, lineEnd);
+        cRecord->inputs.push_back(std::move(cFile));
+      }
+    } else if (type == 'O' && cRecord && cLine[1] == ' ' &&
+               cLine + 2 < lineEnd) {
+      cRecord->outputs.push_back(LinePath(cLine + 2, lineEnd));
+    }
+
+    cLine = lineEnd + 1;
+  }
+
+  // Record without inputs cannot be up to date
+  for (auto it = records.begin(); it != records.end();)
+    if (it->second.inputs.empty())
+      it = records.erase(it);
+    else
+      it++;
+}
+
+static uint64_t ContentHash(const TSTRING &path, size_t size) {
+  Hash64 hash;
+
+  if (size) {
+    MappedFile file(path);
+
+    if (!file.IsValid())
+      return 0;
+
+    hash.Update(file.Data(), file.Size());
+  }
+
+  return hash.Digest();
+}
+
+void Manifest::Load(const TSTRING &manifestPath) {
+  path = manifestPath;
+  records.clear();
+  updated.clear();
+  ReadRecords(path, records);
+}
+
+bool Manifest::IsUpToDate(const TSTRING &input, uint64_t settingsHash) {
+  auto found = records.find(input);
+
+  if (found == records.end() || found->second.settingsHash != settingsHash)
+    return false;
+
+  for (auto &o : found->second.outputs) {
+    int64_t mtime;
+
+    if (FileStat(o, mtime) == NO_FILE)
+      return false;
+  }
+
+  ManifestRecord current = found->second;
+  bool touched = false;
+
+  for (auto &i : current.inputs) {
+    int64_t mtime = 0;
+    const size_t size = FileStat(i.path, mtime);
+
+    if (size != i.size)
+      return false;
+
+    if (size == NO_FILE || mtime == i.mtime)
+      continue;
+
+    if (ContentHash(i.path, size) != i.contentHash)
+      return false;
+
+    i.mtime = mtime;
+    touched = true;
+  }
+
+  // Touched, but not changed
+  if (touched)
+    Update(input, std::move(current));
+
+  return true;
+}
+
+void Manifest::Update(const TSTRING &input, uint64_t settingsHash,
+                      const std::vector<TSTRING> &inputs,
+                      const std::vector<TSTRING> &outputs) {
+  ManifestRecord record;
+  record.settingsHash = settingsHash;
+  record.outputs = outputs;
+
+  for (auto &i : inputs) {
+    ManifestFile cFile;
+    cFile.path = i;
+    cFile.mtime = 0;
+    cFile.size = FileStat(i, cFile.mtime);
+    cFile.contentHash = cFile.size == NO_FILE ? 0 : ContentHash(i, cFile.size);
+    record.inputs.push_back(std::move(cFile));
+  }
+
+  Update(input, std::move(record));
+}
+
+void Manifest::Update(const TSTRING &input, ManifestRecord &&record) {
+  std::lock_guard<std::mutex> lock(mutex);
+  updated[input] = std::move(record);
+}
+
+int Manifest::Save() {
+  if (updated.empty())
+    return 0;
+
+  const TSTRING lockPath = path + _T(".lock");
+  RawFile lockFile;
+
+  for (int waited = 0; !lockFile.Open(lockPath, RawFile::CREATE_NEW);
+       waited += LOCK_RETRY_MS) {
+    if (waited >= LOCK_TIMEOUT_MS) {
+      printerror("Cannot lock manifest, remove ",
+                 << lockPath << _T(" if no other conversion is running."));
+      return 1;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(LOCK_RETRY_MS));
+  }
+
+  // Other runs might have saved their records since load
+  map_type merged;
+  ReadRecords(path, merged);
+
+  for (auto &u : updated)
+    merged[u.first] = u.second;
+
+  std::string out = MANIFEST_ID;
+
+  for (auto &m : merged) {
+    char buffer[80];
+    snprintf(buffer, sizeof(buffer), "R %016" PRIx64 " ",
+             m.second.settingsHash);
+    out.append(buffer).append(esString(m.first)).push_back('\n');
+
+    for (auto &i : m.second.inputs) {
+      snprintf(buffer, sizeof(buffer),
+               "I %" PRIu64 " %" PRId64 " %016" PRIx64 " ",
+               static_cast<uint64_t>(i.size), i.mtime, i.contentHash);
+      out.append(buffer).append(esString(i.path)).push_back('\n');
+    }
+
+    for (auto &o : m.second.outputs)
+      out.append("O ").append(esString(o)).push_back('\n');
+  }
+
+  const TSTRING tempPath = path + _T(".tmp");
+  RawFile tempFile(tempPath, RawFile::WRITE);
+  int result = 0;
+
+  if (!tempFile.IsValid() || !tempFile.WriteAt(0, out.data(), out.size())) {
+    printerror("Cannot write manifest: ", << tempPath);
+    result = 2;
+  }
+
+  tempFile.Close();
+
+  if (!result && !MoveFileOver(tempPath, path)) {
+    printerror("Cannot replace manifest: ", << path);
+    result = 2;
+  }
+
+  if (result)
+    RemoveFile(tempPath);
+
+  lockFile.Close();
+  RemoveFile(lockPath);
+
+  if (!result) {
+    records.swap(merged);
+    updated.clear();
+  }
+
+  return result;
+}
@@ -0,0 +1,75 @@
+/*      Manifest
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "datas/esString.h"
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct ManifestFile {
+  TSTRING path;
+  // NO_FILE, when file didn't exist
+  size_t size;
+  int64_t mtime;
+  uint64_t contentHash;
+};
+
+struct ManifestRecord {
+  // Hash of settings, that affect output
+  uint64_t settingsHash;
+  // Files read by conversion, converted file is first
+  std::vector<ManifestFile> inputs;
+  // Files written by conversion
+  std::vector<TSTRING> outputs;
+};
+
+// Input files converted by previous runs.
+// Queried and updated by concurrent file handlers, loaded before and saved
+// after conversion.
+// Save merges records into manifest on disk under lock file, so concurrent
+// runs sharing one manifest don't drop each other's records.
+class Manifest {
+public:
+  // Missing or unreadable manifest is empty.
+  void Load(const TSTRING &path);
+
+  // Input is up to date, when it was converted with same settings,
+  // all files read by conversion have same size and same modification time
+  // or content hash, and all files written by conversion exist.
+  // Content is hashed only when modification time differs.
+  bool IsUpToDate(const TSTRING &input, uint64_t settingsHash);
+  // Records current state of files read by conversion.
+  void Update(const TSTRING &input, uint64_t settingsHash,
+              const std::vector<TSTRING> &inputs,
+              const std::vector<TSTRING> &outputs);
+  size_t NumUpdated() const { return updated.size(); }
+
+  int Save();
+
+private:
+  typedef std::unordered_map<TSTRING, ManifestRecord> map_type;
+
+  TSTRING path;
+  std::mutex mutex;
+  // Records loaded from disk, read only while converting
+  map_type records;
+  map_type updated;
+
+  void Update(const TSTRING &input, ManifestRecord &&record);
+};
@@ -0,0 +1,360 @@
+/*      MipGenerator
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "MipGenerator.hpp"
+#include "formats/DDS.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIPGEN_SSE2
+#include <emmintrin.h>
+#endif
+
+// Smaller levels are not worth spreading across threads
+static constexpr size_t MIN_PARALLEL_PIXELS = 0x10000;
+static constexpr int MIN_ROWS_PER_TASK = 16;
+static constexpr int LINEAR_LUT_SIZE = 1 << 14;
+
+typedef void (*row_func)(const uint8_t *row0, const uint8_t *row1,
+                         uint8_t *dst, int srcWidth, int dstWidth);
+
+bool MipFormatFromDXGI(int dxgiFormat, MipFormat &format) {
+  switch (dxgiFormat) {
+  case DXGI_FORMAT_R8G8B8A8_UNORM:
+  case DXGI_FORMAT_B8G8R8A8_UNORM:
+    format = MipFormat::RGBA8;
+    return true;
+  case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+  case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+    format = MipFormat::RGBA8_SRGB;
+    return true;
+  case DXGI_FORMAT_R8G8_UNORM:
+    format = MipFormat::RG8;
+    return true;
+  case DXGI_FORMAT_R8_UNORM:
+    format = MipFormat::R8;
+    return true;
+  case DXGI_FORMAT_R16G16B16A16_FLOAT:
+    format = MipFormat::RGBA16F;
+    return true;
+  default:
+    return false;
+  }
+}
+
+int NumMipmaps(int width, int height) {
+  int numMips = 1;
+
+  for (int size = std::max(width, height); size > 1; size >>= 1)
+    numMips++;
+
+  return numMips;
+}
+
+static int PixelSize(MipFormat format) {
+  switch (format) {
+  case MipFormat::RG8:
+    return 2;
+  case MipFormat::R8:
+    return 1;
+  case MipFormat::RGBA16F:
+    return 8;
+  default:
+    return 4;
+  }
+}
+
+#ifdef MIPGEN_SSE2
+// Sums horizontally adjacent pixels of two rows summed into 16bit lanes,
+// lo and hi hold 8 source bytes each.
+template <int P> static __m128i SumPairs(__m128i lo, __m128i hi);
+
+template <> __m128i SumPairs<4>(__m128i lo, __m128i hi) {
+  return _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+}
+
+template <> __m128i SumPairs<2>(__m128i lo, __m128i hi) {
+  const __m128 even = _mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi),
+                                     _MM_SHUFFLE(2, 0, 2, 0));
+  const __m128 odd = _mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi),
+                                    _MM_SHUFFLE(3, 1, 3, 1));
+  return _mm_add_epi16(_mm_castps_si128(even), _mm_castps_si128(odd));
+}
+
+template <> __m128i SumPairs<1>(__m128i lo, __m128i hi) {
+  const __m128i ones = _mm_set1_epi16(1);
+  return _mm_packs_epi32(_mm_madd_epi16(lo, ones), _mm_madd_epi16(hi, ones));
+}
+#endif
+
+// 8bit channels, P bytes per pixel
+template <int P>
+static void DownsampleRow8(const uint8_t *row0, const uint8_t *row1,
+                           uint8_t *dst, int srcWidth, int dstWidth) {
+  int x = 0;
+#ifdef MIPGEN_SSE2
+  // 16 source bytes of both rows give 8 destination bytes
+  const int pixelsPerStep = 8 / P;
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i two = _mm_set1_epi16(2);
+
+  for (; (x + pixelsPerStep) * 2 <= srcWidth; x += pixelsPerStep) {
+    const __m128i r0 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + x * 2 * P));
+    const __m128i r1 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + x * 2 * P));
+    const __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(r0, zero),
+                                     _mm_unpacklo_epi8(r1, zero));
+    const __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(r0, zero),
+                                     _mm_unpackhi_epi8(r1, zero));
+    const __m128i sum =
+        _mm_srli_epi16(_mm_add_epi16(SumPairs<P>(lo, hi), two), 2);
+
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + x * P),
+                     _mm_packus_epi16(sum, sum));
+  }
+#endif
+
+  // Odd last column is clamped
+  for (; x < dstWidth; x++) {
+    const int x0 = x * 2 * P;
+    const int x1 = std::min(x * 2 + 1, srcWidth - 1) * P;
+
+    for (int c = 0; c < P; c++)
+      dst[x * P + c] = static_cast<uint8_t>(
+          (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >>
+          2);
+  }
+}
+
+struct SRGBTables {
+  float toLinear[256];
+  uint8_t fromLinear[LINEAR_LUT_SIZE];
+
+  SRGBTables() {
+    for (int i = 0; i < 256; i++) {
+      const float value = i / 255.0f;
+      toLinear[i] = value <= 0.04045f
+                        ? value / 12.92f
+                        : std::pow((value + 0.055f) / 1.055f, 2.4f);
+    }
+
+    for (int i = 0; i < LINEAR_LUT_SIZE; i++) {
+      const float value = i / static_cast<float>(LINEAR_LUT_SIZE - 1);
+      const float sRGB = value <= 0.0031308f
+                             ? value * 12.92f
+                             : 1.055f * std::pow(value, 1 / 2.4f) - 0.055f;
+      fromLinear[i] = static_cast<uint8_t>(sRGB * 255.0f + 0.5f);
+    }
+  }
+};
+
+static const SRGBTables &GetSRGBTables() {
+  static const SRGBTables tables;
+  return tables;
+}
+
+// Color is averaged in linear space, alpha is linear
+static void DownsampleRowSRGB(const uint8_t *row0, const uint8_t *row1,
+                              uint8_t *dst, int srcWidth, int dstWidth) {
+  const SRGBTables &tables = GetSRGBTables();
+  const float scale = 0.25f * (LINEAR_LUT_SIZE - 1);
+
+  for (int x = 0; x < dstWidth; x++) {
+    const int x0 = x * 8;
+    const int x1 = std::min(x * 2 + 1, srcWidth - 1) * 4;
+
+    for (int c = 0; c < 3; c++) {
+      const float sum =
+          tables.toLinear[row0[x0 + c]] + tables.toLinear[row0[x1 + c]] +
+          tables.toLinear[row1[x0 + c]] + tables.toLinear[row1[x1 + c]];
+      dst[x * 4 + c] =
+          tables.fromLinear[static_cast<int>(sum * scale + 0.5f)];
+    }
+
+    dst[x * 4 + 3] = static_cast<uint8_t>(
+        (row0[x0 + 3] + row0[x1 + 3] + row1[x0 + 3] + row1[x1 + 3] + 2) >> 2);
+  }
+}
+
+static float HalfToFloat(uint16_t half) {
+  const uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+  const uint32_t exponent = (half >> 10) & 0x1F;
+  const uint32_t mantissa = half & 0x3FF;
+  uint32_t bits;
+
+  if (exponent == 0x1F) {
+    bits = sign | 0x7F800000 | (mantissa << 13);
+  } else if (exponent) {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  } else {
+    // Subnormal, 2^-24 units
+    const float value = mantissa * (1.0f / 16777216.0f);
+    return sign ? -value : value;
+  }
+
+  float retVal;
+  memcpy(&retVal, &bits, sizeof(retVal));
+  return retVal;
+}
+
+// Rounds to nearest even
+static uint16_t FloatToHalf(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  const uint16_t sign = (bits >> 16) & 0x8000;
+  const uint32_t absBits = bits & 0x7FFFFFFF;
+
+  if (absBits >= 0x7F800000)
+    return sign | 0x7C00 | (absBits > 0x7F800000 ? 0x200 : 0);
+
+  // 65520 and above round to infinity
+  if (absBits >= 0x477FF000)
+    return sign | 0x7C00;
+
+  // Below 2^-14, subnormal
+  if (absBits < 0x38800000) {
+    float absValue;
+    memcpy(&absValue, &absBits, sizeof(absValue));
+    return sign |
+           static_cast<uint16_t>(std::nearbyint(absValue * 16777216.0f));
+  }
+
+  uint32_t half = ((absBits >> 23) - 112) << 10 | ((absBits >> 13) & 0x3FF);
+  const uint32_t rest = absBits & 0x1FFF;
+
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+    half++;
+
+  return sign | static_cast<uint16_t>(half);
+}
+
+static void DownsampleRowHalf(const uint8_t *row0, const uint8_t *row1,
+                              uint8_t *dst, int srcWidth, int dstWidth) {
+  const uint16_t *src0 = reinterpret_cast<const uint16_t *>(row0);
+  const uint16_t *src1 = reinterpret_cast<const uint16_t *>(row1);
+  uint16_t *cDst = reinterpret_cast<uint16_t *>(dst);
+
+  for (int x = 0; x < dstWidth; x++) {
+    const int x0 = x * 8;
+    const int x1 = std::min(x * 2 + 1, srcWidth - 1) * 4;
+
+    for (int c = 0; c < 4; c++)
+      cDst[x * 4 + c] = FloatToHalf(
+          (HalfToFloat(src0[x0 + c]) + HalfToFloat(src0[x1 + c]) +
+           HalfToFloat(src1[x0 + c]) + HalfToFloat(src1[x1 + c])) *
+          0.25f);
+  }
+}
+
+static row_func RowFunction(MipFormat format) {
+  switch (format) {
+  case MipFormat::RGBA8_SRGB:
+    return DownsampleRowSRGB;
+  case MipFormat::RG8:
+    return DownsampleRow8<2>;
+  case MipFormat::R8:
+    return DownsampleRow8<1>;
+  case MipFormat::RGBA16F:
+    return DownsampleRowHalf;
+  default:
+    return DownsampleRow8<4>;
+  }
+}
+
+// Large levels are split into bands of rows, processed in parallel
+static void DownsampleLevel(const uint8_t *src, int srcWidth, int srcHeight,
+                            uint8_t *dst, int dstWidth, int dstHeight,
+                            int pixelSize, row_func func, int numWorkers) {
+  const size_t srcPitch = static_cast<size_t>(srcWidth) * pixelSize;
+  const size_t dstPitch = static_cast<size_t>(dstWidth) * pixelSize;
+
+  auto rows = [&](int begin, int end) {
+    for (int y = begin; y < end; y++)
+      func(src + y * 2 * srcPitch,
+           src + std::min(y * 2 + 1, srcHeight - 1) * srcPitch,
+           dst + y * dstPitch, srcWidth, dstWidth);
+  };
+
+  const size_t numPixels = static_cast<size_t>(dstWidth) * dstHeight;
+  const int numTasks =
+      numPixels < MIN_PARALLEL_PIXELS
+          ? 1
+          : std::min(numWorkers, dstHeight / MIN_ROWS_PER_TASK);
+
+  if (numTasks < 2) {
+    rows(0, dstHeight);
+    return;
+  }
+
+  std::vector<std::thread> tasks;
+  const int rowsPerTask = (dstHeight + numTasks - 1) / numTasks;
+
+  for (int t = 1; t < numTasks; t++)
+    tasks.emplace_back(rows, t * rowsPerTask,
+                       std::min((t + 1) * rowsPerTask, dstHeight));
+
+  rows(0, std::min(rowsPerTask, dstHeight));
+
+  for (auto &t : tasks)
+    t.join();
+}
+
+std::string GenerateMipmaps(const char *data, int width, int height,
+                            int numElements, MipFormat format,
+                            int numWorkers) {
+  const int pixelSize = PixelSize(format);
+  const int numMips = NumMipmaps(width, height);
+  const row_func func = RowFunction(format);
+  const size_t level0Size = static_cast<size_t>(width) * height * pixelSize;
+  size_t chainSize = 0;
+
+  for (int m = 0; m < numMips; m++)
+    chainSize += static_cast<size_t>(std::max(width >> m, 1)) *
+                 std::max(height >> m, 1) * pixelSize;
+
+  std::string retVal(chainSize * numElements, 0);
+
+  for (int e = 0; e < numElements; e++) {
+    uint8_t *cChain = reinterpret_cast<uint8_t *>(&retVal[e * chainSize]);
+    memcpy(cChain, data + e * level0Size, level0Size);
+
+    const uint8_t *src = cChain;
+    uint8_t *dst = cChain + level0Size;
+
+    for (int m = 1; m < numMips; m++) {
+      const int srcWidth = std::max(width >> (m - 1), 1);
+      const int srcHeight = std::max(height >> (m - 1), 1);
+      const int dstWidth = std::max(width >> m, 1);
+      const int dstHeight = std::max(height >> m, 1);
+
+      DownsampleLevel(src, srcWidth, srcHeight, dst, dstWidth, dstHeight,
+                      pixelSize, func, numWorkers);
+
+      src = dst;
+      dst += static_cast<size_t>(dstWidth) * dstHeight * pixelSize;
+    }
+  }
+
+  return retVal;
+}
@@ -0,0 +1,37 @@
+/*      MipGenerator
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <string>
+
+// Uncompressed layouts, mipmaps can be generated for.
+// RGBA8 covers BGRA8 too, sRGB variants are filtered in linear space.
+enum class MipFormat { RGBA8, RGBA8_SRGB, RG8, R8, RGBA16F };
+
+// Returns false for formats without mipmap generation support.
+bool MipFormatFromDXGI(int dxgiFormat, MipFormat &format);
+
+// Number of mipmaps of full chain, down to 1x1.
+int NumMipmaps(int width, int height);
+
+// Generates full mipmap chain for each of numElements consecutive images
+// (array elements or cubemap faces), using 2x2 box filter.
+// Returned buffer is in DDS order, each element with its chain.
+// Large levels are split between up to numWorkers threads.
+std::string GenerateMipmaps(const char *data, int width, int height,
+                            int numElements, MipFormat format,
+                            int numWorkers);
@@ -0,0 +1,143 @@
+/*      Preview
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Preview.hpp"
+#include "BlockDecoder.hpp"
+#include "TextureInfo.hpp"
+#include "datas/MasterPrinter.hpp"
+#include "datas/fileinfo.hpp"
+#include "formats/DDS.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+static constexpr size_t TGA_HEADER_SIZE = 18;
+
+static int WriteTGA(const TSTRING &path, int width, int height,
+                    std::string &rgba) {
+  uint8_t header[TGA_HEADER_SIZE] = {};
+  header[2] = 2; // Uncompressed true color
+  header[12] = static_cast<uint8_t>(width);
+  header[13] = static_cast<uint8_t>(width >> 8);
+  header[14] = static_cast<uint8_t>(height);
+  header[15] = static_cast<uint8_t>(height >> 8);
+  header[16] = 32;
+  header[17] = 0x28; // Top left origin, 8 alpha bits
+
+  for (size_t p = 0; p < rgba.size(); p += 4)
+    std::swap(rgba[p], rgba[p + 2]);
+
+  RawFile ofs(path, RawFile::WRITE);
+
+  if (!ofs.IsValid()) {
+    printerror("Cannot create file: ", << path);
+    return 1;
+  }
+
+  if (!ofs.WriteAt(0, {{reinterpret_cast<const char *>(header),
+                        TGA_HEADER_SIZE},
+                       {rgba.data(), rgba.size()}})) {
+    printerror("Cannot write file: ", << path);
+    return 1;
+  }
+
+  return 0;
+}
+
+int WritePreview(const TSTRING &path, int size) {
+  RawFile input(path, RawFile::READ);
+  AVTX tx;
+
+  if (!input.IsValid() || !ReadAVTXHeader(input, tx)) {
+    printerror("Cannot read AVTX header.");
+    return 1;
+  }
+
+  // Mipmaps of first array element or cubemap face
+  DDS tex = {};
+  tex = DDSFormat_DX10;
+  tex.dxgiFormat = static_cast<DXGI_FORMAT>(tx.format);
+  tex.width = tx.width;
+  tex.height = tx.height;
+  tex.arraySize = 1;
+  tex.NumMipmaps(tx.mipCount);
+  tex.ComputeBPP();
+
+  DDS::Mips mips = {};
+
+  if (!tex.ComputeBufferSize(mips) || tx.mipCount < 1 ||
+      tx.mipCount > DDS::Mips::maxMips) {
+    printerror("Unsupported AVTX format.");
+    return 1;
+  }
+
+  // Smallest mipmaps are resident in .ddsc, the rest is streamed
+  const int firstMip = tx.flags[AVTX::Flag_ExternalBuffers]
+                           ? tx.mipCount - tx.headerMipCount
+                           : 0;
+
+  if (firstMip < 0 || firstMip >= tx.mipCount) {
+    printerror("No mipmaps resident in AVTX header.");
+    return 1;
+  }
+
+  int bestMip = firstMip;
+
+  for (int m = firstMip + 1; m < tx.mipCount; m++) {
+    const int bestSize = std::max(tx.width >> bestMip, tx.height >> bestMip);
+    const int mipSize = std::max(tx.width >> m, tx.height >> m);
+
+    if (std::abs(mipSize - size) < std::abs(bestSize - size))
+      bestMip = m;
+  }
+
+  size_t mipOffset = mips.offsets[bestMip] - mips.offsets[firstMip];
+  const size_t mipSize = mips.sizes[bestMip];
+
+  // Cubemap faces are stored mipmap after mipmap, first face is used
+  if (tx.flags[AVTX::Flag_CubeMap])
+    mipOffset *= 6;
+
+  if (mipOffset + mipSize > tx.entries[0].size) {
+    printerror("AVTX header mipmaps are truncated.");
+    return 1;
+  }
+
+  std::string mipData(mipSize, 0);
+
+  if (!input.ReadAt(tx.entries[0].offset + mipOffset, &mipData[0], mipSize)) {
+    printerror("Cannot read AVTX mipmap.");
+    return 1;
+  }
+
+  const int width = std::max(tx.width >> bestMip, 1);
+  const int height = std::max(tx.height >> bestMip, 1);
+  std::string rgba;
+
+  if (!DecodeImage(mipData.data(), mipData.size(), width, height, tx.format,
+                   rgba)) {
+    printerror("Cannot decode AVTX format: ", << tx.format);
+    return 1;
+  }
+
+  TFileInfo fleInfo = path;
+  const TSTRING outPath =
+      fleInfo.GetPath() + fleInfo.GetFileName() + _T(".tga");
+
+  return WriteTGA(outPath, width, height, rgba);
+}
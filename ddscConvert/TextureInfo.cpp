@@ -0,0 +1,249 @@
+/*      TextureInfo
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "TextureInfo.hpp"
+#include "datas/MasterPrinter.hpp"
+#include "formats/DDS.hpp"
+#include <algorithm>
+#include <cstring>
+
+static_assert(sizeof(AVTX) >= AVTX_HEADER_SIZE, "AVTX header mismatch");
+
+bool ReadAVTXHeader(const RawFile &file, AVTX &tx) {
+  char header[AVTX_HEADER_SIZE];
+
+  if (!file.ReadAt(0, header, AVTX_HEADER_SIZE))
+    return false;
+
+  memcpy(static_cast<void *>(&tx), header, AVTX_HEADER_SIZE);
+
+  return tx.magic == AVTX::ID;
+}
+
+static bool ReadAVTXInfo(const RawFile &file, TextureInfo &info) {
+  AVTX tx;
+
+  if (!ReadAVTXHeader(file, tx))
+    return false;
+
+  info.type = "AVTX";
+  info.format = tx.format;
+  info.width = tx.width;
+  info.height = tx.height;
+  info.mipCount = tx.mipCount;
+  info.headerMipCount = tx.headerMipCount;
+  info.arraySize = tx.numArrayElements;
+  info.cubemap = tx.flags[AVTX::Flag_CubeMap];
+  info.externalBuffers = tx.flags[AVTX::Flag_ExternalBuffers];
+  info.noTiling = tx.flags[AVTX::Flag_NoTiling];
+
+  for (auto &e : tx.entries)
+    if (e.flags[AVTX::Entry::Flag_Used])
+      info.entries.push_back({e.externalID, e.size});
+
+  return true;
+}
+
+static bool ReadDDSInfo(const RawFile &file, TextureInfo &info) {
+  DDS tex = {};
+
+  if (!file.ReadAt(0, reinterpret_cast<char *>(&tex), tex.LEGACY_SIZE) ||
+      tex.magic != DDS::ID)
+    return false;
+
+  if (tex.fourCC == DDSFormat_DX10.fourCC) {
+    if (!file.ReadAt(tex.LEGACY_SIZE,
+                     reinterpret_cast<char *>(
+                         &static_cast<DDS_HeaderDX10 &>(tex)),
+                     sizeof(DDS_HeaderDX10)))
+      return false;
+  } else if (tex.FromLegacy()) {
+    tex.dxgiFormat = DXGI_FORMAT_UNKNOWN;
+    tex.arraySize = 1;
+  }
+
+  info.type = "DDS";
+  info.format = tex.dxgiFormat;
+  info.width = tex.width;
+  info.height = tex.height;
+  info.mipCount = tex.mipMapCount ? static_cast<int>(tex.mipMapCount) : 1;
+  info.headerMipCount = info.mipCount;
+  info.arraySize = tex.arraySize;
+  info.cubemap = tex.caps01[DDS::Caps01Flags_CubeMap];
+  info.externalBuffers = false;
+  info.noTiling = false;
+
+  return true;
+}
+
+bool ReadTextureInfo(const TSTRING &path, TextureInfo &info) {
+  RawFile file(path, RawFile::READ);
+  int ID;
+
+  if (!file.IsValid() ||
+      !file.ReadAt(0, reinterpret_cast<char *>(&ID), sizeof(ID)))
+    return false;
+
+  info.path = path;
+
+  if (ID == AVTX::ID)
+    return ReadAVTXInfo(file, info);
+
+  if (ID == DDS::ID)
+    return ReadDDSInfo(file, info);
+
+  return false;
+}
+
+void TextureInventory::Add(TextureInfo &&info) {
+  std::lock_guard<std::mutex> lock(mutex);
+  infos.push_back(std::move(info));
+}
+
+void TextureInventory::Sort() {
+  std::sort(infos.begin(), infos.end(),
+            [](const TextureInfo &i1, const TextureInfo &i2) {
+              return i1.path < i2.path;
+            });
+}
+
+static int WriteOutput(const TSTRING &path, const std::string &data) {
+  RawFile ofs(path, RawFile::WRITE);
+
+  if (!ofs.IsValid()) {
+    printerror("Cannot create file: ", << path);
+    return 1;
+  }
+
+  if (!ofs.WriteAt(0, data.data(), data.size())) {
+    printerror("Cannot write file: ", << path);
+    return 1;
+  }
+
+  return 0;
+}
+
+static void AppendJSONString(std::string &out, const std::string &value) {
+  static const char hexDigits[] = "0123456789abcdef";
+  out.push_back('"');
+
+  for (auto c : value) {
+    if (c == '"' || c == '\\') {
+      out.push_back('\\');
+      out.push_back(c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      out.append("\\u00");
+      out.push_back(hexDigits[c >> 4]);
+      out.push_back(hexDigits[c & 0xF]);
+    } else {
+      out.push_back(c);
+    }
+  }
+
+  out.push_back('"');
+}
+
+static void AppendCSVString(std::string &out, const std::string &value) {
+  if (value.find_first_of(",\"\r\n") == value.npos) {
+    out.append(value);
+    return;
+  }
+
+  out.push_back('"');
+
+  for (auto c : value) {
+    if (c == '"')
+      out.push_back('"');
+
+    out.push_back(c);
+  }
+
+  out.push_back('"');
+}
+
+static const char *BoolName(bool value) { return value ? "true" : "false"; }
+
+int TextureInventory::WriteJSON(const TSTRING &path) {
+  Sort();
+  std::string out = "[\n";
+
+  for (auto &i : infos) {
+    out.append("  {\"path\": ");
+    AppendJSONString(out, esString(i.path));
+    out.append(", \"type\": \"").append(i.type);
+    out.append("\", \"format\": ").append(std::to_string(i.format));
+    out.append(", \"width\": ").append(std::to_string(i.width));
+    out.append(", \"height\": ").append(std::to_string(i.height));
+    out.append(", \"mipCount\": ").append(std::to_string(i.mipCount));
+    out.append(", \"headerMipCount\": ")
+        .append(std::to_string(i.headerMipCount));
+    out.append(", \"arraySize\": ").append(std::to_string(i.arraySize));
+    out.append(", \"cubemap\": ").append(BoolName(i.cubemap));
+    out.append(", \"externalBuffers\": ").append(BoolName(i.externalBuffers));
+    out.append(", \"noTiling\": ").append(BoolName(i.noTiling));
+    out.append(", \"entries\": [");
+
+    for (auto &e : i.entries) {
+      if (&e != i.entries.data())
+        out.append(", ");
+
+      out.append("{\"externalID\": ").append(std::to_string(e.externalID));
+      out.append(", \"size\": ").append(std::to_string(e.size)).append("}");
+    }
+
+    out.append(&i == &infos.back() ? "]}\n" : "]},\n");
+  }
+
+  out.append("]\n");
+
+  return WriteOutput(path, out);
+}
+
+int TextureInventory::WriteCSV(const TSTRING &path) {
+  Sort();
+  std::string out = "path,type,format,width,height,mipCount,headerMipCount,"
+                    "arraySize,cubemap,externalBuffers,noTiling,entries\n";
+
+  for (auto &i : infos) {
+    AppendCSVString(out, esString(i.path));
+    out.append(",").append(i.type);
+    out.append(",").append(std::to_string(i.format));
+    out.append(",").append(std::to_string(i.width));
+    out.append(",").append(std::to_string(i.height));
+    out.append(",").append(std::to_string(i.mipCount));
+    out.append(",").append(std::to_string(i.headerMipCount));
+    out.append(",").append(std::to_string(i.arraySize));
+    out.append(",").append(BoolName(i.cubemap));
+    out.append(",").append(BoolName(i.externalBuffers));
+    out.append(",").append(BoolName(i.noTiling));
+    out.push_back(',');
+
+    // externalID:size pairs
+    for (auto &e : i.entries) {
+      if (&e != i.entries.data())
+        out.push_back(' ');
+
+      out.append(std::to_string(e.externalID))
+          .append(":")
+          .append(std::to_string(e.size));
+    }
+
+    out.push_back('\n');
+  }
+
+  return WriteOutput(path, out);
+}
@@ -0,0 +1,71 @@
+/*      TextureInfo
+        Copyright(C) 2019 Lukas Cone
+
+        This program is free software : you can redistribute it and / or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "AVTX.h"
+#include "RawFile.hpp"
+#include <mutex>
+#include <string>
+#include <vector>
+
+// On disk size, AVTX class holds more than that
+static constexpr size_t AVTX_HEADER_SIZE = 128;
+
+// Reads only on disk part of AVTX header.
+bool ReadAVTXHeader(const RawFile &file, AVTX &tx);
+
+struct TextureInfo {
+  struct Entry {
+    int externalID;
+    size_t size;
+  };
+
+  TSTRING path;
+  const char *type;
+  int format;
+  int width;
+  int height;
+  int mipCount;
+  int headerMipCount;
+  int arraySize;
+  bool cubemap;
+  bool externalBuffers;
+  bool noTiling;
+  // Used AVTX entries
+  std::vector<Entry> entries;
+};
+
+// Reads AVTX or DDS header only.
+// Returns false for other files or truncated header.
+bool ReadTextureInfo(const TSTRING &path, TextureInfo &info);
+
+// Collects texture headers from concurrent file handlers.
+class TextureInventory {
+public:
+  void Add(TextureInfo &&info);
+  size_t Size() const { return infos.size(); }
+
+  // Textures are sorted by path.
+  int WriteJSON(const TSTRING &path);
+  int WriteCSV(const TSTRING &path);
+
+private:
+  std::mutex mutex;
+  std::vector<TextureInfo> infos;
+
+  void Sort();
+};
@@ -16,6 +16,14 @@
 */
 
 #include "AVTX.h"
+#include "BlockEncoder.hpp"
+#include "ContentStore.hpp"
+#include "Manifest.hpp"
+#include "MappedFile.hpp"
+#include "MipGenerator.hpp"
+#include "Preview.hpp"
+#include "RawFile.hpp"
+#include "TextureInfo.hpp"
 #include "datas/DirectoryScanner.hpp"
 #include "datas/MultiThread.hpp"
 #include "datas/SettingsManager.hpp"
@@ -24,6 +32,8 @@
 #include "formats/DDS.hpp"
 #include "project.h"
 #include "pugixml.hpp"
+#include <algorithm>
+#include <atomic>
 
 static struct ddscConvert : SettingsManager {
   DECLARE_REFLECTOR;
@@ -34,22 +44,30 @@ static struct ddscConvert : SettingsManager {
   bool No_Tiling = true;
   bool Extract_largest_mipmap = false;
   bool Folder_scan_DDSC_only = true;
+  bool Incremental_conversion = false;
+  int Preview_size = 0;
+  std::string Info_format = "none";
   int Number_of_ATX_levels = 2;
   int ATX_level0_max_resolution = 256;
   int ATX_level1_max_resolution = 1024;
   int ATX_level2_max_resolution = 2048;
+  std::string Encode_format = "none";
+  int Encode_quality = 1;
 } settings;
 
 REFLECTOR_START_WNAMES(ddscConvert, Convert_DDS_to_legacy,
                        Force_unconvetional_legacy_formats,
                        Extract_largest_mipmap, Folder_scan_DDSC_only,
+                       Incremental_conversion, Preview_size, Info_format,
                        Generate_Log, Number_of_ATX_levels, Use_HMDDSC,
                        ATX_level0_max_resolution, ATX_level1_max_resolution,
-                       ATX_level2_max_resolution, No_Tiling);
+                       ATX_level2_max_resolution, No_Tiling, Encode_format,
+                       Encode_quality);
 
 static int levelResolutions[] = {0x8000, 0x8000, 0x8000, 0x8000, 0x8000};
 static const char help[] = "\nConverts between AVTX and DDS formats.\n\
-If a DDS is being converted to AVTX, make sure that DDS is properly encoded and have generated full mipmap chain.\n\n\
+If a DDS is being converted to AVTX, make sure that DDS is properly encoded and have generated full mipmap chain.\n\
+Missing mipmaps are generated for RGBA8, BGRA8, RG8, R8 and RGBA16F formats.\n\n\
 Settings (.config file):\n\
   Convert_DDS_to_legacy: \n\
         Tries to convert AVTX into legacy (DX9) DDS format.\n\
@@ -63,6 +81,21 @@ Settings (.config file):\n\
   Folder_scan_DDSC_only:\n\
         When providing input parameter as folder, program will scan only DDSC files.\n\
         When false, program will scan for DDS files only.\n\
+  Incremental_conversion:\n\
+        Converts only files, that changed since their last conversion,\n\
+        or were converted with other settings, or their output is missing.\n\
+        Streamed atx and hmddsc files are checked with their DDSC file.\n\
+        Converted files are recorded into ddscConvert.manifest\n\
+        next to application, manifest can be shared by concurrent runs.\n\
+  Preview_size:\n\
+        When above 0, DDSC files are not converted, TGA preview is written instead.\n\
+        Mipmap stored in DDSC, closest to this size is used, ATX files are not read.\n\
+        DDS files are skipped and only DDSC files are scanned in folders.\n\
+  Info_format:\n\
+        none, json or csv. When set, files are not converted,\n\
+        only their AVTX or DDS headers are read and listed into\n\
+        ddscConvert_info.json or .csv next to application.\n\
+        Both DDSC and DDS files are scanned in folders.\n\
   Generate_Log: \n\
         Will generate text log of console output next to application location.\n\n\
 Following settings are for AVTX creation:\n\
@@ -78,31 +111,110 @@ Following settings are for AVTX creation:\n\
         Level 0 is main ddsc file, level 1 is atx1 or hmddsc file, \n\
         level 2 is for atx2 and so on.\n\
   No_Tiling: \n\
-        Texture should not tile. Should be used for object baked textures.\n\t";
+        Texture should not tile. Should be used for object baked textures.\n\
+  Encode_format: \n\
+        Block compression of uncompressed 8bit DDS input (RGBA, BGRA, RG, R).\n\
+        none, auto, bc1, bc3, bc4 or bc5.\n\
+        auto picks bc4 for R, bc5 for RG, bc1 or bc3 for RGBA depending on alpha.\n\
+  Encode_quality: \n\
+        0 is fastest, 1 is normal, 2 is best quality.\n\t";
 
 static const char pressKeyCont[] = "\nPress any key to close.";
 
-void FilehandleITFC(const TSTRING &fle) {
+static TextureInventory inventory;
+static Manifest manifest;
+static uint64_t settingsHash;
+static std::atomic<size_t> numUpToDate(0);
+static std::atomic<int> numActiveFiles(0);
+
+// Files are converted in parallel already, threads are split between them
+static int FileWorkers() {
+  const int numThreads =
+      std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+
+  return std::max(numThreads / std::max(numActiveFiles.load(), 1), 1);
+}
+
+// Hash of settings, that affect conversion output
+static uint64_t SettingsHash() {
+  std::string key;
+  auto append = [&](int value) {
+    key.append(std::to_string(value)).push_back(';');
+  };
+
+  append(settings.Number_of_ATX_levels);
+
+  for (int l = 0; l < settings.Number_of_ATX_levels; l++)
+    append(levelResolutions[l]);
+
+  append(settings.Use_HMDDSC);
+  append(settings.No_Tiling);
+  append(settings.Convert_DDS_to_legacy);
+  append(settings.Force_unconvetional_legacy_formats);
+  append(settings.Extract_largest_mipmap);
+  append(settings.Encode_quality);
+  key.append(settings.Encode_format);
+
+  Hash64 hash;
+  hash.Update(key.data(), key.size());
+
+  return hash.Digest();
+}
+
+// Files read and written by conversion
+struct ConvertedFiles {
+  std::vector<TSTRING> inputs;
+  std::vector<TSTRING> outputs;
+};
+
+// Returns 0, when all output files were written
+static int ConvertFile(const TSTRING &fle, ConvertedFiles &files) {
   printline("Loading file: ", << fle);
   BinReader rd(fle);
 
   if (!rd.IsValid()) {
     printerror("Cannot open file.");
-    return;
+    return 1;
   }
 
   int ID;
   rd.Read(ID);
   rd.Seek(0);
 
-  if (ID == AVTX::ID) {
+  if (ID == AVTX::ID && settings.Preview_size > 0) {
+    return WritePreview(fle, settings.Preview_size);
+  } else if (settings.Preview_size > 0) {
+    printwarning("Preview_size is set, skipping non DDSC file.");
+  } else if (ID == AVTX::ID) {
     printline("Converting AVTX -> DDS.");
     AVTX tx;
     tx.Load(fle.c_str(), &rd);
 
     TFileInfo fleInfo = fle;
-    std::ofstream ofs(fleInfo.GetPath() + fleInfo.GetFileName() + _T(".dds"),
-                      std::ios::out | std::ios::binary);
+    const TSTRING outPath =
+        fleInfo.GetPath() + fleInfo.GetFileName() + _T(".dds");
+    files.inputs.push_back(fle);
+    files.outputs.push_back(outPath);
+
+    // Streamed mipmaps are in atxN or hmddsc files, missing ones are
+    // recorded too
+    for (auto &e : tx.entries) {
+      if (!e.flags[AVTX::Entry::Flag_Used] || e.externalID < 1)
+        continue;
+
+      const TSTRING levelPath = fleInfo.GetPath() + fleInfo.GetFileName() +
+                                _T(".atx") + ToTSTRING(e.externalID);
+
+      if (std::find(files.inputs.begin(), files.inputs.end(), levelPath) !=
+          files.inputs.end())
+        continue;
+
+      files.inputs.push_back(levelPath);
+
+      if (e.externalID == 1)
+        files.inputs.push_back(fleInfo.GetPath() + fleInfo.GetFileName() +
+                               _T(".hmddsc"));
+    }
 
     DDS tex = {};
     tex = DDSFormat_DX10;
@@ -145,7 +257,10 @@ void FilehandleITFC(const TSTRING &fle) {
       printwarning("Couldn't convert DX10 dds to legacy.")
     }
 
-    ofs.write(reinterpret_cast<const char *>(&tex), sizetoWrite);
+    // Header and payload slices in DDS order, written at once
+    std::vector<RawFile::Slice> slices = {
+        {reinterpret_cast<const char *>(&tex),
+         static_cast<size_t>(sizetoWrite)}};
 
     if (tx.flags[AVTX::Flag_CubeMap] && tx.mipCount > 1) {
       DDS::Mips cubes[6] = {};
@@ -155,7 +270,7 @@ void FilehandleITFC(const TSTRING &fle) {
 
       if (!bufferSize) {
         printerror("Unsupported DDS format.");
-        return;
+        return 1;
       }
 
       for (int c = 1; c < 6; c++)
@@ -175,7 +290,8 @@ void FilehandleITFC(const TSTRING &fle) {
 
       for (int c = 0; c < 6; c++)
         for (int m = 0; m < tx.mipCount; m++)
-          ofs.write(tx.buffer + cubes[c].offsets[m], cubes[c].sizes[m]);
+          slices.push_back({tx.buffer + cubes[c].offsets[m],
+                            static_cast<size_t>(cubes[c].sizes[m])});
 
     } else {
       int oBufferSize = tx.BufferSize();
@@ -188,10 +304,20 @@ void FilehandleITFC(const TSTRING &fle) {
           oBufferSize = rMips.sizes[0];
       }
 
-      ofs.write(tx.buffer, oBufferSize);
+      slices.push_back({tx.buffer, static_cast<size_t>(oBufferSize)});
     }
 
-    ofs.close();
+    RawFile ofs(outPath, RawFile::WRITE);
+
+    if (!ofs.IsValid()) {
+      printerror("Cannot create file: ", << outPath);
+      return 1;
+    }
+
+    if (!ofs.WriteAt(0, slices)) {
+      printerror("Cannot write file: ", << outPath);
+      return 1;
+    }
   } else if (ID == DDS::ID) {
     printline("Converting DDS -> AVTX.");
     DDS tex = {};
@@ -199,7 +325,7 @@ void FilehandleITFC(const TSTRING &fle) {
 
     if (tex.caps01[DDS::Caps01Flags_Volume]) {
       printerror("Volumetric DDS textures are not supported.");
-      return;
+      return 1;
     }
 
     if (tex.caps01[DDS::Caps01Flags_CubeMap]) {
@@ -210,37 +336,116 @@ void FilehandleITFC(const TSTRING &fle) {
           tex.caps01[DDS::Caps01Flags_CubeMap_PositiveY] &&
           tex.caps01[DDS::Caps01Flags_CubeMap_PositiveZ]) {
         printerror("Cubemap DDS must have all sides.");
-        return;
+        return 1;
       }
     }
 
     if (tex.fourCC != DDSFormat_DX10.fourCC) {
       if (tex.FromLegacy()) {
         printerror("DDS file cannot be converted to DX10!");
-        return;
+        return 1;
       }
     } else {
       rd.Read(static_cast<DDS_HeaderDX10 &>(tex));
     }
 
-    if (tex.mipMapCount < 2) {
-      printerror("DDS file must have generated mipmaps.");
-      return;
+    const int numElements =
+        tex.arraySize * (tex.caps01[DDS::Caps01Flags_CubeMap] ? 6 : 1);
+    const bool generateMips = tex.mipMapCount < 2;
+    MipFormat mipFormat;
+
+    if (generateMips) {
+      if (!MipFormatFromDXGI(tex.dxgiFormat, mipFormat)) {
+        printerror("DDS file must have generated mipmaps. They can be "
+                   "generated only for RGBA8, BGRA8, RG8, R8 and RGBA16F "
+                   "formats.");
+        return 1;
+      }
+
+      if (NumMipmaps(tex.width, tex.height) > DDS::Mips::maxMips) {
+        printerror("DDS file is too large to generate mipmaps.");
+        return 1;
+      }
+
+      tex.NumMipmaps(1);
     }
 
     DDS::Mips dMips = {};
     int mipIDs[DDS::Mips::maxMips] = {};
     tex.ComputeBPP();
-    const int bufferSize = tex.ComputeBufferSize(dMips) * tex.arraySize *
-                           (tex.caps01[DDS::Caps01Flags_CubeMap] ? 6 : 1);
+    int bufferSize = tex.ComputeBufferSize(dMips) * numElements;
 
     if (!bufferSize) {
       printerror("Usupported DDS format.");
-      return;
+      return 1;
     }
 
-    char *masterBuffer = static_cast<char *>(malloc(bufferSize));
-    rd.ReadBuffer(masterBuffer, bufferSize);
+    // Pixel data are written straight from mapped input
+    const size_t dataOffset = rd.Tell();
+    MappedFile input(fle);
+
+    if (!input.IsValid() || input.Size() < dataOffset + bufferSize) {
+      printerror("DDS file is truncated.");
+      return 1;
+    }
+
+    const char *masterBuffer = input.Data() + dataOffset;
+    std::string generatedBuffer;
+
+    if (generateMips) {
+      const int numMips = NumMipmaps(tex.width, tex.height);
+      generatedBuffer = GenerateMipmaps(masterBuffer, tex.width, tex.height,
+                                        numElements, mipFormat, FileWorkers());
+      tex.NumMipmaps(numMips);
+      dMips = {};
+      bufferSize = tex.ComputeBufferSize(dMips) * numElements;
+
+      if (static_cast<size_t>(bufferSize) != generatedBuffer.size()) {
+        printerror("Cannot generate mipmaps.");
+        return 1;
+      }
+
+      masterBuffer = generatedBuffer.data();
+      printline("Generated ", << numMips - 1 << " mipmaps.");
+    }
+
+    EncodeSource encodeSource;
+    std::string encodedBuffer;
+
+    if (settings.Encode_format != "none" &&
+        EncodeSourceFromDXGI(tex.dxgiFormat, encodeSource)) {
+      BlockFormat blockFormat;
+
+      if (settings.Encode_format == "auto")
+        blockFormat = DefaultBlockFormat(
+            masterBuffer, bufferSize / encodeSource.numChannels, encodeSource);
+      else
+        BlockFormatFromName(settings.Encode_format, blockFormat);
+
+      if (!CanEncode(encodeSource, blockFormat)) {
+        printerror("Cannot encode ", << BlockFormatName(blockFormat)
+                                     << " from this DDS format.");
+        return 1;
+      }
+
+      encodedBuffer = EncodeMipChains(
+          masterBuffer, tex.width, tex.height, tex.mipMapCount, numElements,
+          encodeSource, blockFormat,
+          static_cast<EncodeQuality>(settings.Encode_quality), FileWorkers());
+      tex.dxgiFormat = static_cast<DXGI_FORMAT>(
+          BlockFormatDXGI(blockFormat, encodeSource.sRGB));
+      tex.ComputeBPP();
+      dMips = {};
+      bufferSize = tex.ComputeBufferSize(dMips) * numElements;
+
+      if (static_cast<size_t>(bufferSize) != encodedBuffer.size()) {
+        printerror("Cannot encode texture.");
+        return 1;
+      }
+
+      masterBuffer = encodedBuffer.data();
+      printline("Encoded as ", << BlockFormatName(blockFormat));
+    }
 
     AVTX tx;
     tx.flags(AVTX::Flag_ExternalBuffers,
@@ -263,19 +468,17 @@ void FilehandleITFC(const TSTRING &fle) {
       tx.headerMipCount = tx.mipCount;
 
     TFileInfo fleInfo = fle;
-    TSTRING masterFileName =
+    const TSTRING masterFileName =
         fleInfo.GetPath() + fleInfo.GetFileName() + _T(".ddsc");
-    std::ofstream ddscStream(masterFileName, std::ios::out | std::ios::binary);
-    ddscStream.write(reinterpret_cast<char *>(&tx), sizeof(AVTX));
+    // Output files and their slices, first is ddsc
+    std::vector<TSTRING> fileNames = {masterFileName};
+    std::vector<std::vector<RawFile::Slice>> fileSlices(1);
 
     if (!tx.flags[AVTX::Flag_ExternalBuffers] &&
         !tex.caps01[DDS::Caps01Flags_CubeMap]) {
-      ddscStream.write(masterBuffer, bufferSize);
-      ddscStream.close();
-      return;
-    }
-
-    if (tex.caps01[DDS::Caps01Flags_CubeMap]) {
+      fileSlices[0].push_back(
+          {masterBuffer, static_cast<size_t>(bufferSize)});
+    } else if (tex.caps01[DDS::Caps01Flags_CubeMap]) {
       DDS::Mips cubes[6] = {};
       const int sideSize = bufferSize / 6;
 
@@ -288,75 +491,132 @@ void FilehandleITFC(const TSTRING &fle) {
 
       for (int m = 0; m < tx.mipCount; m++)
         for (int c = 0; c < 6; c++)
-          ddscStream.write(masterBuffer + cubes[c].offsets[m],
-                           cubes[c].sizes[m]);
+          fileSlices[0].push_back({masterBuffer + cubes[c].offsets[m],
+                                   static_cast<size_t>(cubes[c].sizes[m])});
+    } else {
+      int _weight = 1, _height = 1, currentLevel = 0, externalMipID = 0,
+          mipOffsetWithinLevel = 0;
+
+      for (int m = tex.mipMapCount - 1; m >= 0; m--) {
+        mipIDs[m] = currentLevel;
+        if (!currentLevel) {
+          tx.entries[0].size += dMips.sizes[m];
+          tx.headerMipCount++;
+        } else {
+          tx.entries[externalMipID].externalID = currentLevel;
+          tx.entries[externalMipID].flags += AVTX::Entry::Flag_Used;
+          tx.entries[externalMipID].offset = mipOffsetWithinLevel;
+          tx.entries[externalMipID].size = dMips.sizes[m];
+          mipOffsetWithinLevel += dMips.sizes[m];
+          externalMipID++;
+        }
 
-      ddscStream.close();
-      return;
-    }
+        _weight *= 2;
+        _height *= 2;
+
+        if ((_weight | _height) > levelResolutions[currentLevel]) {
+          if (!currentLevel)
+            externalMipID++;
 
-    int _weight = 1, _height = 1, currentLevel = 0, externalMipID = 0,
-        mipOffsetWithinLevel = 0;
-
-    for (int m = tex.mipMapCount - 1; m >= 0; m--) {
-      mipIDs[m] = currentLevel;
-      if (!currentLevel) {
-        tx.entries[0].size += dMips.sizes[m];
-        tx.headerMipCount++;
-      } else {
-        tx.entries[externalMipID].externalID = currentLevel;
-        tx.entries[externalMipID].flags += AVTX::Entry::Flag_Used;
-        tx.entries[externalMipID].offset = mipOffsetWithinLevel;
-        tx.entries[externalMipID].size = dMips.sizes[m];
-        mipOffsetWithinLevel += dMips.sizes[m];
-        externalMipID++;
+          currentLevel++;
+          mipOffsetWithinLevel = 0;
+        }
       }
 
-      _weight *= 2;
-      _height *= 2;
+      for (int m = tex.mipMapCount - 1; m >= 0; m--) {
+        if (!mipIDs[m])
+          continue;
 
-      if ((_weight | _height) > levelResolutions[currentLevel]) {
-        if (!currentLevel)
-          externalMipID++;
+        if (mipIDs[m] >= static_cast<int>(fileNames.size())) {
+          TSTRING fileName = fleInfo.GetPath() + fleInfo.GetFileName();
 
-        currentLevel++;
-        mipOffsetWithinLevel = 0;
+          if (settings.Use_HMDDSC)
+            fileName.append(_T(".hmddsc"));
+          else
+            fileName.append(_T(".atx")) += ToTSTRING(mipIDs[m]);
+
+          fileNames.push_back(fileName);
+          fileSlices.emplace_back();
+        }
+
+        fileSlices[mipIDs[m]].push_back(
+            {masterBuffer + dMips.offsets[m],
+             static_cast<size_t>(dMips.sizes[m])});
       }
+
+      fileSlices[0].push_back(
+          {masterBuffer + (bufferSize - tx.entries[0].size),
+           static_cast<size_t>(tx.entries[0].size)});
     }
 
-    std::ofstream ofs;
-    currentLevel = 0;
+    fileSlices[0].insert(fileSlices[0].begin(),
+                         {reinterpret_cast<const char *>(&tx), sizeof(AVTX)});
 
-    for (int m = tex.mipMapCount - 1; m >= 0; m--) {
-      if (currentLevel != mipIDs[m]) {
-        currentLevel = mipIDs[m];
+    // Level files are written concurrently
+    std::atomic<bool> writeFailed(false);
+    auto writeFile = [&](size_t f) {
+      RawFile ofs(fileNames[f], RawFile::WRITE);
 
-        TSTRING fileName = fleInfo.GetPath() + fleInfo.GetFileName();
+      if (!ofs.IsValid()) {
+        printerror("Cannot create file: ", << fileNames[f]);
+        writeFailed = true;
+      } else if (!ofs.WriteAt(0, fileSlices[f])) {
+        printerror("Cannot write file: ", << fileNames[f]);
+        writeFailed = true;
+      }
+    };
 
-        if (settings.Use_HMDDSC)
-          fileName.append(_T(".hmddsc"));
-        else
-          fileName.append(_T(".atx")) += ToTSTRING(mipIDs[m]);
+    std::vector<std::thread> writers;
 
-        ofs.close();
-        ofs.clear();
-        ofs.open(fileName, std::ios::out | std::ios::binary);
-      }
+    for (size_t f = 1; f < fileNames.size(); f++)
+      writers.emplace_back(writeFile, f);
 
-      if (!currentLevel)
-        continue;
+    writeFile(0);
 
-      ofs.write(masterBuffer + dMips.offsets[m], dMips.sizes[m]);
-    }
+    for (auto &w : writers)
+      w.join();
+
+    if (writeFailed)
+      return 1;
 
-    ofs.close();
-    ofs.clear();
-    ddscStream.write(masterBuffer + (bufferSize - tx.entries[0].size),
-                     tx.entries[0].size);
-    ddscStream.close();
+    files.inputs.push_back(fle);
+    files.outputs = fileNames;
   } else {
-    printerror("Invalid file format.")
+    printerror("Invalid file format.");
+    return 1;
+  }
+
+  return 0;
+}
+
+void FilehandleITFC(const TSTRING &fle) {
+  if (settings.Info_format != "none") {
+    TextureInfo info;
+
+    if (ReadTextureInfo(fle, info)) {
+      inventory.Add(std::move(info));
+    } else {
+      printwarning("Not a texture: ", << fle);
+    }
+
+    return;
+  }
+
+  const bool incremental =
+      settings.Incremental_conversion && settings.Preview_size < 1;
+
+  if (incremental && manifest.IsUpToDate(fle, settingsHash)) {
+    numUpToDate++;
+    return;
   }
+
+  ConvertedFiles files;
+  numActiveFiles++;
+  const int result = ConvertFile(fle, files);
+  numActiveFiles--;
+
+  if (incremental && !result)
+    manifest.Update(fle, settingsHash, files.inputs, files.outputs);
 }
 
 struct TexQueueTraits {
@@ -382,11 +642,11 @@ struct TexQueueTraits {
 struct TexFolderQueueTraits {
   int queue = 0;
   int queueEnd;
-  DirectoryScanner ds;
+  std::vector<TSTRING> files;
   typedef void return_type;
 
   return_type RetreiveItem() {
-    const TSTRING &filepath = ds.Files()[queue];
+    const TSTRING &filepath = files[queue];
     FilehandleITFC(filepath);
   }
 
@@ -442,6 +702,34 @@ int _tmain(int argc, _TCHAR *argv[]) {
                  << settings.Number_of_ATX_levels);
   }
 
+  BlockFormat blockFormat;
+
+  if (settings.Encode_format != "none" && settings.Encode_format != "auto" &&
+      !BlockFormatFromName(settings.Encode_format, blockFormat)) {
+    printwarning("Encode_format: Unexpected value ",
+                 << esStringConvert<TCHAR>(settings.Encode_format.c_str())
+                 << _T(", textures won't be encoded."));
+    settings.Encode_format = "none";
+  }
+
+  if (settings.Encode_quality > 2 || settings.Encode_quality < 0) {
+    int temp = settings.Encode_quality;
+    settings.Encode_quality = settings.Encode_quality > 2 ? 2 : 0;
+
+    printwarning("Encode_quality: Unexpected value ",
+                 << temp << _T(", clamping to ") << settings.Encode_quality);
+  }
+
+  if (settings.Info_format != "none" && settings.Info_format != "json" &&
+      settings.Info_format != "csv") {
+    printwarning("Info_format: Unexpected value ",
+                 << esStringConvert<TCHAR>(settings.Info_format.c_str())
+                 << _T(", textures will be converted."));
+    settings.Info_format = "none";
+  }
+
+  const bool infoMode = settings.Info_format != "none";
+
   if (settings.Use_HMDDSC && settings.Number_of_ATX_levels > 1)
     settings.Number_of_ATX_levels = 1;
 
@@ -449,6 +737,16 @@ int _tmain(int argc, _TCHAR *argv[]) {
     levelResolutions[l] = *(&settings.ATX_level0_max_resolution + l);
   }
 
+  const TSTRING manifestPath =
+      configInfo.GetPath() + configInfo.GetFileName() + _T(".manifest");
+  const bool incrementalMode = settings.Incremental_conversion && !infoMode &&
+                               settings.Preview_size < 1;
+
+  if (incrementalMode) {
+    settingsHash = SettingsHash();
+    manifest.Load(manifestPath);
+  }
+
   const int nthreads = std::thread::hardware_concurrency();
   std::vector<std::thread> threadedfuncs(nthreads);
 
@@ -479,26 +777,67 @@ int _tmain(int argc, _TCHAR *argv[]) {
 
   if (folders.size()) {
     printer.PrintThreadID(false);
+    const bool scanDDSC = infoMode || settings.Folder_scan_DDSC_only ||
+                          settings.Preview_size > 0;
+    const bool scanDDS = infoMode || !scanDDSC;
     printline("Scanning folders for ",
-              << (settings.Folder_scan_DDSC_only ? "DDSC" : "DDS") << " files.");
+              << (scanDDSC && scanDDS ? "DDSC and DDS"
+                                      : scanDDSC ? "DDSC" : "DDS")
+              << " files.");
 
-    TexFolderQueueTraits flQue;
-    flQue.ds.AddFilter(settings.Folder_scan_DDSC_only ? _T(".ddsc") : _T(".dds"));
+    // Each folder is scanned on its own thread
+    std::vector<DirectoryScanner> scanners(folders.size());
+    std::vector<std::thread> scanThreads;
+
+    for (size_t f = 0; f < folders.size(); f++) {
+      if (scanDDSC)
+        scanners[f].AddFilter(_T(".ddsc"));
+
+      if (scanDDS)
+        scanners[f].AddFilter(_T(".dds"));
 
-    size_t lastFileCount = 0;
+      scanThreads.emplace_back([&, f] { scanners[f].Scan(folders[f]); });
+    }
+
+    TexFolderQueueTraits flQue;
 
-    for (auto &f : folders) {
-      printline("Scanning: ", << f);
-      flQue.ds.Scan(f);
-      printline("Files found: ", << flQue.ds.Files().size() - lastFileCount);
-      lastFileCount = flQue.ds.Files().size();
+    for (size_t f = 0; f < folders.size(); f++) {
+      scanThreads[f].join();
+      printline("Files found in ", << folders[f] << ": "
+                                   << scanners[f].Files().size());
+      flQue.files.insert(flQue.files.end(), scanners[f].Files().begin(),
+                         scanners[f].Files().end());
     }
 
-    printline("Scanning done, total files found: ", << lastFileCount);
-    flQue.queueEnd = static_cast<int>(lastFileCount);
+    printline("Scanning done, total files found: ", << flQue.files.size());
+    flQue.queueEnd = static_cast<int>(flQue.files.size());
     printer.PrintThreadID(true);
     RunThreadedQueue(flQue);
   }
 
+  if (incrementalMode) {
+    printer.PrintThreadID(false);
+    printline("Skipped up to date files: ", << numUpToDate);
+
+    if (manifest.Save())
+      return 2;
+  }
+
+  if (infoMode) {
+    printer.PrintThreadID(false);
+    const TSTRING infoPath = configInfo.GetPath() + configInfo.GetFileName() +
+                             (settings.Info_format == "json" ? _T("_info.json")
+                                                             : _T("_info.csv"));
+    const int result = settings.Info_format == "json"
+                           ? inventory.WriteJSON(infoPath)
+                           : inventory.WriteCSV(infoPath);
+
+    if (result)
+      return result;
+
+    printline("Listed ", << inventory.Size() << " textures into: "
+                         << infoPath);
+  }
+
   return 0;
 }
\ No newline at end of file